@@ -0,0 +1,524 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+// Benchmark.cpp : measures scanPath, chooseEngine, calculate_crc32, process_7z and dedup on a generated corpus,
+// how the archive scanning cost grows with the number of archive members for each archive backend,
+// the cost of the directory enumeration backends and the throughput of the CRC32 kernels.
+// The corpus is shaped by the command line options, see --help. --only selects benchmarks.
+// Output is CSV on stdout, one section per benchmark, each starting with its header line:
+// corpus,directories,archives,scanned_files,unique_files,bytes
+// benchmark,variant,files,bytes,seconds,us_per_file,mb_per_s
+// benchmark,variant,calls,seconds,ns_per_call
+// benchmark,variant,count,seconds,us_per_item[,stat_calls_per_item]
+// benchmark,kernel,bytes,seconds,gb_per_s
+// benchmark,variant,keys,seconds,ns_per_insert
+// benchmark,variant,lines,seconds,ns_per_line
+// benchmark,variant,updates,seconds,ns_per_update
+//
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+
+#include "DirectoryScanner.h"
+#include "DirEnumerator.h"
+#include "Crc32.h"
+#include "DedupStore.h"
+#include "ArchiveReader.h"
+#include "Logger.h"
+#include "ScanMetrics.h"
+#include "CorpusGenerator.h"
+
+#include <boost/program_options.hpp>
+
+//! scanner which only counts the files delivered and logs errors only
+class CCountingScanner : public CDirectoryScanner
+{
+public:
+	CCountingScanner(bool nozip = false)
+		: CDirectoryScanner(nozip, false, { ".*" }, { "" })
+		, m_filesProcessed(0)
+	{
+		parseCommandLineArguments({ "--quiet" });
+	}
+
+	virtual void process_file(const std::filesystem::path&, const std::filesystem::path&, crc_t) override
+	{
+		m_filesProcessed++;
+	}
+
+	virtual void process_batch(std::span<const CBatchEntry> entries) override
+	{
+		m_filesProcessed += entries.size();
+	}
+
+	size_t filesProcessed() const { return m_filesProcessed; }
+	uint64_t statCalls() const { return m_enumerator ? m_enumerator->statCalls() : 0; }
+
+	// the hot paths benchmarked on their own
+	bool isArchive(const std::filesystem::path& p)
+	{
+		EArchiveFormat format;
+		return chooseEngine(p, format) == eng7z;
+	}
+	using CDirectoryScanner::calculate_crc32;
+
+protected:
+	std::atomic<size_t> m_filesProcessed;
+};
+
+//! results of the measured loops are stored here, so the compiler can't drop the loops
+static volatile uint64_t s_resultSink;
+
+static void writeFile(const std::filesystem::path& p, const std::string& data)
+{
+	std::ofstream ofs(p, std::ios::binary);
+	ofs.write(data.data(), data.size());
+}
+
+static void benchmarkArchive(const std::filesystem::path& workDir, const std::string& backend, const std::string& format, size_t memberCount)
+{
+	std::filesystem::path archivePath = workDir / ("members_" + std::to_string(memberCount) + "." + format);
+	CCorpusGenerator::Members members;
+	for (size_t i = 0; i < memberCount; i++)
+		members.push_back({ "dir_" + std::to_string(i / 100) + "/file_" + std::to_string(i) + ".txt", "This is file " + std::to_string(i) + "\r\n" });
+	writeFile(archivePath, CCorpusGenerator::makeArchive(format, members));
+
+	CCountingScanner scanner;
+	scanner.parseCommandLineArguments({ "--archive-backend", backend });
+	auto start = std::chrono::steady_clock::now();
+	scanner.scanPath(archivePath);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (scanner.filesProcessed() != memberCount)
+		std::cerr << "warning: " << scanner.filesProcessed() << " of " << memberCount << " members processed\n";
+
+	std::cout << "process_7z," << backend << "/" << format << "," << memberCount << "," << elapsed.count() << ","
+		<< elapsed.count() * 1e6 / memberCount << "\n";
+	std::filesystem::remove(archivePath);
+}
+
+//! tree with dirCount directories of filesPerDir empty files each
+static void makeTree(const std::filesystem::path& root, size_t dirCount, size_t filesPerDir)
+{
+	for (size_t d = 0; d < dirCount; d++)
+	{
+		std::filesystem::path dir = root / ("dir_" + std::to_string(d));
+		std::filesystem::create_directories(dir);
+		for (size_t f = 0; f < filesPerDir; f++)
+			std::ofstream(dir / ("file_" + std::to_string(f) + ".txt"));
+	}
+}
+
+//! with sniff the first bytes of every file are read to detect archives
+static void benchmarkEnumerator(const std::filesystem::path& treePath, const std::string& backend, size_t fileCount, bool sniff = false)
+{
+	CCountingScanner scanner(!sniff);
+	scanner.parseCommandLineArguments({ "--enumerator", backend });
+	auto start = std::chrono::steady_clock::now();
+	scanner.scanPath(treePath);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	// the std backend does not count the stat calls made inside the standard library
+	std::cout << "enumerate," << backend << (sniff ? "+sniff" : "") << "," << scanner.filesProcessed() << "," << elapsed.count() << ","
+		<< elapsed.count() * 1e6 / fileCount << ",";
+	if (backend != "std")
+		std::cout << static_cast<double>(scanner.statCalls()) / fileCount;
+	std::cout << "\n";
+}
+
+static void benchmarkCrc32(CCrc32::EKernel kernel, const std::vector<char>& buf, int rounds)
+{
+	// 64 KiB chunks, like calculate_crc32
+	const size_t chunkSize = 0x10000;
+	auto start = std::chrono::steady_clock::now();
+	unsigned int checksum = 0;
+	for (int round = 0; round < rounds; round++)
+	{
+		CCrc32 crc(kernel);
+		for (size_t pos = 0; pos < buf.size(); pos += chunkSize)
+			crc.process_bytes(buf.data() + pos, std::min(chunkSize, buf.size() - pos));
+		checksum ^= crc.checksum();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	s_resultSink = checksum;
+	double bytes = static_cast<double>(buf.size()) * rounds;
+
+	std::cout << "crc32," << CCrc32::kernelName(kernel) << "," << static_cast<uint64_t>(bytes) << "," << elapsed.count() << ","
+		<< bytes / elapsed.count() / 1e9 << "\n";
+}
+
+//! test-and-insert of crcs of which every fourth is a duplicate, like fileHasNewCrcOrNotChecked
+template<class TInsert>
+static void benchmarkDedup(const std::string& variant, const std::vector<unsigned int>& keys, TInsert insert)
+{
+	auto start = std::chrono::steady_clock::now();
+	size_t inserted = 0;
+	for (unsigned int key : keys)
+	{
+		if (insert(key))
+			inserted++;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	if (inserted != keys.size() - keys.size() / 4)
+		std::cerr << "warning: " << inserted << " keys inserted\n";
+
+	std::cout << "dedup," << variant << "," << keys.size() << "," << elapsed.count() << ","
+		<< elapsed.count() * 1e9 / keys.size() << "\n";
+}
+
+//! time spent by the logging thread per line: writing to the stream directly and flushing every line
+//! like a console does, queueing it for the logger or skipping it because the level is disabled
+static void benchmarkLogging(const std::filesystem::path& workDir, size_t lineCount)
+{
+	std::ofstream file(workDir / "log.txt");
+	auto measure = [lineCount](const std::string& variant, auto logLine) {
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < lineCount; i++)
+			logLine(i);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "log," << variant << "," << lineCount << "," << elapsed.count() << ","
+			<< elapsed.count() * 1e9 / lineCount << "\n";
+	};
+
+	measure("sync", [&](size_t i) { file << "  Entry " << i << ": dir/file_" << i << ".txt " << std::hex << i << std::dec << std::endl; });
+	file.flush();
+	{
+		CLogger logger(file, file);
+		measure("async", [&](size_t i) { CLogLine(logger, levelDebug, 1) << "Entry " << i << ": dir/file_" << i << ".txt " << std::hex << i; });
+	}
+	volatile bool verbose = false;
+	measure("disabled", [&](size_t i) { if (verbose) CLogLine(*CLogger::console(), levelDebug, 1) << "Entry " << i; });
+}
+
+//! time per counter update and timed scope of threadCount threads updating the metrics at the same time.
+//! Two clock reads per timed scope are most of it.
+static void benchmarkMetrics(size_t threadCount, size_t updateCount)
+{
+	CScanMetrics metrics;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < threadCount; t++)
+	{
+		threads.emplace_back([&metrics, updateCount]() {
+			for (size_t i = 0; i < updateCount; i++)
+			{
+				CScanMetrics::CScopedTimer timer(metrics, CScanMetrics::timerCrc32);
+				metrics.add(CScanMetrics::counterBytesHashed, i);
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "metrics,threads=" << threadCount << "," << threadCount * updateCount << "," << elapsed.count() << ","
+		<< elapsed.count() * 1e9 / (threadCount * updateCount) << "\n";
+}
+
+//! print what the corpus benchmarks run on
+static void printCorpus(const CCorpusStats& stats)
+{
+	std::cout << "\ncorpus,directories,archives,scanned_files,unique_files,bytes\n";
+	std::cout << "corpus," << stats.directories << "," << stats.archives << "," << stats.scannedFiles << ","
+		<< stats.uniqueFiles << "," << stats.bytes << "\n";
+}
+
+static void printThroughput(const std::string& benchmark, const std::string& variant, uint64_t files, uint64_t bytes, std::chrono::duration<double> elapsed)
+{
+	std::cout << benchmark << "," << variant << "," << files << "," << bytes << "," << elapsed.count() << ","
+		<< elapsed.count() * 1e6 / std::max<uint64_t>(files, 1) << "," << bytes / elapsed.count() / 1e6 << "\n";
+}
+
+//! scanPath over a generated tree, warning unless expectedFiles are delivered
+static void benchmarkScan(const std::filesystem::path& path, const CCorpusStats& stats, const std::string& benchmark, const std::string& variant,
+	const std::vector<std::string>& arguments, std::optional<uint64_t> expectedFiles)
+{
+	CCountingScanner scanner;
+	scanner.parseCommandLineArguments(arguments);
+	auto start = std::chrono::steady_clock::now();
+	scanner.scanPath(path);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (expectedFiles && scanner.filesProcessed() != *expectedFiles)
+		std::cerr << "warning: " << benchmark << "," << variant << ": " << scanner.filesProcessed() << " of " << *expectedFiles << " files processed\n";
+	printThroughput(benchmark, variant, scanner.filesProcessed(), stats.bytes, elapsed);
+}
+
+//! the files of a sequential scan pulled through CDirectoryScanner::entries
+static void benchmarkEntries(const std::filesystem::path& path, const CCorpusStats& stats)
+{
+	CCountingScanner scanner;
+	size_t count = 0;
+	auto start = std::chrono::steady_clock::now();
+	for ([[maybe_unused]] const CScanEntry& entry : scanner.entries(path))
+		count++;
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	if (count != stats.scannedFiles)
+		std::cerr << "warning: scanPath,entries: " << count << " of " << stats.scannedFiles << " files produced\n";
+	printThroughput("scanPath", "entries", count, stats.bytes, elapsed);
+}
+
+//! chooseEngine for every file of the corpus, repeated up to callCount calls
+static void benchmarkChooseEngine(const CCorpusStats& stats, const std::string& variant, const std::vector<std::string>& arguments, size_t callCount)
+{
+	std::vector<std::filesystem::path> names(stats.files);
+	names.insert(names.end(), stats.archivePaths.begin(), stats.archivePaths.end());
+	if (names.empty())
+		return;
+	CCountingScanner scanner;
+	scanner.parseCommandLineArguments(arguments);
+	size_t archives = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < callCount; i++)
+	{
+		if (scanner.isArchive(names[i % names.size()]))
+			archives++;
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	s_resultSink = archives;
+
+	std::cout << "chooseEngine," << variant << "," << callCount << "," << elapsed.count() << ","
+		<< elapsed.count() * 1e9 / callCount << "\n";
+}
+
+//! calculate_crc32 of every file of the corpus which isn't an archive. The files are in the page cache.
+static void benchmarkCalculateCrc32(const CCorpusStats& stats)
+{
+	CCountingScanner scanner;
+	uint64_t bytes = 0;
+	unsigned int checksum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (const std::filesystem::path& p : stats.files)
+	{
+		checksum ^= scanner.calculate_crc32(p);
+		bytes += std::filesystem::file_size(p);
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	s_resultSink = checksum;
+	printThroughput("calculate_crc32", "corpus", stats.files.size(), bytes, elapsed);
+}
+
+int main(int argc, char* argv[])
+{
+	namespace po = boost::program_options;
+	CCorpusOptions corpus;
+	std::vector<std::string> only;
+	std::string workDirArg;
+	bool keepCorpus = false;
+	size_t archiveCount = 32;
+	po::options_description desc("Benchmark options");
+	desc.add_options()
+		("help,h", "print this help")
+		("only", po::value<std::vector<std::string>>(&only)->multitoken(),
+			"benchmarks to run: scan, engine, hash, archive, dedup, enumerate, crc32, log, metrics. Default is all.")
+		("work-dir", po::value<std::string>(&workDirArg),
+			"directory receiving the generated files. Default is DirectoryScanner_Benchmark in the temp directory.")
+		("keep-corpus", po::value<bool>(&keepCorpus)->zero_tokens(),
+			"do not delete the generated corpus")
+		("fan-out", po::value<unsigned int>(&corpus.fanOut), "subdirectories per directory. Default is 4.")
+		("depth", po::value<unsigned int>(&corpus.depth), "directory levels below the root. Default is 3.")
+		("files-per-dir", po::value<unsigned int>(&corpus.filesPerDir), "files per directory. Default is 16.")
+		("min-size", po::value<uint64_t>(&corpus.minFileSize), "smallest file size, at least 32. Default is 64.")
+		("max-size", po::value<uint64_t>(&corpus.maxFileSize),
+			"largest file size. Sizes are distributed log-uniformly. Default is 262144.")
+		("duplicate-ratio", po::value<double>(&corpus.duplicateRatio),
+			"share of files with the contents of an earlier file. Default is 0.25.")
+		("archive-ratio", po::value<double>(&corpus.archiveRatio), "share of files which are archives. Default is 0.05.")
+		("members-per-archive", po::value<unsigned int>(&corpus.membersPerArchive), "files per archive. Default is 16.")
+		("archive-nesting", po::value<unsigned int>(&corpus.archiveNesting),
+			"levels of archives inside archives. Default is 1.")
+		("archive-formats", po::value<std::vector<std::string>>(&corpus.archiveFormats)->multitoken(),
+			"archive formats used in turn: zip, 7z, tar, tgz. Default is all of them.")
+		("archive-count", po::value<size_t>(&archiveCount),
+			"archives per format of the process_7z corpus benchmark. Default is 32.")
+		("seed", po::value<uint64_t>(&corpus.seed), "seed of the corpus. Default is 1.");
+
+	try {
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+		if (vm.count("help")) {
+			std::cout << desc << "\n";
+			return 0;
+		}
+		auto enabled = [&only](const char* name) {
+			return only.empty() || std::find(only.begin(), only.end(), name) != only.end();
+		};
+
+		std::filesystem::path workDir = workDirArg.empty() ? std::filesystem::temp_directory_path() / "DirectoryScanner_Benchmark" : std::filesystem::path(workDirArg);
+		std::filesystem::create_directories(workDir);
+
+		// hot paths on a generated corpus. Output: benchmark,variant,files,bytes,seconds,us_per_file,mb_per_s
+		if (enabled("scan") || enabled("engine") || enabled("hash") || enabled("archive") || enabled("dedup"))
+		{
+			std::filesystem::path corpusPath = workDir / "corpus";
+			std::filesystem::remove_all(corpusPath);
+			CCorpusStats stats = CCorpusGenerator(corpus).generate(corpusPath);
+			printCorpus(stats);
+
+			if (enabled("scan") || enabled("hash") || enabled("archive") || enabled("dedup"))
+				std::cout << "\nbenchmark,variant,files,bytes,seconds,us_per_file,mb_per_s\n";
+			if (enabled("scan")) {
+				benchmarkScan(corpusPath, stats, "scanPath", "sequential", {}, stats.scannedFiles);
+				benchmarkEntries(corpusPath, stats);
+				benchmarkScan(corpusPath, stats, "scanPath", "batch=1024", { "--batch-size", "1024" }, stats.scannedFiles);
+				benchmarkScan(corpusPath, stats, "scanPath", "threads=4", { "--threads", "4" }, stats.scannedFiles);
+				benchmarkScan(corpusPath, stats, "scanPath", "pipeline", { "--pipeline", "--hash-workers", "2" }, stats.scannedFiles);
+				benchmarkScan(corpusPath, stats, "scanPath", "nozip", { "--nozip" }, stats.files.size());
+			}
+			if (enabled("dedup")) {
+				benchmarkScan(corpusPath, stats, "scanPath", "checkcrc", { "--checkcrc" }, stats.uniqueFiles);
+				// members without a crc in the archive header can't be compared once they have been processed,
+				// so --dedup delivers some duplicates
+				benchmarkScan(corpusPath, stats, "scanPath", "dedup", { "--dedup" }, std::nullopt);
+			}
+			if (enabled("hash"))
+				benchmarkCalculateCrc32(stats);
+			if (enabled("archive")) {
+				// archives of one format each, nested as configured
+				for (const std::string& format : corpus.archiveFormats)
+				{
+					if (!CCorpusGenerator::isFormatAvailable(format))
+						continue;
+					std::filesystem::path archivesPath = workDir / ("archives_" + format);
+					std::filesystem::remove_all(archivesPath);
+					CCorpusStats archiveStats = CCorpusGenerator(corpus).generateArchives(archivesPath, format, archiveCount);
+					for (const char* backend : { "7z", "libarchive" })
+					{
+						if (CArchiveReader::isAvailable(backend))
+							benchmarkScan(archivesPath, archiveStats, "process_7z", std::string(backend) + "/" + format, { "--archive-backend", backend }, archiveStats.scannedFiles);
+					}
+					// several archives at a time, zip archives split into parts of 1 MiB
+					if (CArchiveReader::isAvailable("libarchive"))
+						benchmarkScan(archivesPath, archiveStats, "process_7z", "libarchive/" + format + "/workers=4",
+							{ "--archive-backend", "libarchive", "--archive-workers", "4", "--archive-split-size", "1048576" }, archiveStats.scannedFiles);
+					std::filesystem::remove_all(archivesPath);
+				}
+			}
+			if (enabled("engine")) {
+				std::cout << "\nbenchmark,variant,calls,seconds,ns_per_call\n";
+				benchmarkChooseEngine(stats, "match_all", {}, 1000000);
+				benchmarkChooseEngine(stats, "filespecs", { "-f", ".*\\.dat", ".*\\.txt", ".*\\.doc", "-e", ".*tmp.*", ".*~" }, 1000000);
+			}
+			if (!keepCorpus)
+				std::filesystem::remove_all(corpusPath);
+		}
+
+		// runtime per member must stay flat when the member count grows
+		if (enabled("archive")) {
+			std::cout << "\nbenchmark,variant,count,seconds,us_per_item\n";
+			for (const char* backend : { "7z", "libarchive" })
+			{
+				if (!CArchiveReader::isAvailable(backend))
+					continue;
+				for (const char* format : { "tar", "tgz" })
+				{
+					for (size_t memberCount : { 500, 1000, 2000, 4000, 8000 })
+					{
+						benchmarkArchive(workDir, backend, format, memberCount);
+					}
+				}
+			}
+		}
+
+		// stat calls per file should be close to zero for the native backend
+		if (enabled("enumerate")) {
+			std::cout << "\nbenchmark,variant,count,seconds,us_per_item,stat_calls_per_item\n";
+			const size_t dirCount = 50, filesPerDir = 1000;
+			std::filesystem::path treePath = workDir / "tree";
+			makeTree(treePath, dirCount, filesPerDir);
+			for (const char* backend : { "std", "native" })
+			{
+				benchmarkEnumerator(treePath, backend, dirCount * filesPerDir);
+			}
+			benchmarkEnumerator(treePath, "native", dirCount * filesPerDir, true);
+			std::filesystem::remove_all(treePath);
+		}
+
+		if (enabled("crc32")) {
+			std::cout << "\nbenchmark,kernel,bytes,seconds,gb_per_s\n";
+			std::vector<char> buf(64 << 20);
+			for (size_t i = 0; i < buf.size(); i++)
+				buf[i] = static_cast<char>(i * 2654435761u >> 24);
+			for (CCrc32::EKernel kernel : { CCrc32::kernelReference, CCrc32::kernelSlicing16, CCrc32::kernelPclmul })
+			{
+				if (CCrc32::isSupported(kernel))
+					benchmarkCrc32(kernel, buf, kernel == CCrc32::kernelReference ? 2 : 8);
+			}
+		}
+
+		if (enabled("dedup")) {
+			std::cout << "\nbenchmark,variant,keys,seconds,ns_per_insert\n";
+			std::vector<unsigned int> keys(4000000);
+			for (size_t i = 0; i < keys.size(); i++)
+			{
+				size_t n = i % 4 == 3 ? i - 1 : i;
+				keys[i] = CCrc32::compute(&n, sizeof(n));
+			}
+			{
+				std::set<unsigned int> crcSet;
+				std::mutex mutex;
+				benchmarkDedup("std::set", keys, [&](unsigned int key) {
+					std::lock_guard<std::mutex> lock(mutex);
+					return crcSet.insert(key).second;
+				});
+			}
+			{
+				CDedupStore store;
+				benchmarkDedup("CDedupStore", keys, [&](unsigned int key) { return store.insert(key); });
+			}
+		}
+
+		if (enabled("log")) {
+			std::cout << "\nbenchmark,variant,lines,seconds,ns_per_line\n";
+			benchmarkLogging(workDir, 1000000);
+			std::filesystem::remove(workDir / "log.txt");
+		}
+
+		if (enabled("metrics")) {
+			std::cout << "\nbenchmark,variant,updates,seconds,ns_per_update\n";
+			for (size_t threadCount : { 1, 4 })
+				benchmarkMetrics(threadCount, 1000000);
+		}
+
+		// the work directory is left alone if it contains anything else
+		std::error_code ec;
+		std::filesystem::remove(workDir, ec);
+	}
+	catch (const std::exception& ex)
+	{
+		std::cerr << "Error: " << ex.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,339 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "CorpusGenerator.h"
+
+#include "Crc32.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef DIRECTORYSCANNER_WITH_LIBARCHIVE
+#include <archive.h>
+#include <archive_entry.h>
+#endif
+
+namespace
+{
+	void writeFile(const std::filesystem::path& p, const std::string& data)
+	{
+		std::ofstream ofs(p, std::ios::binary);
+		ofs.write(data.data(), data.size());
+		if (!ofs)
+			throw std::runtime_error("Can't write " + p.string());
+	}
+
+	void put16(std::string& s, uint32_t v)
+	{
+		s.push_back(static_cast<char>(v & 0xff));
+		s.push_back(static_cast<char>((v >> 8) & 0xff));
+	}
+
+	void put32(std::string& s, uint32_t v)
+	{
+		put16(s, v & 0xffff);
+		put16(s, v >> 16);
+	}
+}
+
+CCorpusGenerator::CCorpusGenerator(const CCorpusOptions& options)
+	: m_options(options)
+	, m_state(options.seed)
+	, m_archiveCount(0)
+{
+	// smaller files would be cut off within their first line and could have the same contents
+	if (m_options.minFileSize < 32 || m_options.maxFileSize < m_options.minFileSize || m_options.maxFileSize > 0xffffffffu)
+		throw std::invalid_argument("file sizes must be between 32 bytes and 4 GiB, min <= max");
+	m_options.archiveFormats.erase(std::remove_if(m_options.archiveFormats.begin(), m_options.archiveFormats.end(),
+		[](const std::string& format) { return !isFormatAvailable(format); }), m_options.archiveFormats.end());
+	if (m_options.archiveFormats.empty())
+		m_options.archiveRatio = 0;
+}
+
+uint64_t CCorpusGenerator::next()
+{
+	uint64_t z = (m_state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+uint64_t CCorpusGenerator::uniform(uint64_t n)
+{
+	return n ? next() % n : 0;
+}
+
+bool CCorpusGenerator::chance(double p)
+{
+	return static_cast<double>(next() >> 11) * 0x1.0p-53 < p;
+}
+
+std::string CCorpusGenerator::contents(uint64_t id, uint64_t size)
+{
+	std::string data = "file " + std::to_string(id) + "\n";
+	data.resize(std::max<uint64_t>(size, data.size()));
+	uint64_t state = id * 0x9e3779b97f4a7c15ull + 1;
+	for (size_t pos = data.find('\n') + 1; pos < data.size(); pos++)
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		data[pos] = static_cast<char>(state);
+	}
+	data.resize(size);
+	return data;
+}
+
+std::string CCorpusGenerator::nextContents(CCorpusStats& stats)
+{
+	stats.scannedFiles++;
+	if (!m_contents.empty() && chance(m_options.duplicateRatio)) {
+		const auto& earlier = m_contents[uniform(m_contents.size())];
+		return contents(earlier.first, earlier.second);
+	}
+	double logMin = std::log(static_cast<double>(m_options.minFileSize));
+	double logMax = std::log(static_cast<double>(m_options.maxFileSize + 1));
+	double fraction = static_cast<double>(next() >> 11) * 0x1.0p-53;
+	uint64_t size = std::min(m_options.maxFileSize, static_cast<uint64_t>(std::exp(logMin + (logMax - logMin) * fraction)));
+	m_contents.push_back({ m_contents.size(), size });
+	stats.uniqueFiles++;
+	return contents(m_contents.back().first, size);
+}
+
+std::string CCorpusGenerator::nextArchive(const std::string& format, unsigned int nesting, CCorpusStats& stats)
+{
+	stats.archives++;
+	Members members;
+	for (unsigned int i = 0; i < m_options.membersPerArchive; i++)
+	{
+		std::string name = "dir_" + std::to_string(i % 4) + "/member_" + std::to_string(i) + ".dat";
+		members.push_back({ name, nextContents(stats) });
+	}
+	if (nesting > 0) {
+		const std::string& nestedFormat = m_options.archiveFormats[m_archiveCount++ % m_options.archiveFormats.size()];
+		members.push_back({ "nested_" + std::to_string(m_archiveCount) + "." + nestedFormat, nextArchive(nestedFormat, nesting - 1, stats) });
+	}
+	return makeArchive(format, members);
+}
+
+void CCorpusGenerator::generateDirectory(const std::filesystem::path& dir, unsigned int level, CCorpusStats& stats)
+{
+	std::filesystem::create_directories(dir);
+	stats.directories++;
+	for (unsigned int i = 0; i < m_options.filesPerDir; i++)
+	{
+		std::string data;
+		std::filesystem::path p;
+		if (chance(m_options.archiveRatio)) {
+			const std::string& format = m_options.archiveFormats[m_archiveCount++ % m_options.archiveFormats.size()];
+			p = dir / ("archive_" + std::to_string(i) + "." + format);
+			data = nextArchive(format, m_options.archiveNesting, stats);
+			stats.archivePaths.push_back(p);
+		}
+		else {
+			p = dir / ("file_" + std::to_string(i) + ".dat");
+			data = nextContents(stats);
+			stats.files.push_back(p);
+		}
+		writeFile(p, data);
+		stats.bytes += data.size();
+	}
+	if (level < m_options.depth) {
+		for (unsigned int i = 0; i < m_options.fanOut; i++)
+			generateDirectory(dir / ("dir_" + std::to_string(i)), level + 1, stats);
+	}
+}
+
+CCorpusStats CCorpusGenerator::generate(const std::filesystem::path& root)
+{
+	if (std::filesystem::exists(root))
+		throw std::invalid_argument("corpus directory " + root.string() + " exists already");
+	CCorpusStats stats;
+	generateDirectory(root, 0, stats);
+	return stats;
+}
+
+CCorpusStats CCorpusGenerator::generateArchives(const std::filesystem::path& dir, const std::string& format, size_t count)
+{
+	if (!isFormatAvailable(format))
+		throw std::invalid_argument("can't write " + format + " archives");
+	std::filesystem::create_directories(dir);
+	CCorpusStats stats;
+	stats.directories++;
+	for (size_t i = 0; i < count; i++)
+	{
+		std::filesystem::path p = dir / ("archive_" + std::to_string(i) + "." + format);
+		std::string data = nextArchive(format, m_options.archiveNesting, stats);
+		writeFile(p, data);
+		stats.bytes += data.size();
+		stats.archivePaths.push_back(p);
+	}
+	return stats;
+}
+
+std::string CCorpusGenerator::makeTar(const Members& members)
+{
+	std::string tar;
+	for (const auto& [name, content] : members)
+	{
+		if (name.size() >= 100)
+			throw std::invalid_argument("tar member name too long: " + name);
+		char header[512] = {};
+		memcpy(header, name.data(), name.size());
+		snprintf(header + 100, 8, "%07o", 0644);
+		snprintf(header + 108, 8, "%07o", 0);
+		snprintf(header + 116, 8, "%07o", 0);
+		snprintf(header + 124, 12, "%011llo", static_cast<unsigned long long>(content.size()));
+		snprintf(header + 136, 12, "%011o", 0);
+		header[156] = '0';
+		memcpy(header + 257, "ustar", 6);
+		memcpy(header + 263, "00", 2);
+		memset(header + 148, ' ', 8);
+		unsigned int checksum = 0;
+		for (unsigned char c : header) checksum += c;
+		snprintf(header + 148, 8, "%06o", checksum);
+
+		tar.append(header, sizeof(header));
+		tar.append(content);
+		tar.append((512 - content.size() % 512) % 512, '\0');
+	}
+	tar.append(1024, '\0');
+	return tar;
+}
+
+std::string CCorpusGenerator::makeGzip(const std::string& data)
+{
+	std::string gz("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+	size_t pos = 0;
+	do {
+		size_t len = std::min<size_t>(data.size() - pos, 0xffff);
+		bool last = pos + len == data.size();
+		gz.push_back(last ? 1 : 0);
+		put16(gz, static_cast<uint32_t>(len));
+		put16(gz, static_cast<uint32_t>(~len & 0xffff));
+		gz.append(data, pos, len);
+		pos += len;
+	} while (pos < data.size());
+
+	put32(gz, CCrc32::compute(data.data(), data.size()));
+	put32(gz, static_cast<uint32_t>(data.size()));
+	return gz;
+}
+
+std::string CCorpusGenerator::makeZip(const Members& members)
+{
+	std::string zip, directory;
+	for (const auto& [name, content] : members)
+	{
+		uint32_t offset = static_cast<uint32_t>(zip.size());
+		uint32_t crc = CCrc32::compute(content.data(), content.size());
+		uint32_t size = static_cast<uint32_t>(content.size());
+
+		// local file header: version 2.0, no flags, stored, 1980-01-01 00:00
+		put32(zip, 0x04034b50);
+		put16(zip, 20); put16(zip, 0); put16(zip, 0); put16(zip, 0); put16(zip, 0x21);
+		put32(zip, crc); put32(zip, size); put32(zip, size);
+		put16(zip, static_cast<uint32_t>(name.size())); put16(zip, 0);
+		zip.append(name);
+		zip.append(content);
+
+		put32(directory, 0x02014b50);
+		put16(directory, 20); put16(directory, 20); put16(directory, 0); put16(directory, 0); put16(directory, 0); put16(directory, 0x21);
+		put32(directory, crc); put32(directory, size); put32(directory, size);
+		put16(directory, static_cast<uint32_t>(name.size())); put16(directory, 0); put16(directory, 0);
+		put16(directory, 0); put16(directory, 0); put32(directory, 0);
+		put32(directory, offset);
+		directory.append(name);
+	}
+	uint32_t directoryOffset = static_cast<uint32_t>(zip.size());
+	zip.append(directory);
+	put32(zip, 0x06054b50);
+	put16(zip, 0); put16(zip, 0);
+	put16(zip, static_cast<uint32_t>(members.size())); put16(zip, static_cast<uint32_t>(members.size()));
+	put32(zip, static_cast<uint32_t>(directory.size())); put32(zip, directoryOffset);
+	put16(zip, 0);
+	return zip;
+}
+
+#ifdef DIRECTORYSCANNER_WITH_LIBARCHIVE
+std::string CCorpusGenerator::make7z(const Members& members)
+{
+	std::string data;
+	archive* a = archive_write_new();
+	auto write = [](archive*, void* clientData, const void* buffer, size_t length) -> la_ssize_t {
+		static_cast<std::string*>(clientData)->append(static_cast<const char*>(buffer), length);
+		return static_cast<la_ssize_t>(length);
+	};
+	bool ok = archive_write_set_format_7zip(a) == ARCHIVE_OK
+		&& archive_write_set_format_option(a, "7zip", "compression", "store") == ARCHIVE_OK
+		&& archive_write_open(a, &data, nullptr, write, nullptr) == ARCHIVE_OK;
+	for (auto member = members.begin(); ok && member != members.end(); ++member)
+	{
+		archive_entry* entry = archive_entry_new();
+		archive_entry_set_pathname(entry, member->first.c_str());
+		archive_entry_set_size(entry, static_cast<la_int64_t>(member->second.size()));
+		archive_entry_set_filetype(entry, AE_IFREG);
+		archive_entry_set_perm(entry, 0644);
+		ok = archive_write_header(a, entry) == ARCHIVE_OK
+			&& archive_write_data(a, member->second.data(), member->second.size()) == static_cast<la_ssize_t>(member->second.size());
+		archive_entry_free(entry);
+	}
+	ok = archive_write_close(a) == ARCHIVE_OK && ok;
+	std::string error = ok ? "" : archive_error_string(a) ? archive_error_string(a) : "unknown error";
+	archive_write_free(a);
+	if (!ok)
+		throw std::runtime_error("Can't write 7z archive: " + error);
+	return data;
+}
+#else
+std::string CCorpusGenerator::make7z(const Members&)
+{
+	throw std::runtime_error("7z archives can only be written with DIRECTORYSCANNER_WITH_LIBARCHIVE");
+}
+#endif
+
+std::string CCorpusGenerator::makeArchive(const std::string& format, const Members& members)
+{
+	if (format == "zip")
+		return makeZip(members);
+	if (format == "7z")
+		return make7z(members);
+	if (format == "tar")
+		return makeTar(members);
+	if (format == "tgz")
+		return makeGzip(makeTar(members));
+	throw std::invalid_argument("unknown archive format " + format);
+}
+
+bool CCorpusGenerator::isFormatAvailable(const std::string& format)
+{
+#ifdef DIRECTORYSCANNER_WITH_LIBARCHIVE
+	if (format == "7z")
+		return true;
+#endif
+	return format == "zip" || format == "tar" || format == "tgz";
+}
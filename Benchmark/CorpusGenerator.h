@@ -0,0 +1,102 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+//! shape of a synthetic corpus. The same options always generate the same files, on every platform.
+struct CCorpusOptions
+{
+	unsigned int fanOut = 4;	//!< subdirectories per directory
+	unsigned int depth = 3;	//!< directory levels below the root
+	unsigned int filesPerDir = 16;
+	uint64_t minFileSize = 64;	//!< at least 32
+	uint64_t maxFileSize = 256 << 10;	//!< sizes are distributed log-uniformly between min and max
+	double duplicateRatio = 0.25;	//!< share of files and members with the contents of an earlier one
+	double archiveRatio = 0.05;	//!< share of the files on disk which are archives
+	unsigned int membersPerArchive = 16;
+	unsigned int archiveNesting = 1;	//!< levels of archives inside archives, 0: no nested archives
+	std::vector<std::string> archiveFormats = { "zip", "7z", "tar", "tgz" };	//!< used in turn
+	uint64_t seed = 1;
+};
+
+//! what has been generated, and what a scan of it is expected to deliver
+struct CCorpusStats
+{
+	uint64_t directories = 0;
+	uint64_t archives = 0;	//!< archives on disk and nested ones
+	uint64_t scannedFiles = 0;	//!< files on disk and archive members which aren't archives
+	uint64_t uniqueFiles = 0;	//!< scannedFiles with distinct contents
+	uint64_t bytes = 0;	//!< size of the files on disk
+	std::vector<std::filesystem::path> files;	//!< files on disk which aren't archives
+	std::vector<std::filesystem::path> archivePaths;	//!< archives on disk
+};
+
+//! Writes directory trees of files with random contents and archives of them.
+//! Archives are stored uncompressed, so that benchmarks measure the scanner rather than the codecs.
+//! Every file starts with a line of text, so no file is mistaken for an archive by its contents.
+class CCorpusGenerator
+{
+public:
+	typedef std::vector<std::pair<std::string, std::string>> Members;	//!< name and contents
+
+	CCorpusGenerator(const CCorpusOptions& options);
+
+	//! write the tree below root, which must not exist yet
+	CCorpusStats generate(const std::filesystem::path& root);
+	//! write count archives of the given format into dir, nested as configured
+	CCorpusStats generateArchives(const std::filesystem::path& dir, const std::string& format, size_t count);
+
+	static std::string makeTar(const Members& members);
+	//! gzip stream made of stored deflate blocks
+	static std::string makeGzip(const std::string& data);
+	//! zip archive with stored members
+	static std::string makeZip(const Members& members);
+	//! 7z archive with stored members, needs libarchive
+	static std::string make7z(const Members& members);
+	static std::string makeArchive(const std::string& format, const Members& members);
+	//! zip, tar and tgz are always available, 7z with DIRECTORYSCANNER_WITH_LIBARCHIVE
+	static bool isFormatAvailable(const std::string& format);
+
+private:
+	//! contents of a file: a new one or a copy of an earlier one
+	std::string nextContents(CCorpusStats& stats);
+	std::string nextArchive(const std::string& format, unsigned int nesting, CCorpusStats& stats);
+	void generateDirectory(const std::filesystem::path& dir, unsigned int level, CCorpusStats& stats);
+	static std::string contents(uint64_t id, uint64_t size);
+
+	//! splitmix64, the standard distributions differ between standard libraries
+	uint64_t next();
+	uint64_t uniform(uint64_t n);
+	bool chance(double p);
+
+	CCorpusOptions m_options;
+	uint64_t m_state;
+	size_t m_archiveCount;
+	std::vector<std::pair<uint64_t, uint64_t>> m_contents;	//!< id and size of every distinct contents
+};
@@ -0,0 +1,83 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "ArchiveReader.h"
+#include "SevenZipArchiveReader.h"
+#ifdef DIRECTORYSCANNER_WITH_LIBARCHIVE
+#include "LibArchiveReader.h"
+#endif
+
+#include <stdexcept>
+
+namespace
+{
+	std::string resolveBackend(const std::string& backend)
+	{
+		if (backend != "native")
+			return backend;
+#if defined(DIRECTORYSCANNER_WITH_LIBARCHIVE) && !defined(_WIN32)
+		return "libarchive";
+#else
+		return "7z";
+#endif
+	}
+}
+
+CArchiveReader::CArchiveReader()
+	: m_metrics(nullptr)
+	, m_cancel(nullptr)
+{
+}
+
+CArchiveReader::~CArchiveReader()
+{
+}
+
+bool CArchiveReader::streamNested(CMemberSource&, uint64_t, const std::filesystem::path&,
+	EArchiveFormat, const Select&, const Consume&)
+{
+	return false;
+}
+
+bool CArchiveReader::isAvailable(const std::string& backend)
+{
+	std::string resolved = resolveBackend(backend);
+#ifdef DIRECTORYSCANNER_WITH_LIBARCHIVE
+	if (resolved == "libarchive")
+		return true;
+#endif
+	return resolved == "7z";
+}
+
+std::unique_ptr<CArchiveReader> CArchiveReader::create(const std::string& backend, const std::string& sevenZipDllPath)
+{
+	std::string resolved = resolveBackend(backend);
+	if (resolved == "7z")
+		return std::make_unique<CSevenZipArchiveReader>(sevenZipDllPath);
+#ifdef DIRECTORYSCANNER_WITH_LIBARCHIVE
+	if (resolved == "libarchive")
+		return std::make_unique<CLibArchiveReader>();
+#endif
+	throw std::invalid_argument("Unknown or unavailable archive backend: " + backend);
+}
@@ -0,0 +1,108 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "FormatDetector.h"
+
+class CMemberSource;
+class CScanMetrics;
+
+//! entry of an archive
+struct CArchiveMember
+{
+	std::filesystem::path name;	//!< path inside the archive
+	uint64_t size = 0;	//!< 0 if the archive does not record the size
+	uint32_t crc = 0;	//!< 0 if the archive does not record a crc
+	bool isDirectory = false;
+	int64_t mtime = 0;	//!< last write time in seconds since 1970, 0 if the archive does not record it
+	int64_t ctime = 0;	//!< status change time in seconds since 1970, 0 if the archive does not record it
+	std::optional<uint32_t> uid;	//!< owner, if the archive records it
+	std::optional<uint32_t> mode;	//!< permission bits, if the archive records them
+};
+
+//! Backend reading archives. format is the format detected from the contents or the name of the archive.
+//! Errors are reported as exceptions.
+//! The methods keep no state between calls and may be called concurrently.
+class CArchiveReader
+{
+public:
+	typedef std::function<bool(unsigned int index, const CArchiveMember& member)> Select;
+	typedef std::function<void(unsigned int index, const CArchiveMember& member, CMemberSource& source)> Consume;
+
+	virtual ~CArchiveReader();
+
+	virtual std::string name() const = 0;
+
+	//! all members of the archive, in archive order
+	virtual std::vector<CArchiveMember> list(const std::filesystem::path& archivePath, EArchiveFormat format) = 0;
+
+	//! extract the members with the given indices into dir in a single pass, keeping their paths
+	virtual void extract(const std::filesystem::path& archivePath, EArchiveFormat format,
+		const std::vector<unsigned int>& indices, const std::filesystem::path& dir) = 0;
+
+	//! Pass every member except directories to select, and the selected ones to consume, in archive order.
+	//! Backends decide on a member when they reach it and read the archive only once where possible.
+	//! The source is valid during consume only, unless it is backed by a file kept alive by fileOwner().
+	virtual void stream(const std::filesystem::path& archivePath, EArchiveFormat format,
+		const Select& select, const Consume& consume) = 0;
+
+	//! Like stream, reading an archive nested in another one from source without writing it to a file.
+	//! archiveName is the name of the nested archive, size its size or 0 if unknown. Returns false
+	//! without reading from source if the backend can't read this archive from a stream; the caller
+	//! then extracts it to a file. The default implementation always returns false.
+	virtual bool streamNested(CMemberSource& source, uint64_t size, const std::filesystem::path& archiveName,
+		EArchiveFormat format, const Select& select, const Consume& consume);
+
+	//! Backend by name: "7z" (7z.dll through 7zip-cpp), "libarchive" or "native" (7z on Windows, libarchive elsewhere
+	//! if it has been compiled in). Throws std::invalid_argument for unknown or unavailable backends and
+	//! std::runtime_error if the backend can't be loaded.
+	static std::unique_ptr<CArchiveReader> create(const std::string& backend, const std::string& sevenZipDllPath);
+	static bool isAvailable(const std::string& backend);
+
+	//! metrics receiving the listing and extraction times and the temporary bytes written, nullptr: none
+	void setMetrics(CScanMetrics* metrics) { m_metrics = metrics; }
+	//! directory receiving the members of backends which extract to files, empty: the temporary directory of the system
+	void setTempDirectory(const std::filesystem::path& dir) { m_tempDirectory = dir; }
+	//! flag which stops reading archives once it is set, nullptr: none. The backends poll it between members
+	//! and while decompressing, and stream and streamNested return early without an error.
+	void setCancel(const std::atomic<bool>* cancel) { m_cancel = cancel; }
+
+protected:
+	CArchiveReader();
+
+	bool cancelled() const { return m_cancel && *m_cancel; }
+
+	CScanMetrics* m_metrics;
+	std::filesystem::path m_tempDirectory;
+	const std::atomic<bool>* m_cancel;
+};
@@ -0,0 +1,128 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "ArchiveScheduler.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <numeric>
+
+namespace {
+	//! parts of one archive. Shared with the helper tasks, which may start after runParts has returned.
+	struct CParts
+	{
+		explicit CParts(const std::vector<CArchiveScheduler::Task>& tasks)
+			: tasks(tasks)
+			, count(tasks.size())
+			, next(0)
+			, done(0)
+		{}
+
+		//! run parts until none is left
+		void work()
+		{
+			size_t index;
+			while ((index = next++) < count) {
+				try {
+					tasks[index]();
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!error)
+						error = std::current_exception();
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				if (++done == count)
+					allDone.notify_all();
+			}
+		}
+
+		const std::vector<CArchiveScheduler::Task>& tasks;	//!< valid until all parts are done
+		const size_t count;
+		std::atomic<size_t> next;	//!< index of the next part to run
+
+		std::mutex mutex;	//!< protects the members below
+		std::condition_variable allDone;
+		size_t done;
+		std::exception_ptr error;
+	};
+}
+
+CArchiveScheduler::CArchiveScheduler(unsigned int workers)
+	: m_pool(workers)
+{
+}
+
+void CArchiveScheduler::submit(Task task)
+{
+	m_pool.submit(std::move(task));
+}
+
+void CArchiveScheduler::runParts(const std::vector<Task>& parts)
+{
+	auto shared = std::make_shared<CParts>(parts);
+	for (size_t i = 1; i < parts.size(); i++)
+		m_pool.submit([shared]() { shared->work(); });
+	shared->work();
+
+	std::unique_lock<std::mutex> lock(shared->mutex);
+	shared->allDone.wait(lock, [&shared] { return shared->done == shared->count; });
+	if (shared->error)
+		std::rethrow_exception(shared->error);
+}
+
+void CArchiveScheduler::wait()
+{
+	m_pool.wait();
+}
+
+std::vector<CArchiveScheduler::Range> CArchiveScheduler::partition(const std::vector<uint64_t>& sizes, unsigned int count)
+{
+	std::vector<Range> ranges;
+	if (sizes.empty())
+		return ranges;
+	if (count == 0)
+		count = 1;
+	const uint64_t total = std::accumulate(sizes.begin(), sizes.end(), uint64_t(0));
+	if (total == 0) {
+		// the archive records no sizes: split by the number of members
+		return partition(std::vector<uint64_t>(sizes.size(), 1), count);
+	}
+	unsigned int first = 0;
+	uint64_t sum = 0;
+	for (unsigned int index = 0; index < sizes.size(); index++) {
+		sum += sizes[index];
+		// a range ends once it reaches its share of the bytes, the last range takes the rest
+		const uint64_t share = total / count * (ranges.size() + 1);
+		if (ranges.size() + 1 < count && sum >= share && index + 1 < sizes.size()) {
+			ranges.push_back({ first, index + 1 });
+			first = index + 1;
+		}
+	}
+	ranges.push_back({ first, static_cast<unsigned int>(sizes.size()) });
+	return ranges;
+}
@@ -0,0 +1,64 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "WorkStealingPool.h"
+
+//! Decompresses archives on a fixed number of workers. The number of workers is the global limit of
+//! archives being decompressed at a time, which bounds the memory held by the decoders.
+//! Whole archives are queued with submit. Archives whose members are compressed independently of each
+//! other can be read in parts by several workers with runParts.
+class CArchiveScheduler
+{
+public:
+	typedef std::function<void()> Task;
+	//! range of member indices, first to last exclusive
+	typedef std::pair<unsigned int, unsigned int> Range;
+
+	explicit CArchiveScheduler(unsigned int workers);
+
+	unsigned int workers() const { return m_pool.threadCount(); }
+
+	//! queue the scan of an archive
+	void submit(Task task);
+
+	//! Run the parts concurrently and return when all of them are done. The calling thread runs parts
+	//! itself while the others are picked up by idle workers, so a worker may call runParts without
+	//! waiting for workers which are busy. Rethrows the first exception which escaped a part.
+	void runParts(const std::vector<Task>& parts);
+
+	//! block until all queued archives are done. Rethrows the first exception which escaped a task.
+	void wait();
+
+	//! split the members with the given sizes into at most count contiguous ranges of about the same number of bytes
+	static std::vector<Range> partition(const std::vector<uint64_t>& sizes, unsigned int count);
+
+private:
+	CWorkStealingPool m_pool;
+};
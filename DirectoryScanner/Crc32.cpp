@@ -0,0 +1,282 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "Crc32.h"
+
+#include <cstring>
+
+#include <boost/crc.hpp>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32_HAVE_PCLMUL
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC32_TARGET_PCLMUL
+#else
+#define CRC32_TARGET_PCLMUL __attribute__((target("pclmul,sse2")))
+#endif
+#endif
+
+namespace
+{
+	//! reflected polynomial 0x04C11DB7
+	const uint32_t polynomial = 0xedb88320;
+
+	struct CSlicingTables
+	{
+		uint32_t t[16][256];
+
+		CSlicingTables()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t crc = i;
+				for (int bit = 0; bit < 8; bit++)
+					crc = (crc >> 1) ^ (polynomial & (0 - (crc & 1)));
+				t[0][i] = crc;
+			}
+			for (uint32_t i = 0; i < 256; i++)
+				for (int slice = 1; slice < 16; slice++)
+					t[slice][i] = (t[slice - 1][i] >> 8) ^ t[0][t[slice - 1][i] & 0xff];
+		}
+	};
+
+	const CSlicingTables& slicingTables()
+	{
+		static const CSlicingTables tables;
+		return tables;
+	}
+
+	uint32_t reflect32(uint32_t v)
+	{
+		uint32_t r = 0;
+		for (int bit = 0; bit < 32; bit++, v >>= 1)
+			r = (r << 1) | (v & 1);
+		return r;
+	}
+
+	inline uint32_t load32(const unsigned char* p)
+	{
+		// bytes are combined explicitly, so the kernel does not depend on the host byte order
+		return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+	}
+
+	uint32_t updateSlicing16(uint32_t crc, const unsigned char* p, size_t size)
+	{
+		const auto& t = slicingTables().t;
+		while (size >= 16)
+		{
+			uint32_t a = load32(p) ^ crc;
+			uint32_t b = load32(p + 4);
+			uint32_t c = load32(p + 8);
+			uint32_t d = load32(p + 12);
+			crc = t[15][a & 0xff] ^ t[14][(a >> 8) & 0xff] ^ t[13][(a >> 16) & 0xff] ^ t[12][a >> 24]
+				^ t[11][b & 0xff] ^ t[10][(b >> 8) & 0xff] ^ t[9][(b >> 16) & 0xff] ^ t[8][b >> 24]
+				^ t[7][c & 0xff] ^ t[6][(c >> 8) & 0xff] ^ t[5][(c >> 16) & 0xff] ^ t[4][c >> 24]
+				^ t[3][d & 0xff] ^ t[2][(d >> 8) & 0xff] ^ t[1][(d >> 16) & 0xff] ^ t[0][d >> 24];
+			p += 16;
+			size -= 16;
+		}
+		while (size--)
+			crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+		return crc;
+	}
+
+#ifdef CRC32_HAVE_PCLMUL
+	//! fold x by 128 bits with the constant pair k and add the next block
+	CRC32_TARGET_PCLMUL inline __m128i fold128(__m128i x, __m128i k, __m128i next)
+	{
+		__m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+		__m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+		return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+	}
+
+	//! Folds 64 bytes per iteration with carry-less multiplication and reduces the result
+	//! with Barrett reduction, see Intel's "Fast CRC Computation for Generic Polynomials
+	//! Using PCLMULQDQ Instruction". size must be a multiple of 16 and at least 64.
+	CRC32_TARGET_PCLMUL uint32_t updatePclmul(uint32_t crc, const unsigned char* p, size_t size)
+	{
+		// bit-reflected folding constants x^(4*128+32) mod P, x^(4*128-32) mod P, ... and the Barrett constants
+		alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+		alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+		alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+		alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+		__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+		__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+		__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48));
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+		p += 64;
+		size -= 64;
+
+		// fold four 128 bit lanes in parallel
+		__m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+		while (size >= 64)
+		{
+			__m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+			__m128i x6 = _mm_clmulepi64_si128(x2, k, 0x00);
+			__m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00);
+			__m128i x8 = _mm_clmulepi64_si128(x4, k, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)));
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)));
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)));
+			p += 64;
+			size -= 64;
+		}
+
+		// fold the four lanes into one, then the remaining 16 byte blocks
+		k = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+		x1 = fold128(x1, k, x2);
+		x1 = fold128(x1, k, x3);
+		x1 = fold128(x1, k, x4);
+		while (size >= 16)
+		{
+			x1 = fold128(x1, k, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+			p += 16;
+			size -= 16;
+		}
+
+		// fold 128 to 64 bits
+		const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+		x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+		k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+
+		// Barrett reduction to 32 bits
+		k = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+		x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k, 0x10);
+		x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), k, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+		return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(x1, 4)));
+	}
+
+	bool cpuHasPclmul()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 1)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("pclmul");
+#endif
+	}
+#endif
+}
+
+CCrc32::CCrc32(EKernel kernel)
+	: m_kernel(kernel == kernelAuto ? bestKernel() : kernel)
+	, m_crc(0xffffffff)
+{
+	if (!isSupported(m_kernel))
+		m_kernel = kernelSlicing16;
+}
+
+void CCrc32::process_bytes(const void* data, size_t size)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	switch (m_kernel)
+	{
+	case kernelReference:
+	{
+		// boost::crc_32_type keeps its register bit-reversed
+		boost::crc_32_type crc;
+		crc.reset(reflect32(m_crc));
+		crc.process_bytes(p, size);
+		m_crc = reflect32(crc.get_interim_remainder());
+		break;
+	}
+#ifdef CRC32_HAVE_PCLMUL
+	case kernelPclmul:
+		if (size >= 64)
+		{
+			size_t blocks = size & ~size_t(15);
+			m_crc = updatePclmul(m_crc, p, blocks);
+			p += blocks;
+			size -= blocks;
+		}
+		m_crc = updateSlicing16(m_crc, p, size);
+		break;
+#endif
+	default:
+		m_crc = updateSlicing16(m_crc, p, size);
+		break;
+	}
+}
+
+CCrc32::EKernel CCrc32::bestKernel()
+{
+	static const EKernel best = isSupported(kernelPclmul) ? kernelPclmul : kernelSlicing16;
+	return best;
+}
+
+bool CCrc32::isSupported(EKernel kernel)
+{
+	switch (kernel)
+	{
+	case kernelReference:
+	case kernelSlicing16:
+		return true;
+	case kernelPclmul:
+#ifdef CRC32_HAVE_PCLMUL
+	{
+		static const bool supported = cpuHasPclmul();
+		return supported;
+	}
+#else
+		return false;
+#endif
+	default:
+		return false;
+	}
+}
+
+const char* CCrc32::kernelName(EKernel kernel)
+{
+	switch (kernel)
+	{
+	case kernelAuto: return "auto";
+	case kernelReference: return "reference";
+	case kernelSlicing16: return "slicing16";
+	case kernelPclmul: return "pclmul";
+	default: return "unknown";
+	}
+}
+
+uint32_t CCrc32::compute(const void* data, size_t size, EKernel kernel)
+{
+	CCrc32 crc(kernel);
+	crc.process_bytes(data, size);
+	return crc.checksum();
+}
@@ -0,0 +1,57 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//! CRC-32 (IEEE 802.3, as used by zip, gzip and 7z), bit-for-bit identical to boost::crc_32_type.
+//! The kernel is chosen at runtime: carry-less multiplication folding where the CPU supports it,
+//! slicing-by-16 tables otherwise. The boost implementation is kept as the reference.
+class CCrc32
+{
+public:
+	enum EKernel { kernelAuto, kernelReference, kernelSlicing16, kernelPclmul };
+
+	explicit CCrc32(EKernel kernel = kernelAuto);
+
+	void process_bytes(const void* data, size_t size);
+	uint32_t checksum() const { return ~m_crc; }
+	void reset() { m_crc = 0xffffffff; }
+
+	EKernel kernel() const { return m_kernel; }
+
+	//! fastest kernel available on this CPU
+	static EKernel bestKernel();
+	static bool isSupported(EKernel kernel);
+	static const char* kernelName(EKernel kernel);
+
+	//! checksum of a single buffer
+	static uint32_t compute(const void* data, size_t size, EKernel kernel = kernelAuto);
+
+private:
+	EKernel m_kernel;
+	//! crc register, i.e. the complement of the checksum
+	uint32_t m_crc;
+};
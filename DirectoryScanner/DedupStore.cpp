@@ -0,0 +1,149 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "DedupStore.h"
+
+namespace
+{
+	const size_t initialCapacity = 256;	//!< slots per shard, a power of two
+}
+
+//! Shards are cache line aligned, so threads working on different shards don't share cache lines.
+//! Key 0 marks an empty slot and is tracked by a flag instead.
+struct alignas(64) CDedupStore::CShard
+{
+	mutable std::mutex mutex;
+	std::vector<uint64_t> slots;
+	size_t count = 0;	//!< keys in slots, not counting key 0
+	bool hasZero = false;
+
+	size_t find(uint64_t key, uint64_t hash) const
+	{
+		size_t mask = slots.size() - 1;
+		size_t i = static_cast<size_t>(hash) & mask;
+		while (slots[i] != 0 && slots[i] != key)
+			i = (i + 1) & mask;
+		return i;
+	}
+
+	void grow()
+	{
+		std::vector<uint64_t> old(slots.size() * 2, 0);
+		old.swap(slots);
+		for (uint64_t key : old)
+		{
+			if (key != 0)
+				slots[find(key, mix(key))] = key;
+		}
+	}
+};
+
+CDedupStore::CDedupStore(size_t shardCount)
+{
+	size_t count = 1;
+	while (count < shardCount)
+		count *= 2;
+	m_shards = std::make_unique<CShard[]>(count);
+	m_shardMask = count - 1;
+	for (size_t i = 0; i < count; i++)
+		m_shards[i].slots.assign(initialCapacity, 0);
+}
+
+CDedupStore::~CDedupStore()
+{
+}
+
+uint64_t CDedupStore::mix(uint64_t key)
+{
+	// crcs are well distributed, but other keys may not be: finalizer of MurmurHash3
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+CDedupStore::CShard& CDedupStore::shardOf(uint64_t hash) const
+{
+	// the high bits select the shard, the low bits the slot within it
+	return m_shards[static_cast<size_t>(hash >> 48) & m_shardMask];
+}
+
+bool CDedupStore::insert(uint64_t key)
+{
+	uint64_t hash = mix(key);
+	CShard& shard = shardOf(hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	if (key == 0) {
+		bool inserted = !shard.hasZero;
+		shard.hasZero = true;
+		return inserted;
+	}
+
+	size_t i = shard.find(key, hash);
+	if (shard.slots[i] == key)
+		return false;
+
+	// keep the load factor below 1/2, so probe sequences stay short
+	if (2 * (shard.count + 1) > shard.slots.size()) {
+		shard.grow();
+		i = shard.find(key, hash);
+	}
+	shard.slots[i] = key;
+	shard.count++;
+	return true;
+}
+
+bool CDedupStore::contains(uint64_t key) const
+{
+	uint64_t hash = mix(key);
+	const CShard& shard = shardOf(hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	if (key == 0)
+		return shard.hasZero;
+	return shard.slots[shard.find(key, hash)] == key;
+}
+
+size_t CDedupStore::size() const
+{
+	size_t total = 0;
+	for (size_t i = 0; i <= m_shardMask; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+		total += m_shards[i].count + (m_shards[i].hasZero ? 1 : 0);
+	}
+	return total;
+}
+
+void CDedupStore::clear()
+{
+	for (size_t i = 0; i <= m_shardMask; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+		m_shards[i].slots.assign(initialCapacity, 0);
+		m_shards[i].count = 0;
+		m_shards[i].hasZero = false;
+	}
+}
@@ -0,0 +1,58 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//! Set of 64 bit keys (checksums) which parallel scanners test and insert atomically.
+//! The keys are spread over shards with a lock each. Every shard is an open-addressing table
+//! with linear probing over a flat array, so a lookup touches one or two cache lines.
+class CDedupStore
+{
+public:
+	explicit CDedupStore(size_t shardCount = 64);
+	~CDedupStore();
+
+	CDedupStore(const CDedupStore&) = delete;
+	CDedupStore& operator=(const CDedupStore&) = delete;
+
+	//! insert key. Returns true if it was not in the store before.
+	bool insert(uint64_t key);
+	bool contains(uint64_t key) const;
+	size_t size() const;
+	void clear();
+
+private:
+	struct CShard;
+
+	static uint64_t mix(uint64_t key);
+	CShard& shardOf(uint64_t hash) const;
+
+	std::unique_ptr<CShard[]> m_shards;
+	size_t m_shardMask;
+};
@@ -0,0 +1,257 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "pch.h"
+#include "DirEnumerator.h"
+#include "FilePredicate.h"
+
+#include <chrono>
+
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+std::unique_ptr<CDirEnumerator> CDirEnumerator::create(const std::string& backend)
+{
+	if (backend == "std")
+		return std::make_unique<CStdDirEnumerator>();
+#ifdef __linux__
+	if (backend == "native" || backend == "linux")
+		return std::make_unique<CLinuxDirEnumerator>();
+#else
+	if (backend == "native")
+		return std::make_unique<CStdDirEnumerator>();
+#endif
+	throw std::invalid_argument("Unknown directory enumerator: " + backend);
+}
+
+namespace {
+	class CStdDirHandle : public CDirHandle
+	{
+	public:
+		CStdDirHandle(const std::filesystem::path& dirPath)
+			: it(dirPath)
+			, started(false)
+		{}
+
+		std::filesystem::directory_iterator it;	//!< at the entry last returned by next, so stat can use it
+		bool started;
+	};
+
+	CDirEntry::EType toEntryType(std::filesystem::file_type type)
+	{
+		switch (type) {
+		case std::filesystem::file_type::regular: return CDirEntry::typeFile;
+		case std::filesystem::file_type::directory: return CDirEntry::typeDirectory;
+		case std::filesystem::file_type::symlink: return CDirEntry::typeSymlink;
+		case std::filesystem::file_type::none:
+		case std::filesystem::file_type::not_found:
+		case std::filesystem::file_type::unknown: return CDirEntry::typeUnknown;
+		default: return CDirEntry::typeOther;
+		}
+	}
+}
+
+std::unique_ptr<CDirHandle> CStdDirEnumerator::open(const std::filesystem::path& dirPath, const CDirHandle*)
+{
+	return std::make_unique<CStdDirHandle>(dirPath);
+}
+
+bool CStdDirEnumerator::next(CDirHandle& dir, CDirEntry& entry)
+{
+	CStdDirHandle& d = static_cast<CStdDirHandle&>(dir);
+	auto& it = d.it;
+	if (d.started && it != std::filesystem::directory_iterator())
+		it++;
+	d.started = true;
+	if (it == std::filesystem::directory_iterator())
+		return false;
+
+	std::error_code ec;
+	entry.name = it->path().filename().string();
+	entry.device = 0;
+	entry.inode = 0;
+	entry.type = toEntryType(it->symlink_status(ec).type());
+	entry.targetType = entry.type == CDirEntry::typeSymlink ? toEntryType(it->status(ec).type()) : entry.type;
+	return true;
+}
+
+bool CStdDirEnumerator::stat(CDirHandle& dir, const CDirEntry& entry, CFileStat& st)
+{
+	const std::filesystem::directory_entry& current = *static_cast<CStdDirHandle&>(dir).it;
+	std::error_code ec;
+	uint64_t size = current.file_size(ec);
+	if (ec)
+		return false;
+	st.size = size;
+	std::filesystem::file_time_type mtime = current.last_write_time(ec);
+	if (!ec) {
+		auto sys = std::chrono::file_clock::to_sys(mtime);
+		st.mtime = std::chrono::duration_cast<std::chrono::seconds>(sys.time_since_epoch()).count();
+	}
+	std::filesystem::file_status status = current.status(ec);
+	if (!ec)
+		st.mode = static_cast<uint32_t>(status.permissions() & std::filesystem::perms::mask);
+	st.symlink = entry.type == CDirEntry::typeSymlink;
+	return true;
+}
+
+#ifdef __linux__
+namespace {
+	struct linux_dirent64
+	{
+		ino64_t d_ino;
+		off64_t d_off;
+		unsigned short d_reclen;
+		unsigned char d_type;
+		char d_name[1];
+	};
+
+	class CLinuxDirHandle : public CDirHandle
+	{
+	public:
+		CLinuxDirHandle(int pFd)
+			: fd(pFd)
+			, buffer(CLinuxDirEnumerator::bufferSize)
+			, pos(0)
+			, end(0)
+		{}
+
+		virtual ~CLinuxDirHandle()
+		{
+			::close(fd);
+		}
+
+		int fd;
+		std::vector<char> buffer;
+		size_t pos;
+		size_t end;
+	};
+
+	CDirEntry::EType toEntryType(mode_t mode)
+	{
+		if (S_ISREG(mode)) return CDirEntry::typeFile;
+		if (S_ISDIR(mode)) return CDirEntry::typeDirectory;
+		if (S_ISLNK(mode)) return CDirEntry::typeSymlink;
+		return CDirEntry::typeOther;
+	}
+}
+
+std::unique_ptr<CDirHandle> CLinuxDirEnumerator::open(const std::filesystem::path& dirPath, const CDirHandle* parent)
+{
+	const int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW;
+	int fd = parent
+		? ::openat(static_cast<const CLinuxDirHandle*>(parent)->fd, dirPath.filename().c_str(), flags)
+		: ::open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0)
+		throw std::filesystem::filesystem_error("Can't open directory", dirPath, std::error_code(errno, std::system_category()));
+	auto dir = std::make_unique<CLinuxDirHandle>(fd);
+	struct stat st;
+	if (::fstat(fd, &st) == 0) {
+		dir->device = static_cast<uint64_t>(st.st_dev);
+		dir->inode = static_cast<uint64_t>(st.st_ino);
+	}
+	return dir;
+}
+
+bool CLinuxDirEnumerator::next(CDirHandle& dir, CDirEntry& entry)
+{
+	CLinuxDirHandle& d = static_cast<CLinuxDirHandle&>(dir);
+	for (;;)
+	{
+		if (d.pos >= d.end) {
+			long nread = ::syscall(SYS_getdents64, d.fd, d.buffer.data(), d.buffer.size());
+			if (nread < 0)
+				throw std::system_error(errno, std::system_category(), "getdents64");
+			if (nread == 0)
+				return false;
+			d.pos = 0;
+			d.end = static_cast<size_t>(nread);
+		}
+
+		const linux_dirent64* de = reinterpret_cast<const linux_dirent64*>(d.buffer.data() + d.pos);
+		d.pos += de->d_reclen;
+
+		const char* name = de->d_name;
+		if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+			continue;
+
+		entry.name = name;
+		entry.device = d.device;
+		entry.inode = static_cast<uint64_t>(de->d_ino);
+		switch (de->d_type) {
+		case DT_REG: entry.type = CDirEntry::typeFile; break;
+		case DT_DIR: entry.type = CDirEntry::typeDirectory; break;
+		case DT_LNK: entry.type = CDirEntry::typeSymlink; break;
+		case DT_UNKNOWN: {
+			struct stat st;
+			m_statCalls++;
+			entry.type = ::fstatat(d.fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 ? toEntryType(st.st_mode) : CDirEntry::typeUnknown;
+			if (entry.type != CDirEntry::typeUnknown)
+				entry.device = static_cast<uint64_t>(st.st_dev);
+			break;
+		}
+		default: entry.type = CDirEntry::typeOther; break;
+		}
+
+		entry.targetType = entry.type;
+		if (entry.type == CDirEntry::typeSymlink) {
+			struct stat st;
+			m_statCalls++;
+			if (::fstatat(d.fd, name, &st, 0) == 0) {
+				entry.targetType = toEntryType(st.st_mode);
+				entry.device = static_cast<uint64_t>(st.st_dev);
+				entry.inode = static_cast<uint64_t>(st.st_ino);
+			}
+			else {
+				entry.targetType = CDirEntry::typeUnknown;
+				entry.device = 0;
+				entry.inode = 0;
+			}
+		}
+		return true;
+	}
+}
+
+bool CLinuxDirEnumerator::stat(CDirHandle& dir, const CDirEntry& entry, CFileStat& st)
+{
+	struct stat s;
+	m_statCalls++;
+	if (::fstatat(static_cast<CLinuxDirHandle&>(dir).fd, entry.name.c_str(), &s, 0) != 0)
+		return false;
+	st.size = static_cast<uint64_t>(s.st_size);
+	st.mtime = static_cast<int64_t>(s.st_mtim.tv_sec);
+	st.ctime = static_cast<int64_t>(s.st_ctim.tv_sec);
+	st.uid = static_cast<uint32_t>(s.st_uid);
+	st.mode = static_cast<uint32_t>(s.st_mode & 07777);
+	st.symlink = entry.type == CDirEntry::typeSymlink;
+	return true;
+}
+#endif
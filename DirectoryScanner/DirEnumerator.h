@@ -0,0 +1,127 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+//! Entry of a directory listing.
+struct CDirEntry
+{
+	enum EType
+	{
+		typeUnknown,
+		typeFile,
+		typeDirectory,
+		typeSymlink,
+		typeOther
+	};
+
+	std::string name;
+	EType type = typeUnknown;	//!< type of the entry itself
+	EType targetType = typeUnknown;	//!< type of the symlink target for symlinks, otherwise equal to type
+	uint64_t device = 0;	//!< device and inode of the file, of the target for symlinks. 0 if the backend doesn't know them
+	uint64_t inode = 0;
+
+	//! regular file or symlink to a regular file
+	bool isFile() const { return targetType == typeFile; }
+	//! directory which is not reached through a symlink
+	bool isDirectory() const { return type == typeDirectory; }
+	//! symlink to a directory
+	bool isDirectoryLink() const { return type == typeSymlink && targetType == typeDirectory; }
+};
+
+struct CFileStat;
+
+//! Open directory of a CDirEnumerator.
+class CDirHandle
+{
+public:
+	virtual ~CDirHandle() = default;
+
+	uint64_t device = 0;	//!< device and inode of the directory, 0 if the backend doesn't know them
+	uint64_t inode = 0;
+};
+
+//! Enumeration backend used by the directory scanner.
+class CDirEnumerator
+{
+public:
+	virtual ~CDirEnumerator() = default;
+
+	//! open the directory dirPath. If parent is given, dirPath is a direct subdirectory of parent
+	//! and the backend may open it relative to the parent handle. Throws std::filesystem::filesystem_error.
+	virtual std::unique_ptr<CDirHandle> open(const std::filesystem::path& dirPath, const CDirHandle* parent) = 0;
+
+	//! read the next entry. Returns false at the end of the directory. "." and ".." are skipped.
+	virtual bool next(CDirHandle& dir, CDirEntry& entry) = 0;
+
+	//! Metadata of entry, the entry last returned by next for dir, following symlinks. The backend
+	//! fills what it gets without opening the file. Returns false if the entry can't be read.
+	virtual bool stat(CDirHandle& dir, const CDirEntry& entry, CFileStat& st) = 0;
+
+	//! name of the backend
+	virtual const char* name() const = 0;
+
+	//! number of stat calls needed to determine entry types, if the backend can count them
+	uint64_t statCalls() const { return m_statCalls; }
+
+	//! create a backend: "std" (std::filesystem), "native" (best backend of the platform)
+	//! or "linux" (getdents64, Linux only). Throws std::invalid_argument for unknown names.
+	static std::unique_ptr<CDirEnumerator> create(const std::string& backend);
+
+protected:
+	std::atomic<uint64_t> m_statCalls{ 0 };
+};
+
+//! Portable backend based on std::filesystem::directory_iterator.
+class CStdDirEnumerator : public CDirEnumerator
+{
+public:
+	virtual std::unique_ptr<CDirHandle> open(const std::filesystem::path& dirPath, const CDirHandle* parent) override;
+	virtual bool next(CDirHandle& dir, CDirEntry& entry) override;
+	//! uses the data cached by the directory entry where the platform provides it, e.g. on Windows
+	virtual bool stat(CDirHandle& dir, const CDirEntry& entry, CFileStat& st) override;
+	virtual const char* name() const override { return "std"; }
+};
+
+#ifdef __linux__
+//! Linux backend. Reads directories with large getdents64 calls on file descriptors opened
+//! relative to the parent directory and takes the entry type from d_type. fstatat is only
+//! called for symlinks and for file systems which report DT_UNKNOWN. The identity of a file is the
+//! device of its directory, taken by one fstat when the directory is opened, and d_ino.
+class CLinuxDirEnumerator : public CDirEnumerator
+{
+public:
+	virtual std::unique_ptr<CDirHandle> open(const std::filesystem::path& dirPath, const CDirHandle* parent) override;
+	virtual bool next(CDirHandle& dir, CDirEntry& entry) override;
+	//! fstatat relative to the open directory, the path is not resolved again
+	virtual bool stat(CDirHandle& dir, const CDirEntry& entry, CFileStat& st) override;
+	virtual const char* name() const override { return "linux"; }
+
+	static const size_t bufferSize = 0x10000;
+};
+#endif
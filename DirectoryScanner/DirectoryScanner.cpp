@@ -22,37 +22,186 @@
 
 #include "pch.h"
 #include "DirectoryScanner.h"
+#include "MemberSource.h"
+#include "FileNameMatcher.h"
+#include "WorkStealingPool.h"
+#include "DirEnumerator.h"
+#include "Crc32.h"
+#include "FileReader.h"
+#include "ScanIndex.h"
+#include "DuplicateDetector.h"
+#include "DedupStore.h"
+#include "ArchiveReader.h"
+#include "ScanMetrics.h"
+#include "InodeSet.h"
+#include "StorageDevice.h"
 
-#include <7zpp/7zpp.h>
-
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <exception>
 #include <iostream>
 #include <fstream>
-#include <random>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
 
-#include <boost/crc.hpp>
-#include <boost/regex.hpp>
 #include <boost/program_options.hpp>
 #include <boost/dll/runtime_symbol_info.hpp>
 
+namespace {
+	//! archive formats recognized by file name
+	struct CFileFmtInfo
+	{
+		const char* regex;
+		EArchiveFormat format;
+	};
+
+	const CFileFmtInfo fileFmtInfos[] = {
+		{ ".*\\.zip", fmtZip },
+		{ ".*\\.7z", fmt7z },
+		{ ".*\\.tgz", fmtGzip },
+		{ ".*\\.tar", fmtTar },
+		{ ".*\\.gz", fmtGzip },
+		{ ".*\\.cab", fmtCab },
+		{ ".*\\.bz2", fmtBzip2 },
+		{ ".*\\.xz", fmtXz },
+	};
+
+	//! a limit of the nested archive scan has been exceeded: the archive on disk is abandoned
+	class CArchiveLimitError : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	//! counts the bytes read from source against the expanded size limit
+	class CLimitedMemberSource : public CMemberSource
+	{
+	public:
+		CLimitedMemberSource(CMemberSource& source, uint64_t& expandedBytes, uint64_t limit)
+			: m_source(source)
+			, m_expandedBytes(expandedBytes)
+			, m_limit(limit)
+		{}
+
+		virtual size_t read(char* buf, size_t size) override
+		{
+			size_t nread = m_source.read(buf, size);
+			m_expandedBytes += nread;
+			if (m_expandedBytes > m_limit)
+				throw CArchiveLimitError("more than " + std::to_string(m_limit) + " bytes decompressed");
+			return nread;
+		}
+
+		virtual std::filesystem::path filePath() const override { return m_source.filePath(); }
+		virtual std::shared_ptr<CTempStorage> fileOwner() const override { return m_source.fileOwner(); }
+
+	private:
+		CMemberSource& m_source;
+		uint64_t& m_expandedBytes;
+		uint64_t m_limit;
+	};
+}
+
+thread_local int CDirectoryScanner::logIndent = 0;
+thread_local const CDirectoryScanner::ScanPipeline::Emit* CDirectoryScanner::s_memberSink = nullptr;
+thread_local unsigned int CDirectoryScanner::s_archiveDepth = 0;
+thread_local uint64_t CDirectoryScanner::s_expandedBytes = 0;
+thread_local const CPathFilter::DirectoryPtr* CDirectoryScanner::s_directory = nullptr;
+
 CDirectoryScanner::CDirectoryScanner()
-	: logIndent(0)
-	, m_nozip(false)
+	: m_nozip(false)
 	, m_crcCheck(false)
+	, m_dedup(false)
+	, m_trustExtension(false)
+	, m_verbose(false)
+	, m_quiet(false)
+	, m_threads(1)
+	, m_pipeline(false)
+	, m_filterWorkers(1)
+	, m_hashWorkers(1)
+	, m_extractWorkers(1)
+	, m_consumeWorkers(1)
+	, m_queueSize(1024)
+	, m_enumeratorName("native")
+	, m_archiveBackend("native")
+	, m_maxArchiveDepth(16)
+	, m_maxExpandedBytes(0)
+	, m_batchSize(0)
+	, m_batchInterval(1000)
+	, m_xdev(false)
+	, m_followSymlinks(false)
+	, m_inodeDedup(false)
+	, m_memorySpillLimit(16 << 20)
+	, m_archiveWorkers(0)
+	, m_archiveSplitSize(64 << 20)
+	, m_inodes(std::make_unique<CInodeSet>())
 	, m_filespecs({ ".*" })
 	, m_excludeFilespecs({""})
+	, m_maxDepth(CPathFilter::noDepthLimit)
+	, m_pathFilter(std::make_unique<CPathFilter>())
+	, m_archiveMatcher(std::make_unique<CFileNameMatcher>())
+	, m_includeMatcher(std::make_unique<CFileNameMatcher>())
+	, m_explicitMatcher(std::make_unique<CFileNameMatcher>())
+	, m_excludeMatcher(std::make_unique<CFileNameMatcher>())
+	, m_predicate(std::make_unique<CFilePredicate>())
+	, m_crcStore(std::make_unique<CDedupStore>())
+	, m_logger(CLogger::console())
+	, m_metrics(std::make_unique<CScanMetrics>())
+	, m_entryFeed(nullptr)
 {
 	initialize7zDllPath();
+	compileFilters();
 }
 
 CDirectoryScanner::CDirectoryScanner(bool nozip, bool crcCheck, const std::vector<std::string>& filespecs, const std::vector<std::string>& excludeFilespecs)
-	: logIndent(0)
-	, m_nozip(nozip)
+	: m_nozip(nozip)
 	, m_crcCheck(crcCheck)
+	, m_dedup(false)
+	, m_trustExtension(false)
+	, m_verbose(false)
+	, m_quiet(false)
+	, m_threads(1)
+	, m_pipeline(false)
+	, m_filterWorkers(1)
+	, m_hashWorkers(1)
+	, m_extractWorkers(1)
+	, m_consumeWorkers(1)
+	, m_queueSize(1024)
+	, m_enumeratorName("native")
+	, m_archiveBackend("native")
+	, m_maxArchiveDepth(16)
+	, m_maxExpandedBytes(0)
+	, m_batchSize(0)
+	, m_batchInterval(1000)
+	, m_xdev(false)
+	, m_followSymlinks(false)
+	, m_inodeDedup(false)
+	, m_memorySpillLimit(16 << 20)
+	, m_archiveWorkers(0)
+	, m_archiveSplitSize(64 << 20)
+	, m_inodes(std::make_unique<CInodeSet>())
 	, m_filespecs(filespecs)
 	, m_excludeFilespecs(excludeFilespecs)
+	, m_maxDepth(CPathFilter::noDepthLimit)
+	, m_pathFilter(std::make_unique<CPathFilter>())
+	, m_archiveMatcher(std::make_unique<CFileNameMatcher>())
+	, m_includeMatcher(std::make_unique<CFileNameMatcher>())
+	, m_explicitMatcher(std::make_unique<CFileNameMatcher>())
+	, m_excludeMatcher(std::make_unique<CFileNameMatcher>())
+	, m_predicate(std::make_unique<CFilePredicate>())
+	, m_crcStore(std::make_unique<CDedupStore>())
+	, m_logger(CLogger::console())
+	, m_metrics(std::make_unique<CScanMetrics>())
+	, m_entryFeed(nullptr)
 {
 	initialize7zDllPath();
+	compileFilters();
 }
 
 void CDirectoryScanner::initialize7zDllPath()
@@ -80,6 +229,7 @@ std::vector<std::string> CDirectoryScanner::parseCommandLineArguments(const std:
 	po::variables_map vm;
 	po::store(parsed_options, vm);
 	po::notify(vm);
+	compileFilters();
 	
 	std::vector<std::string> to_pass_further = po::collect_unrecognized(parsed_options.options, po::include_positional);
 	return to_pass_further;
@@ -96,273 +246,1479 @@ std::unique_ptr<boost::program_options::options_description> CDirectoryScanner::
 		("exclude,e", po::value< std::vector<std::string> >(&m_excludeFilespecs)->multitoken(),
 			"file specification (regexp). "
 			"Do not process files matching any of these file specifications.")
+		("include-dir", po::value< std::vector<std::string> >(&m_includeDirs)->multitoken(),
+			"directory name (regexp). Process only files below directories matching any of these names.")
+		("exclude-dir", po::value< std::vector<std::string> >(&m_excludeDirs)->multitoken(),
+			"directory name (regexp). Do not enter directories matching any of these names, on disk and in archives.")
+		("max-depth", po::value<unsigned int>(&m_maxDepth),
+			"do not enter directories more than this number of levels below the root. Directories in "
+			"archives count as levels below the directory holding the archive. 0 scans the root only.")
+		("ignore-file", po::value< std::vector<std::string> >(&m_ignoreFiles)->multitoken(),
+			"name of ignore files in the syntax of .gitignore, e.g. .gitignore. The rules of such a file "
+			"exclude files and directories below the directory it is found in.")
+		("xdev", po::value<bool>(&m_xdev)->zero_tokens(),
+			"do not enter directories on other file systems than the root, like find -xdev. "
+			"Needs a backend knowing the devices of directories (linux).")
+		("follow-symlinks", po::value<bool>(&m_followSymlinks)->zero_tokens(),
+			"enter symbolic links to directories. Directories reached again, e.g. through a link to a "
+			"parent, are skipped.")
+		("inode-dedup", po::value<bool>(&m_inodeDedup)->zero_tokens(),
+			"skip files and directories whose device and inode have already been seen during the scan: "
+			"hardlinks and bind mounts are scanned once, before anything is read. Needs a backend knowing "
+			"the inodes of files (linux).")
+		("temp-dir", po::value<std::string>(&m_tempDir),
+			"directory receiving archive members which are extracted to files, e.g. a tmpfs like /dev/shm. "
+			"Default is the temporary directory of the system.")
+		("memory-spill-limit", po::value<uint64_t>(&m_memorySpillLimit),
+			"archive members which need a file and are at most this size in bytes are written to anonymous "
+			"memory files instead (Linux), passed to process_file as /proc/self/fd/N. Larger members go to "
+			"--temp-dir. Default is 16777216, 0 disables memory files.")
+		("min-size", po::value<std::string>(&m_predicateOptions.minSize),
+			"process only files of at least this size in bytes, with an optional k, m, g or t suffix (1k = 1024). "
+			"The predicates are evaluated on the directory entries and archive headers, before files are opened "
+			"or members extracted.")
+		("max-size", po::value<std::string>(&m_predicateOptions.maxSize),
+			"process only files of at most this size.")
+		("max-age", po::value<std::string>(&m_predicateOptions.maxAge),
+			"process only files modified within this time before the scan, in seconds or with an s, m, h, d or w suffix.")
+		("min-age", po::value<std::string>(&m_predicateOptions.minAge),
+			"process only files modified at least this time before the scan.")
+		("changed-within", po::value<std::string>(&m_predicateOptions.changedWithin),
+			"process only files whose status changed within this time before the scan.")
+		("owner", po::value<std::string>(&m_predicateOptions.owner),
+			"process only files of this user, given by name or uid.")
+		("perm", po::value<std::string>(&m_predicateOptions.permissions),
+			"process only files having all of these permission bits set (octal).")
+		("type", po::value<std::string>(&m_predicateOptions.type),
+			"f: process regular files only, l: process symbolic links to files only.")
 		("nozip,n", po::value<bool>(&m_nozip)->zero_tokens(),
 			"do not recurse into archives files")
 		("checkcrc,c", po::value<bool>(&m_crcCheck)->zero_tokens(),
 			"Do not calculate crc of files prior to scanning and do not skip"
 			"scanning if file has already been scanned.")
+		("dedup", po::value<bool>(&m_dedup)->zero_tokens(),
+			"skip files whose contents have already been scanned. Files are compared by size first, "
+			"then by a hash of their first and last 4 KiB and only then by a 128 bit hash of the whole file. "
+			"Archive members are compared by the size and crc of the archive header first. Replaces --checkcrc.")
+		("trust-extension", po::value<bool>(&m_trustExtension)->zero_tokens(),
+			"recognize archives by their file name only. By default the first bytes of the files are read "
+			"to recognize archives by their contents, including files without an extension which don't "
+			"match --filespec. Zip based documents (.docx, .xlsx, .odt, .jar, ...) are then expanded like "
+			"archives, unless a --filespec other than .* selects them.")
+		("verbose,v", po::value<bool>(&m_verbose)->zero_tokens(),
+			"log every archive entry and crc.")
+		("quiet,q", po::value<bool>(&m_quiet)->zero_tokens(),
+			"log errors only.")
 		("7zdll,7", po::value<std::string>(&m_7zDllPath), 
-			"path to 7z.dll. If omitted 7z.dll is searched in the folder, where the executable is stored.");
+			"path to 7z.dll. If omitted 7z.dll is searched in the folder, where the executable is stored.")
+		("threads,j", po::value<unsigned int>(&m_threads),
+			"number of threads scanning directories in parallel. Default is 1.")
+		("pipeline", po::value<bool>(&m_pipeline)->zero_tokens(),
+			"run enumeration, filtering, hashing, extraction and processing in separate stages "
+			"connected by bounded queues.")
+		("filter-workers", po::value<unsigned int>(&m_filterWorkers),
+			"number of threads of the pipeline filter stage. Default is 1.")
+		("hash-workers", po::value<unsigned int>(&m_hashWorkers),
+			"number of threads of the pipeline hash stage. Default is 1.")
+		("extract-workers", po::value<unsigned int>(&m_extractWorkers),
+			"number of threads of the pipeline archive extraction stage. Default is 1.")
+		("consume-workers", po::value<unsigned int>(&m_consumeWorkers),
+			"number of threads of the pipeline stage calling process_file. Default is 1.")
+		("archive-workers", po::value<unsigned int>(&m_archiveWorkers),
+			"number of threads decompressing archives, which is also the limit of archives read at a time. "
+			"The directory scan hands archives over to them and goes on, process_file is called concurrently. "
+			"Default is 0: archives are read by the thread finding them, one after the other.")
+		("archive-split-size", po::value<uint64_t>(&m_archiveSplitSize),
+			"with --archive-workers, zip and cab archives are read by several workers at a time, each "
+			"decompressing a range of the members: one worker per this many bytes of the archive file. "
+			"Default is 67108864, 0 reads every archive by one worker.")
+		("queue-size", po::value<size_t>(&m_queueSize),
+			"capacity of the queues between pipeline stages. Default is 1024.")
+		("enumerator", po::value<std::string>(&m_enumeratorName),
+			"directory enumeration backend: std (std::filesystem), native (best backend of the platform) "
+			"or linux (getdents64). Default is native.")
+		("index", po::value<std::string>(&m_indexPath),
+			"scan index file. Files and archives which are unchanged since the last scan with the same "
+			"index are skipped, changes are reported. The index is created if it does not exist.")
+		("archive-backend", po::value<std::string>(&m_archiveBackend),
+			"archive reader backend: 7z (7z.dll), libarchive or native (libarchive where it is built in, "
+			"7z otherwise). Default is native.")
+		("max-archive-depth", po::value<unsigned int>(&m_maxArchiveDepth),
+			"archives nested deeper are not opened. 1 opens archives on disk only. Default is 16.")
+		("max-expanded-bytes", po::value<uint64_t>(&m_maxExpandedBytes),
+			"stop scanning an archive when more than this number of bytes have been decompressed from it, "
+			"including nested archives. Protects against zip bombs. Default is 0 (no limit).")
+		("metrics", po::value<std::string>(&m_metricsPath),
+			"write the counters and per phase timings of the scan to this file as JSON.")
+		("batch-size", po::value<size_t>(&m_batchSize),
+			"pass the files found to process_batch in batches of this size instead of one by one to "
+			"process_file. Default is 0 (no batches).")
+		("batch-interval", po::value<unsigned int>(&m_batchInterval),
+			"milliseconds after which a batch is passed to process_batch even if it isn't full. Default is 1000.");
 	return desc;
 }
 
-void CDirectoryScanner::scanPathRec(const std::filesystem::path& rootPath, int indent)
+struct CDirectoryScanner::CTreeWalk::CLevel
 {
-	logs(indent) << "Searching directory " << rootPath << "\n";
+	CPathFilter::DirectoryPtr directory;
+	std::unique_ptr<CDirHandle> dir;
+};
 
-	std::filesystem::directory_iterator rdi(rootPath);
-	std::filesystem::directory_iterator endIter = std::filesystem::directory_iterator();
+CDirectoryScanner::CTreeWalk::CTreeWalk(CDirectoryScanner& scanner, const std::filesystem::path& rootPath)
+	: m_scanner(scanner)
+{
+	SCANNER_LOG_TO(m_scanner, levelInfo, 0) << "Searching directory " << rootPath;
+	m_stack.push_back({ m_scanner.m_pathFilter->root(rootPath, m_scanner.m_xdev ? CStorageDevice::id(rootPath) : 0), m_scanner.openDirectory(rootPath, nullptr) });
+	m_scanner.checkDirectoryIdentity(*m_stack.back().dir, *m_stack.back().directory, 0);
+}
+
+CDirectoryScanner::CTreeWalk::~CTreeWalk()
+{
+}
 
-	while (rdi != endIter) // 2.
+bool CDirectoryScanner::CTreeWalk::next(const OnFile& onFile)
+{
+	CDirEntry entry;
+	while (!m_stack.empty())
 	{
+		CLevel& level = m_stack.back();
+		bool more;
+		try {
+			more = m_scanner.nextEntry(*level.dir, entry);
+		}
+		catch (std::exception& ex)
+		{
+			if (m_stack.size() == 1)
+				throw;
+			SCANNER_LOG_TO(m_scanner, levelError, 0) << "Error in directory " << level.directory->path << " -- skipped: " << ex.what();
+			more = false;
+		}
+		if (!more) {
+			m_stack.pop_back();
+			continue;
+		}
+
+		std::filesystem::path p = level.directory->path / entry.name;
 		try {
-			// logs << rdi.level() << ": " << rdi->path() << "\n";
-			if (std::filesystem::is_regular_file(rdi->status())) {
-				dispatch_file(*rdi, rdi->path(), 0);
+			if (entry.isFile()) {
+				EEngine engine = engUnknown;
+				EArchiveFormat format = fmtNone;
+				if (m_scanner.m_pathFilter->acceptsFile(*level.directory, entry.name) && m_scanner.matchesPredicates(*level.dir, entry, p, engine, format)
+					&& m_scanner.checkFileIdentity(entry, p)) {
+					CDirectoryScope scope(level.directory);
+					onFile(p, level.directory, engine, format);
+					return true;
+				}
+				m_scanner.m_metrics->add(CScanMetrics::counterFilesSkipped);
 			}
-			if (std::filesystem::is_directory(*rdi)) {
-				if (!std::filesystem::is_symlink(*rdi))
-				{
-					scanPathRec(rdi->path(), indent + 1);
+			else if (m_scanner.isSubdirectory(entry)) {
+				const int indent = static_cast<int>(m_stack.size());
+				CPathFilter::DirectoryPtr sub = m_scanner.enterDirectory(level.directory, entry.name, indent);
+				if (sub) {
+					// symlinks are opened by their path, relative opens don't follow them
+					std::unique_ptr<CDirHandle> dir = m_scanner.openDirectory(p, entry.isDirectory() ? level.dir.get() : nullptr);
+					if (m_scanner.checkDirectoryIdentity(*dir, *sub, indent))
+						m_stack.push_back({ std::move(sub), std::move(dir) });
 				}
 			}
 		}
 		catch (std::exception& ex)
 		{
-			logs(0) << "\nError in directory " << rdi->path() << " -- skipped: \n";
-			logs(0) << ex.what() << "\n\n";
+			SCANNER_LOG_TO(m_scanner, levelError, 0) << "Error in directory " << p << " -- skipped: " << ex.what();
 		}
-		rdi++;
 	}
+	return false;
 }
 
+void CDirectoryScanner::walkTree(const std::filesystem::path& rootPath, const OnFile& onFile)
+{
+	CTreeWalk walk(*this, rootPath);
+	while (walk.next(onFile))
+		;
+}
 
-void CDirectoryScanner::scanPath(const std::filesystem::path& rootPath)
+void CDirectoryScanner::scanDirectoryTask(CWorkStealingPool& pool, const CPathFilter::DirectoryPtr& directory, int indent)
+{
+	std::unique_ptr<CDirHandle> dir = openDirectory(directory->path, nullptr);
+	if (!checkDirectoryIdentity(*dir, *directory, indent))
+		return;
+	CDirEntry entry;
+
+	while (nextEntry(*dir, entry))
+	{
+		std::filesystem::path p = directory->path / entry.name;
+		try {
+			if (entry.isFile()) {
+				EEngine engine = engUnknown;
+				EArchiveFormat format = fmtNone;
+				if (m_pathFilter->acceptsFile(*directory, entry.name) && matchesPredicates(*dir, entry, p, engine, format)
+					&& checkFileIdentity(entry, p)) {
+					CDirectoryScope scope(directory);
+					dispatch_file(p, p, 0, engine, format);
+				}
+				else {
+					m_metrics->add(CScanMetrics::counterFilesSkipped);
+				}
+			}
+			else if (isSubdirectory(entry)) {
+				CPathFilter::DirectoryPtr sub = enterDirectory(directory, entry.name, indent + 1);
+				if (sub) {
+					pool.submit([this, &pool, sub, indent]() {
+						try {
+							scanDirectoryTask(pool, sub, indent + 1);
+						}
+						catch (std::exception& ex)
+						{
+							SCANNER_LOG(levelError, 0) << "Error in directory " << sub->path << " -- skipped: " << ex.what();
+						}
+					});
+				}
+			}
+		}
+		catch (std::exception& ex)
+		{
+			SCANNER_LOG(levelError, 0) << "Error in directory " << p << " -- skipped: " << ex.what();
+		}
+	}
+}
+
+CPathFilter::DirectoryPtr CDirectoryScanner::enterDirectory(const CPathFilter::DirectoryPtr& parent, const std::string& name, int indent)
+{
+	CPathFilter::DirectoryPtr dir = m_pathFilter->enter(parent, name);
+	if (dir) {
+		SCANNER_LOG(levelInfo, indent) << "Searching directory " << dir->path;
+	}
+	else {
+		SCANNER_LOG(levelDebug, indent) << "Skipping directory " << parent->path / name;
+		m_metrics->add(CScanMetrics::counterDirectoriesPruned);
+	}
+	return dir;
+}
+
+bool CDirectoryScanner::isSubdirectory(const CDirEntry& entry) const
+{
+	return entry.isDirectory() || (m_followSymlinks && entry.isDirectoryLink());
+}
+
+bool CDirectoryScanner::checkDirectoryIdentity(const CDirHandle& dir, const CPathFilter::CDirectory& directory, int indent)
+{
+	const std::filesystem::path& p = directory.path;
+	if (dir.inode == 0)
+		return true;
+	if (m_xdev && directory.parent && dir.device != directory.rootDevice) {
+		SCANNER_LOG(levelDebug, indent) << "Skipping directory on another file system " << p;
+		m_metrics->add(CScanMetrics::counterDirectoriesPruned);
+		return false;
+	}
+	if ((m_inodeDedup || m_followSymlinks) && !m_inodes->insert(dir.device, dir.inode)) {
+		SCANNER_LOG(levelDebug, indent) << "Skipping directory scanned before " << p;
+		m_metrics->add(CScanMetrics::counterDirectoriesPruned);
+		return false;
+	}
+	return true;
+}
+
+bool CDirectoryScanner::checkFileIdentity(const CDirEntry& entry, const std::filesystem::path& p)
+{
+	if (!m_inodeDedup || entry.inode == 0 || m_inodes->insert(entry.device, entry.inode))
+		return true;
+	SCANNER_LOG(levelDebug, logIndent) << "already processed: " << p.filename();
+	m_metrics->add(CScanMetrics::counterDedupHits);
+	return false;
+}
+
+std::unique_ptr<CDirHandle> CDirectoryScanner::openDirectory(const std::filesystem::path& dirPath, const CDirHandle* parent)
+{
+	CScanMetrics::CScopedTimer timer(*m_metrics, CScanMetrics::timerEnumerate);
+	std::unique_ptr<CDirHandle> dir = m_enumerator->open(dirPath, parent);
+	m_metrics->add(CScanMetrics::counterDirectories);
+	return dir;
+}
+
+bool CDirectoryScanner::nextEntry(CDirHandle& dir, CDirEntry& entry)
+{
+	CScanMetrics::CScopedTimer timer(*m_metrics, CScanMetrics::timerEnumerate);
+	return m_enumerator->next(dir, entry);
+}
+
+void CDirectoryScanner::scanPathPipelined(const std::filesystem::path& rootPath)
+{
+	typedef ScanPipeline::Emit Emit;
+	auto pipeline = std::make_shared<ScanPipeline>(m_queueSize);
+
+	pipeline->addStage("filter", m_filterWorkers, [this](CScanItem& item, const Emit& emit) {
+		if (item.engine == engUnknown)
+			item.engine = chooseEngine(item.logicalFilename, item.format);
+		if (item.engine != engUnknown || sniffs(item.logicalFilename, item.engine))
+			emit(std::move(item));
+		else
+			m_metrics->add(CScanMetrics::counterFilesSkipped);
+	});
+	pipeline->addStage("hash", m_hashWorkers, [this](CScanItem& item, const Emit& emit) {
+		try {
+			// the head is read by the reader which calculates the crc
+			bool changed;
+			item.engine = identifyFile(item.path, item.logicalFilename, item.engine, item.format, changed);
+			m_metrics->add(item.engine == engUnknown ? CScanMetrics::counterFilesSkipped : CScanMetrics::counterFilesMatched);
+			if (item.engine == engUnknown || !changed)
+				return;
+			if (item.engine != engFile) {
+				emit(std::move(item));
+				return;
+			}
+			bool isNew = fileHasNewCrcOrNotChecked(item.path, item.crc);
+			if (m_index && item.crc != 0)
+				m_index->setCrc(CScanIndex::key(item.path), item.crc);
+			if (isNew)
+				emit(std::move(item));
+		}
+		catch (std::exception& ex)
+		{
+			SCANNER_LOG(levelError, 0) << "Error processing " << item.logicalFilename << ": " << ex.what();
+			throw;
+		}
+	});
+	pipeline->addStage("extract", m_extractWorkers, [this](CScanItem& item, const Emit& emit) {
+		if (item.engine != eng7z) {
+			emit(std::move(item));
+			return;
+		}
+		// members found by process_7z are emitted to the consume stage by dispatch_member
+		CDirectoryScope scope(item.directory);
+		s_memberSink = &emit;
+		try {
+			process_7z(item.path, item.logicalFilename, item.format);
+		}
+		catch (std::exception& ex)
+		{
+			s_memberSink = nullptr;
+			SCANNER_LOG(levelError, 0) << "Error processing " << item.logicalFilename << ": " << ex.what();
+			throw;
+		}
+		catch (...)
+		{
+			s_memberSink = nullptr;
+			throw;
+		}
+		s_memberSink = nullptr;
+	});
+	pipeline->addStage("consume", m_consumeWorkers, [this](CScanItem& item, const Emit&) {
+		CReaderScope readerScope;
+		try {
+			if (item.member) {
+				CFileMemberSource source(item.path, item.storage);
+				deliverStream(source, item.logicalFilename, item.crc, item.size);
+			}
+			else {
+				deliverFile(item.path, item.logicalFilename, item.crc);
+			}
+		}
+		catch (std::exception& ex)
+		{
+			SCANNER_LOG(levelError, 0) << "Error processing " << item.logicalFilename << ": " << ex.what();
+			throw;
+		}
+	});
+
+	{
+		std::lock_guard<std::mutex> lock(m_pipelineMutex);
+		m_activePipeline = pipeline;
+	}
+	auto finish = [this, &pipeline]() {
+		std::lock_guard<std::mutex> lock(m_pipelineMutex);
+		m_pipelineStats = pipeline->stats();
+		m_activePipeline.reset();
+	};
+	try {
+		pipeline->run("enumerate", [this, &rootPath](const Emit& emit) {
+			walkTree(rootPath, [&emit](const std::filesystem::path& p, const CPathFilter::DirectoryPtr& dir, EEngine engine, EArchiveFormat format) {
+				CScanItem item;
+				item.path = p;
+				item.logicalFilename = p;
+				item.directory = dir;
+				item.engine = engine;
+				item.format = format;
+				emit(std::move(item));
+			});
+		});
+	}
+	catch (...)
+	{
+		finish();
+		throw;
+	}
+	finish();
+}
+
+std::vector<CPipelineStageStats> CDirectoryScanner::pipelineStats() const
+{
+	std::lock_guard<std::mutex> lock(m_pipelineMutex);
+	if (m_activePipeline)
+		return m_activePipeline->stats();
+	return m_pipelineStats;
+}
+
+void CDirectoryScanner::beginScan()
 {
+	// the file specifications may have been changed by an external options parser
+	compileFilters();
+	m_pathFilter->configure(m_includeDirs, m_excludeDirs, m_maxDepth, m_ignoreFiles);
+	m_inodes->clear();
+	m_enumerator = createEnumerator();
+	m_metrics->reset();
+
 	if (!m_nozip) {
-		m_7zlib = std::make_unique<SevenZip::SevenZipLibrary>();
-		if (!m_7zlib->Load(m_7zDllPath))
-			throw std::runtime_error("Error loading 7z.dll from " + m_7zDllPath);
+		m_archiveReader = CArchiveReader::create(m_archiveBackend, m_7zDllPath);
+		m_archiveReader->setMetrics(m_metrics.get());
+		m_archiveReader->setTempDirectory(tempDirectory());
 	}
+	if (m_archiveWorkers && !m_nozip)
+		m_archiveScheduler = std::make_unique<CArchiveScheduler>(m_archiveWorkers);
+	else
+		m_archiveScheduler.reset();
 
-	if (std::filesystem::is_regular_file(rootPath))
+	if (m_dedup && !m_duplicates) {
+		m_duplicates = std::make_unique<CDuplicateDetector>();
+	}
+	else if (!m_dedup) {
+		m_duplicates.reset();
+	}
+
+	if (!m_indexPath.empty()) {
+		m_index = std::make_unique<CScanIndex>();
+		m_index->load(m_indexPath);
+	}
+	else {
+		m_index.reset();
+	}
+}
+
+std::unique_ptr<CDirEnumerator> CDirectoryScanner::createEnumerator()
+{
+	return CDirEnumerator::create(m_enumeratorName);
+}
+
+void CDirectoryScanner::endScan(const std::vector<std::filesystem::path>& roots)
+{
+	if (m_archiveScheduler)
+		m_archiveScheduler->wait();
+	flushBatch();
+	if (m_index) {
+		std::vector<std::string> rootKeys;
+		for (const std::filesystem::path& rootPath : roots)
+			rootKeys.push_back(CScanIndex::key(rootPath));
+		for (const std::string& key : m_index->removeUnseen(rootKeys)) {
+			process_change(std::filesystem::path(std::u8string(key.begin(), key.end())), changeRemoved);
+		}
+		m_index->save(m_indexPath);
+	}
+	if (!m_metricsPath.empty()) {
+		std::ofstream ofs(m_metricsPath, std::ios::binary);
+		ofs << m_metrics->toJson();
+		if (!ofs) {
+			SCANNER_LOG(levelError, 0) << "Can't write metrics to " << m_metricsPath;
+		}
+	}
+	m_logger->flush();
+}
+
+void CDirectoryScanner::abortScan()
+{
+	// the archive workers still call process_file / process_7z, they finish before the scan returns
+	try {
+		if (m_archiveScheduler)
+			m_archiveScheduler->wait();
+		// the files accepted so far are passed on
+		flushBatch();
+	}
+	catch (std::exception& ex)
 	{
+		SCANNER_LOG(levelError, 0) << "Error finishing the scan: " << ex.what();
+	}
+	m_logger->flush();
+}
+
+void CDirectoryScanner::scanSequential(const std::filesystem::path& rootPath)
+{
+	if (std::filesystem::is_regular_file(rootPath))
 		dispatch_file(rootPath, rootPath, 0);
+	else
+		walkTree(rootPath, [this](const std::filesystem::path& p, const CPathFilter::DirectoryPtr&, EEngine engine, EArchiveFormat format) {
+			dispatch_file(p, p, 0, engine, format);
+		});
+}
+
+void CDirectoryScanner::scanPath(const std::filesystem::path& rootPath)
+{
+	beginScan();
+	try {
+		scanRoot(rootPath, m_threads);
+	}
+	catch (...)
+	{
+		abortScan();
+		throw;
+	}
+	endScan({ rootPath });
+}
+
+void CDirectoryScanner::scanRoot(const std::filesystem::path& rootPath, unsigned int threads)
+{
+	if (std::filesystem::is_regular_file(rootPath) || (!m_pipeline && threads <= 1))
+	{
+		scanSequential(rootPath);
+	}
+	else if (m_pipeline)
+	{
+		scanPathPipelined(rootPath);
 	}
 	else
 	{
-		scanPathRec(rootPath, 0);
+		CWorkStealingPool pool(threads);
+		CPathFilter::DirectoryPtr root = m_pathFilter->root(rootPath, m_xdev ? CStorageDevice::id(rootPath) : 0);
+		SCANNER_LOG(levelInfo, 0) << "Searching directory " << rootPath;
+		pool.submit([this, &pool, root]() { scanDirectoryTask(pool, root, 0); });
+		pool.wait();
 	}
 }
 
-void CDirectoryScanner::process_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc)
+void CDirectoryScanner::scanPaths(const std::vector<std::filesystem::path>& roots)
+{
+	std::vector<std::filesystem::path> unique = uniqueRoots(roots);
+	beginScan();
+
+	struct CDevice
+	{
+		bool rotational = false;
+		std::vector<std::filesystem::path> roots;
+	};
+	auto scanDevice = [this](const CDevice& device) {
+		// a spinning disk is read by a single thread, seeking between the directories of several would slow all of them down
+		const unsigned int threads = device.rotational ? 1 : m_threads;
+		for (const std::filesystem::path& root : device.roots) {
+			try {
+				scanRoot(root, threads);
+			}
+			catch (std::exception& ex)
+			{
+				SCANNER_LOG(levelError, 0) << "Error scanning " << root << " -- skipped: " << ex.what();
+			}
+		}
+	};
+
+	std::map<uint64_t, CDevice> devices;
+	if (m_pipeline) {
+		// the stages of the pipeline have threads of their own
+		devices[0].roots = unique;
+	}
+	else {
+		for (const std::filesystem::path& root : unique) {
+			CDevice& device = devices[CStorageDevice::id(root)];
+			if (device.roots.empty())
+				device.rotational = CStorageDevice::isRotational(root);
+			device.roots.push_back(root);
+		}
+	}
+	std::vector<std::thread> threads;
+	try {
+		for (const auto& [id, device] : devices) {
+			SCANNER_LOG(levelDebug, 0) << "Device " << id << (device.rotational ? " (rotational)" : "") << ": " << device.roots.size() << " roots";
+			if (id != devices.begin()->first)
+				threads.emplace_back(scanDevice, std::cref(device));
+		}
+		if (!devices.empty())
+			scanDevice(devices.begin()->second);
+	}
+	catch (...)
+	{
+		for (std::thread& thread : threads)
+			thread.join();
+		abortScan();
+		throw;
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+
+	endScan(unique);
+}
+
+std::vector<std::filesystem::path> CDirectoryScanner::uniqueRoots(const std::vector<std::filesystem::path>& roots)
 {
+	// compared by their canonical paths, scanned by the paths given
+	std::vector<std::filesystem::path> canonical;
+	for (const std::filesystem::path& root : roots) {
+		std::error_code ec;
+		std::filesystem::path p = std::filesystem::weakly_canonical(root, ec);
+		if (ec)
+			p = std::filesystem::absolute(root, ec).lexically_normal();
+		// "dir/" has an empty file name
+		if (!p.has_filename() && p.has_relative_path())
+			p = p.parent_path();
+		canonical.push_back(p);
+	}
+	auto contains = [](const std::filesystem::path& dir, const std::filesystem::path& p) {
+		return std::mismatch(dir.begin(), dir.end(), p.begin(), p.end()).first == dir.end();
+	};
+
+	std::vector<std::filesystem::path> unique;
+	for (size_t i = 0; i < roots.size(); i++) {
+		size_t j = 0;
+		// of two equal roots the first one is kept
+		while (j < roots.size() && (j == i || !contains(canonical[j], canonical[i]) || (canonical[j] == canonical[i] && j > i)))
+			j++;
+		if (j < roots.size()) {
+			SCANNER_LOG(levelInfo, 0) << "Skipping " << roots[i] << ", it is scanned with " << roots[j];
+			continue;
+		}
+		unique.push_back(roots[i]);
+	}
+	return unique;
 }
 
-class ListCallBackOutput : public SevenZip::ListCallback
+//! Produces the entries of a sequential scan on the thread of the consumer, advancing a CTreeWalk by one
+//! file per entry. The archive backends deliver members through callbacks, so an archive is read by a
+//! thread of its own, which waits in deliverMember until the consumer asks for the next entry.
+//! Destroying the range sets m_cancel, which the backends poll to stop reading the archive.
+class CDirectoryScanner::CEntryFeed : public CScanEntrySource
 {
 public:
-	ListCallBackOutput(std::vector<SevenZip::intl::FileInfo>& fileInfos)
-		: m_fileInfos(fileInfos)
+	CEntryFeed(CDirectoryScanner& scanner, const std::filesystem::path& rootPath)
+		: m_scanner(scanner)
+		, m_rootPath(rootPath)
+		, m_started(false)
+		, m_finished(false)
+		, m_hasFile(false)
+		, m_cancel(false)
+		, m_state(stateIdle)
+		, m_member(nullptr)
 	{}
 
-	virtual void OnFileFound(const SevenZip::intl::FileInfo& fileInfo) override
+	~CEntryFeed()
 	{
-		m_fileInfos.push_back(fileInfo);
+		stopArchive();
+		if (m_started && !m_finished) {
+			// the index is not updated after an incomplete scan
+			m_walk.reset();
+			m_scanner.abortScan();
+		}
+		if (m_scanner.m_archiveReader)
+			m_scanner.m_archiveReader->setCancel(nullptr);
+		m_scanner.m_entryFeed = nullptr;
 	}
 
-	std::vector<SevenZip::intl::FileInfo>& m_fileInfos;
+	virtual const CScanEntry* next() override
+	{
+		if (m_returned) {
+			m_scanner.m_metrics->record(CScanMetrics::timerEntryFeed, std::chrono::steady_clock::now() - *m_returned);
+			m_returned.reset();
+		}
+		m_hasFile = false;
+		if (m_finished)
+			return nullptr;
+		const CScanEntry* entry = nullptr;
+		try {
+			entry = advance();
+		}
+		catch (...)
+		{
+			stopArchive();
+			m_finished = true;
+			m_walk.reset();
+			m_scanner.abortScan();
+			throw;
+		}
+		if (entry)
+			m_returned = std::chrono::steady_clock::now();
+		return entry;
+	}
+
+	//! called by dispatch_file on the thread of the consumer: entry is returned by next
+	void deliverFile(const CScanEntry& entry)
+	{
+		m_file = entry;
+		m_hasFile = true;
+	}
+
+	//! called by dispatch_file on the thread of the consumer: read the archive on the archive thread
+	void readArchive(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, EArchiveFormat format)
+	{
+		CPathFilter::DirectoryPtr directory = s_directory ? *s_directory : nullptr;
+		const int indent = logIndent;
+		m_state = stateReading;
+		m_archiveThread = std::thread([this, p, logicalFilename, format, directory, indent]() {
+			CDirectoryScope scope(directory);
+			logIndent = indent;
+			std::exception_ptr error;
+			try {
+				m_scanner.process_7z(p, logicalFilename, format);
+			}
+			catch (...)
+			{
+				error = std::current_exception();
+			}
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_error = error;
+			m_state = stateRead;
+			m_changed.notify_all();
+		});
+	}
+
+	//! called by the archive thread: hand entry over and wait until the consumer is done with it.
+	//! Returns at once if the range has been destroyed, the backend then stops at m_cancel.
+	void deliverMember(const CScanEntry& entry)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (m_cancel)
+			return;
+		m_member = &entry;
+		m_state = stateDelivered;
+		m_changed.notify_all();
+		m_changed.wait(lock, [this]() { return m_state != stateDelivered || m_cancel; });
+		m_member = nullptr;
+	}
+
+private:
+	//! the next entry of the archive being read or, after it, of the walk
+	const CScanEntry* advance()
+	{
+		if (!m_started) {
+			m_started = true;
+			m_scanner.beginScan();
+			if (m_scanner.m_archiveReader)
+				m_scanner.m_archiveReader->setCancel(&m_cancel);
+			if (std::filesystem::is_regular_file(m_rootPath))
+				m_scanner.dispatch_file(m_rootPath, m_rootPath, 0);
+			else
+				m_walk = std::make_unique<CTreeWalk>(m_scanner, m_rootPath);
+		}
+		else if (m_archiveThread.joinable()) {
+			// the archive thread continues from the member returned last
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_state = stateReading;
+			m_changed.notify_all();
+		}
+
+		for (;;) {
+			if (m_hasFile)
+				return &m_file;
+			if (m_archiveThread.joinable()) {
+				if (const CScanEntry* member = nextMember())
+					return member;
+				continue;
+			}
+			auto onFile = [this](const std::filesystem::path& p, const CPathFilter::DirectoryPtr&, EEngine engine, EArchiveFormat format) {
+				m_scanner.dispatch_file(p, p, 0, engine, format);
+			};
+			if (!m_walk || !m_walk->next(onFile))
+				break;
+		}
+		m_walk.reset();
+		m_finished = true;
+		m_scanner.endScan({ m_rootPath });
+		return nullptr;
+	}
+
+	//! wait for the next member of the archive thread, nullptr once it has read the archive
+	const CScanEntry* nextMember()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_changed.wait(lock, [this]() { return m_state != stateReading; });
+		if (m_state == stateDelivered)
+			return m_member;
+		lock.unlock();
+		m_archiveThread.join();
+		m_state = stateIdle;
+		if (m_error)
+			std::rethrow_exception(std::exchange(m_error, nullptr));
+		return nullptr;
+	}
+
+	//! cancel the archive being read and wait for the archive thread
+	void stopArchive()
+	{
+		if (!m_archiveThread.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_cancel = true;
+		}
+		m_changed.notify_all();
+		m_archiveThread.join();
+	}
+
+	enum EState
+	{
+		stateIdle,	//!< no archive is being read
+		stateReading,	//!< the archive thread looks for the next member
+		stateDelivered,	//!< the consumer looks at m_member
+		stateRead	//!< the archive thread is done
+	};
+
+	CDirectoryScanner& m_scanner;
+	std::filesystem::path m_rootPath;
+	bool m_started;
+	bool m_finished;
+	std::unique_ptr<CTreeWalk> m_walk;
+	CScanEntry m_file;	//!< file on disk delivered by the last step of the walk
+	bool m_hasFile;
+	std::optional<std::chrono::steady_clock::time_point> m_returned;	//!< when the consumer got the last entry
+
+	std::thread m_archiveThread;
+	std::atomic<bool> m_cancel;	//!< stops the archive backend, set when the range is destroyed
+	std::mutex m_mutex;	//!< protects the members below
+	std::condition_variable m_changed;
+	EState m_state;
+	const CScanEntry* m_member;
+	std::exception_ptr m_error;
 };
 
-void CDirectoryScanner::process_7z(const std::filesystem::path& zipPath, const std::filesystem::path& logicalFilename, const std::string& fmtHint)
+CScanRange CDirectoryScanner::entries(const std::filesystem::path& rootPath)
 {
-	logs(logIndent) << "searching archive " << zipPath.filename() << std::endl;
-	try {
-		SevenZip::SevenZipLister lister(*m_7zlib, zipPath.string());
-
-		SevenZip::CompressionFormat::_Enum compressionFormat;
-		// Try to detect compression type: for some reason this doesnt work.
-		//if (!lister.DetectCompressionFormat()) throw std::exception("Can't detect compression format");
-		if (fmtHint == "zip") 
-			compressionFormat = SevenZip::CompressionFormat::Zip;
-		else if (fmtHint == "7z") 
-			compressionFormat = SevenZip::CompressionFormat::SevenZip;
-		else if (fmtHint == "tar")
-			compressionFormat = SevenZip::CompressionFormat::Tar;
-		else if (fmtHint == "gz")
-			compressionFormat = SevenZip::CompressionFormat::GZip;
-		else if (fmtHint == "xz")
-			compressionFormat = SevenZip::CompressionFormat::XZ;
-		else if (fmtHint == "bz2")
-			compressionFormat = SevenZip::CompressionFormat::BZip2;
-		else if (fmtHint == "cab")
-			compressionFormat = SevenZip::CompressionFormat::Cab;
-		else
-			throw std::logic_error("Unknown format: " + fmtHint);
+	if (m_entryFeed)
+		throw std::logic_error("entries: the scanner is already iterating a scan");
+	auto feed = std::make_unique<CEntryFeed>(*this, rootPath);
+	m_entryFeed = feed.get();
+	return CScanRange(std::move(feed));
+}
+
+void CDirectoryScanner::deliverFile(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc)
+{
+	if (m_entryFeed) {
+		CScanEntry entry;
+		entry.path = p;
+		entry.logicalFilename = logicalFilename;
+		entry.crc = crc;
+		m_entryFeed->deliverFile(entry);
+		return;
+	}
+	CScanMetrics::CScopedTimer timer(*m_metrics, CScanMetrics::timerProcessFile);
+	if (m_batchSize) {
+		addToBatch(p, logicalFilename, crc, 0, nullptr);
+	}
+	else {
+		process_file(p, logicalFilename, crc);
+	}
+}
 
-		lister.SetCompressionFormat(compressionFormat);
+void CDirectoryScanner::deliverStream(CMemberSource& source, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size)
+{
+	if (m_entryFeed) {
+		CScanEntry entry;
+		entry.path = source.filePath();
+		entry.logicalFilename = logicalFilename;
+		entry.crc = crc;
+		entry.size = size;
+		entry.source = &source;
+		m_entryFeed->deliverMember(entry);
+		return;
+	}
+	CScanMetrics::CScopedTimer timer(*m_metrics, CScanMetrics::timerProcessFile);
+	if (m_batchSize && !source.filePath().empty()) {
+		// dispatch_member has extracted the member to a file
+		addToBatch(source.filePath(), logicalFilename, crc, size, source.fileOwner());
+	}
+	else {
+		process_stream(source, logicalFilename, crc, size);
+	}
+}
 
-		std::vector<SevenZip::intl::FileInfo> fileInfos;
-		ListCallBackOutput myListCallBack(fileInfos);
-		lister.ListArchive("", (SevenZip::ListCallback*) & myListCallBack);
-		
-		for (size_t i = 0; i < fileInfos.size(); i++)
+void CDirectoryScanner::addToBatch(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size,
+	std::shared_ptr<CTempStorage> owner)
+{
+	std::unique_ptr<CScanBatch> due;
+	{
+		std::lock_guard<std::mutex> lock(m_batchMutex);
+		if (!m_batch) {
+			if (!m_spareBatches.empty()) {
+				m_batch = std::move(m_spareBatches.back());
+				m_spareBatches.pop_back();
+			}
+			else {
+				m_batch = std::make_unique<CScanBatch>();
+			}
+		}
+		m_batch->add(p, logicalFilename, crc, size, std::move(owner));
+		if (m_batch->size() >= m_batchSize
+			|| std::chrono::steady_clock::now() - m_batch->started() >= std::chrono::milliseconds(m_batchInterval)) {
+			due = std::move(m_batch);
+		}
+	}
+	// the next batch is filled by other threads while this one is processed
+	if (due)
+		passBatch(std::move(due));
+}
+
+void CDirectoryScanner::flushBatch()
+{
+	std::unique_ptr<CScanBatch> due;
+	{
+		std::lock_guard<std::mutex> lock(m_batchMutex);
+		if (m_batch && !m_batch->empty())
+			due = std::move(m_batch);
+	}
+	if (due)
+		passBatch(std::move(due));
+}
+
+void CDirectoryScanner::passBatch(std::unique_ptr<CScanBatch> batch)
+{
+	struct CRecycle {
+		CDirectoryScanner& scanner;
+		std::unique_ptr<CScanBatch>& batch;
+		~CRecycle()
 		{
-			SevenZip::FileInfo& fi = fileInfos[i];
-			logs() << "Entry " << i << ": " << fi.FileName << " " << (fi.IsDirectory ? "<DIR>" : "") << " " << std::hex << fi.crc << "\n";
-			if (fi.IsDirectory) continue;
-
-			std::filesystem::path pathInZip = fi.FileName;
-			std::filesystem::path fileInZip = pathInZip.filename();
-			size_t fileSize = fi.Size;
-			std::string fmtHint;
-			EEngine eng = chooseEngine(fileInZip, fmtHint);
-			if (eng != engUnknown) {
-				if (!m_crcCheck || fi.crc == 0 || crcSet.find(fi.crc) == crcSet.end())
-				{
-					std::filesystem::path tempPath = std::filesystem::temp_directory_path() / generate_unique_path();
-					std::filesystem::create_directories(tempPath);
+			batch->clear();
+			std::lock_guard<std::mutex> lock(scanner.m_batchMutex);
+			scanner.m_spareBatches.push_back(std::move(batch));
+		}
+	} recycle{ *this, batch };
+	process_batch(batch->entries());
+}
 
-					logs(logIndent) << "extracting file " << fileInZip << "\n";
+void CDirectoryScanner::process_batch(std::span<const CBatchEntry> entries)
+{
+	for (const CBatchEntry& entry : entries)
+	{
+		process_file(std::filesystem::path(entry.path), std::filesystem::path(entry.logicalFilename), entry.crc);
+	}
+}
 
-					SevenZip::SevenZipExtractor extractor(*m_7zlib, zipPath.string());
-					extractor.SetCompressionFormat(compressionFormat);
-					
-					unsigned int index = static_cast<unsigned int>(i);
-					extractor.ExtractFilesFromArchive(&index, 1, tempPath.string());
+void CDirectoryScanner::process_change(const std::filesystem::path& p, EChange change)
+{
+	static const char* const changeNames[] = { "added", "modified", "removed" };
+	SCANNER_LOG(levelInfo, logIndent) << changeNames[change] << ": " << p;
+}
 
-					try {
-						std::filesystem::path tempFilePath = tempPath / fi.FileName;
-						dispatch_file(tempFilePath, logicalFilename / pathInZip.string(), fi.crc);
-						crcSet.insert(fi.crc);
-					}
-					catch (const std::exception & ex)
-					{
-						std::cerr << "Error processing file from archive: " << ex.what() << "\n";
-					}
-					std::filesystem::remove_all(tempPath);
+void CDirectoryScanner::process_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc)
+{
+}
+
+void CDirectoryScanner::process_stream(CMemberSource& source, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size)
+{
+	std::filesystem::path p = source.filePath();
+	if (!p.empty()) {
+		process_file(p, logicalFilename, crc);
+		return;
+	}
+
+	// the member exists only as a stream: write it to a temporary file for the path based interface
+	std::unique_ptr<CFileMemberSource> spilled = spillToFile(source, logicalFilename.filename(), size);
+	process_file(spilled->filePath(), logicalFilename, crc);
+}
+
+std::unique_ptr<CFileMemberSource> CDirectoryScanner::spillToFile(CMemberSource& source, const std::filesystem::path& filename, uint64_t size)
+{
+	std::vector<char> buf(0x10000);
+	size_t nread;
+	uint64_t written = 0;
+#ifdef __linux__
+	if (size != 0 && size <= m_memorySpillLimit) {
+		// no directory to create and remove, no disk writes
+		std::shared_ptr<CMemoryFile> memoryFile;
+		try {
+			memoryFile = std::make_shared<CMemoryFile>(filename.string());
+		}
+		catch (const std::system_error& ex)
+		{
+			SCANNER_LOG(levelDebug, logIndent) << "no memory file, spilling to disk: " << ex.what();
+		}
+		if (memoryFile) {
+			while ((nread = source.read(buf.data(), buf.size())) > 0) {
+				memoryFile->write(buf.data(), nread);
+				written += nread;
+			}
+			m_metrics->add(CScanMetrics::counterMemoryBytesWritten, written);
+			return std::make_unique<CFileMemberSource>(memoryFile->path(), memoryFile);
+		}
+	}
+#endif
+	auto tempDir = std::make_shared<CTempDirectory>(generate_unique_path(tempDirectory()));
+	std::filesystem::path tempFilePath = tempDir->path() / filename;
+	{
+		std::ofstream ofs(tempFilePath, std::ios::binary);
+		while ((nread = source.read(buf.data(), buf.size())) > 0) {
+			ofs.write(buf.data(), nread);
+			written += nread;
+		}
+		if (!ofs)
+			throw std::runtime_error("Can't write temporary file " + tempFilePath.string());
+		m_metrics->add(CScanMetrics::counterTempBytesWritten, written);
+	}
+	return std::make_unique<CFileMemberSource>(tempFilePath, tempDir);
+}
+
+std::filesystem::path CDirectoryScanner::tempDirectory() const
+{
+	return m_tempDir.empty() ? std::filesystem::temp_directory_path() : std::filesystem::path(m_tempDir);
+}
+
+void CDirectoryScanner::process_7z(const std::filesystem::path& zipPath, const std::filesystem::path& logicalFilename, EArchiveFormat format)
+{
+	std::vector<CArchiveScheduler::Range> parts = archiveParts(zipPath, format);
+	scanArchive(zipPath, logicalFilename, [&](const CArchiveReader::Select& select, const CArchiveReader::Consume& consume) {
+		if (parts.empty()) {
+			m_archiveReader->stream(zipPath, format, select, consume);
+			return true;
+		}
+		// every worker opens the archive and decompresses the members of its range, skipping the others
+		CArchiveContext context;
+		std::vector<CArchiveScheduler::Task> tasks;
+		for (const CArchiveScheduler::Range& range : parts) {
+			tasks.push_back([&, range]() {
+				CArchiveContext previous;
+				context.apply();
+				auto selectRange = [&](unsigned int index, const CArchiveMember& member) {
+					return index >= range.first && index < range.second && select(index, member);
+				};
+				try {
+					m_archiveReader->stream(zipPath, format, selectRange, consume);
 				}
-				else
+				catch (...)
 				{
-					// file was already scanned
-					logs(logIndent) << "already processed: " << fileInZip << "\n";
+					previous.apply();
+					throw;
 				}
+				previous.apply();
+			});
+		}
+		m_archiveScheduler->runParts(tasks);
+		return true;
+	});
+}
 
+void CDirectoryScanner::scheduleArchive(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, EArchiveFormat format)
+{
+	// the task keeps the directory alive for the pruning rules of the members
+	CPathFilter::DirectoryPtr directory = s_directory ? *s_directory : nullptr;
+	const int indent = logIndent;
+	m_archiveScheduler->submit([this, p, logicalFilename, format, directory, indent]() {
+		CDirectoryScope scope(directory);
+		logIndent = indent;
+		process_7z(p, logicalFilename, format);
+	});
+}
+
+std::vector<CArchiveScheduler::Range> CDirectoryScanner::archiveParts(const std::filesystem::path& zipPath, EArchiveFormat format)
+{
+	// Members of zip and cab archives are compressed one by one and a reader skips the others cheaply.
+	// The limit of decompressed bytes is counted per thread, and the pipeline stages emit from one thread each.
+	if (!m_archiveScheduler || m_archiveScheduler->workers() < 2 || !m_archiveSplitSize || s_archiveDepth != 0
+		|| m_maxExpandedBytes || s_memberSink || m_entryFeed || (format != fmtZip && format != fmtCab))
+		return {};
+	std::error_code ec;
+	const uint64_t fileSize = std::filesystem::file_size(zipPath, ec);
+	const uint64_t count = ec ? 0 : std::min<uint64_t>(m_archiveScheduler->workers(), fileSize / m_archiveSplitSize);
+	if (count < 2)
+		return {};
+
+	std::vector<uint64_t> sizes;
+	try {
+		for (const CArchiveMember& member : m_archiveReader->list(zipPath, format))
+			sizes.push_back(member.isDirectory ? 0 : member.size);
+	}
+	catch (const std::exception& ex)
+	{
+		// reported when the archive is read in one piece
+		SCANNER_LOG(levelDebug, logIndent) << "can't list " << zipPath.filename() << ": " << ex.what();
+		return {};
+	}
+	std::vector<CArchiveScheduler::Range> parts = CArchiveScheduler::partition(sizes, static_cast<unsigned int>(count));
+	if (parts.size() < 2)
+		return {};
+	SCANNER_LOG(levelDebug, logIndent) << "reading " << zipPath.filename() << " in " << parts.size() << " parts";
+	m_metrics->add(CScanMetrics::counterArchiveParts, parts.size());
+	return parts;
+}
+
+bool CDirectoryScanner::scanArchive(const std::filesystem::path& archivePath, const std::filesystem::path& logicalFilename, const ArchiveRead& read)
+{
+	const bool topLevel = s_archiveDepth == 0;
+	if (topLevel)
+		s_expandedBytes = 0;
+	struct CDepthGuard {
+		CDepthGuard() { s_archiveDepth++; }
+		~CDepthGuard() { s_archiveDepth--; }
+	} depthGuard;
+
+	SCANNER_LOG(levelInfo, logIndent) << "searching archive " << logicalFilename.filename();
+	bool handled = true;
+	try {
+		// the parts of an archive read by several workers are selected concurrently
+		std::mutex selectMutex;	// protects the members below
+		std::vector<std::pair<unsigned int, CScanIndexMember>> indexMembers;	// by member index
+		std::set<crc_t> selectedCrcs;
+		std::set<std::pair<uint64_t, crc_t>> selectedMembers;
+		// path of the archive relative to the directory whose pruning rules apply to its members
+		std::filesystem::path archiveRelative;
+		if (m_pathFilter->active())
+			archiveRelative = currentDirectory() ? logicalFilename.lexically_relative(currentDirectory()->path) : logicalFilename.filename();
+
+		// members are selected by their header information before they are decompressed
+		auto select = [&](unsigned int index, const CArchiveMember& member) {
+			SCANNER_LOG(levelDebug, logIndent) << "Entry " << index << ": " << member.name << " " << std::hex << member.crc;
+			m_metrics->add(CScanMetrics::counterMembersListed);
+			if (m_index && topLevel) {
+				std::u8string name = member.name.generic_u8string();
+				std::lock_guard<std::mutex> lock(selectMutex);
+				indexMembers.push_back({ index, { std::string(name.begin(), name.end()), member.size, member.crc } });
+			}
+
+			if (!m_pathFilter->acceptsMember(currentDirectory(), archiveRelative, member.name)) {
+				SCANNER_LOG(levelDebug, logIndent) << "pruned: " << member.name;
+				m_metrics->add(CScanMetrics::counterFilesSkipped);
+				return false;
+			}
+			// archives which aren't named like archives are extracted if their name matches the file specifications
+			EArchiveFormat format;
+			EEngine engine = chooseEngine(member.name.filename(), format);
+			if ((engine == engUnknown && !sniffs(member.name, engine))
+				|| (engine == engFile && !m_predicate->matches(CFilePredicate::memberStat(member)))) {
+				m_metrics->add(CScanMetrics::counterFilesSkipped);
+				return false;
+			}
+			if (m_maxExpandedBytes && s_expandedBytes + member.size > m_maxExpandedBytes) {
+				// the recorded size may be a lie, the bytes are counted again while decompressing
+				throw CArchiveLimitError(member.name.string() + " would exceed " + std::to_string(m_maxExpandedBytes) + " decompressed bytes");
+			}
+
+			bool select = !(m_crcCheck || m_duplicates) || member.crc == 0;
+			std::lock_guard<std::mutex> lock(selectMutex);
+			if (!select && m_duplicates) {
+				// members with the size and crc of an earlier member are skipped without extracting them
+				select = !m_duplicates->hasMember(member.size, member.crc) && selectedMembers.insert({ member.size, member.crc }).second;
 			}
+			else if (!select) {
+				select = !m_crcStore->contains(member.crc) && selectedCrcs.insert(member.crc).second;
+			}
+			if (!select) {
+				// file was already scanned
+				SCANNER_LOG(levelDebug, logIndent) << "already processed: " << member.name.filename();
+				m_metrics->add(CScanMetrics::counterDedupHits);
+			}
+			return select;
+		};
+
+		auto consume = [&](unsigned int, const CArchiveMember& member, CMemberSource& source) {
+			m_metrics->add(CScanMetrics::counterMembersExtracted);
+			try {
+				if (m_maxExpandedBytes == 0) {
+					dispatch_member(source, logicalFilename / member.name, member.crc, member.size);
+				}
+				else {
+					// members extracted by the backend are counted by their size on disk
+					if (!source.filePath().empty()) {
+						s_expandedBytes += std::filesystem::file_size(source.filePath());
+						if (s_expandedBytes > m_maxExpandedBytes)
+							throw CArchiveLimitError("more than " + std::to_string(m_maxExpandedBytes) + " bytes decompressed");
+					}
+					CLimitedMemberSource limited(source, s_expandedBytes, m_maxExpandedBytes);
+					dispatch_member(limited, logicalFilename / member.name, member.crc, member.size);
+				}
+				if (!m_duplicates && member.crc != 0) {
+					m_crcStore->insert(member.crc);
+				}
+			}
+			catch (const CArchiveLimitError&)
+			{
+				throw;
+			}
+			catch (const std::exception & ex)
+			{
+				SCANNER_LOG(levelError, 0) << "Error processing file from archive: " << ex.what();
+			}
+		};
+
+		handled = read(select, consume);
+
+		if (handled && m_index && topLevel) {
+			// only archives on disk are in the index, nested archives are ignored
+			std::sort(indexMembers.begin(), indexMembers.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+			std::vector<CScanIndexMember> members;
+			members.reserve(indexMembers.size());
+			for (auto& indexMember : indexMembers)
+				members.push_back(std::move(indexMember.second));
+			m_index->setMembers(CScanIndex::key(archivePath), std::move(members));
 		}
 	}
+	catch (const CArchiveLimitError& ex)
+	{
+		if (!topLevel)
+			throw;
+		SCANNER_LOG(levelError, 0) << "Error processing archive " << logicalFilename.string() << ": " << ex.what();
+	}
 	catch (const std::exception & ex)
 	{
-		std::cerr << "Error processing archive: " << ex.what() << "\n";
+		SCANNER_LOG(levelError, 0) << "Error processing archive: " << ex.what();
 	}
+	return handled;
 }
 
-inline void CDirectoryScanner::dispatch_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc)
+inline void CDirectoryScanner::dispatch_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc,
+	EEngine engine, EArchiveFormat format)
 {
-	std::string fmtHint;
-	EEngine engine = chooseEngine(logicalFilename, fmtHint);
+	if (engine == engUnknown)
+		engine = chooseEngine(logicalFilename, format);
+	bool changed;
+	engine = identifyFile(p, logicalFilename, engine, format, changed);
+	m_metrics->add(engine == engUnknown ? CScanMetrics::counterFilesSkipped : CScanMetrics::counterFilesMatched);
+	if (!changed)
+		return;
 	logIndent++;
 	switch (engine) {
 	case engFile:
 		if (fileHasNewCrcOrNotChecked(p, crc)) {
-			process_file(p, logicalFilename, crc);
+			deliverFile(p, logicalFilename, crc);
+			fileReader().close();
+		}
+		if (m_index && crc != 0) {
+			m_index->setCrc(CScanIndex::key(p), crc);
 		}
-		break;
 		break;
 	case eng7z:
-		process_7z(p, logicalFilename, fmtHint);
+		// the consumer of entries() is fed by one thread
+		if (m_entryFeed)
+			m_entryFeed->readArchive(p, logicalFilename, format);
+		else if (m_archiveScheduler)
+			scheduleArchive(p, logicalFilename, format);
+		else
+			process_7z(p, logicalFilename, format);
+		break;
+	case engUnknown:
 		break;
 	}
 	logIndent--;
 }
 
-CDirectoryScanner::EEngine CDirectoryScanner::chooseEngine(const std::filesystem::path& p, std::string& fmtHint)
+void CDirectoryScanner::dispatch_member(CMemberSource& source, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size)
 {
+	// the file of the member is released when it has been dispatched
+	CReaderScope readerScope;
+	EArchiveFormat format;
+	EEngine engine = chooseEngine(logicalFilename, format);
 
-	boost::smatch what;
-
-	class CFileFmtInfo
-	{
-	public:
-		CFileFmtInfo(const std::string& pRegex, const std::string& pHint, EEngine pEngine)
-			: regex(pRegex)
-			, hint(pHint)
-			, engine(pEngine)
-		{}
+	// members which aren't backed by a file are sniffed from the bytes read ahead
+	std::unique_ptr<CReadAheadMemberSource> readAhead;
+	if (sniffs(logicalFilename, engine)) {
+		if (!source.filePath().empty()) {
+			engine = sniffFile(source.filePath(), logicalFilename, engine, format, true);
+		}
+		else {
+			readAhead = std::make_unique<CReadAheadMemberSource>(source, CFormatDetector::headSize);
+			engine = detectEngine(logicalFilename, engine, readAhead->head(), readAhead->headSize(), format);
+		}
+	}
+	CMemberSource& data = readAhead ? *readAhead : source;
+	m_metrics->add(engine == engUnknown ? CScanMetrics::counterFilesSkipped : CScanMetrics::counterFilesMatched);
 
-		std::string regex;
-		std::string hint;
-		EEngine engine;
-	};
+	// Crc calculation, duplicate detection, the pipeline and batches need the member as a file.
+	// Backends which decompress into memory don't provide one.
+	std::unique_ptr<CFileMemberSource> spilled;
+	if (data.filePath().empty() && engine == engFile
+		&& (s_memberSink || m_duplicates || (m_crcCheck && crc == 0) || (m_batchSize && !m_entryFeed))) {
+		spilled = spillToFile(data, logicalFilename.filename(), size);
+		if (size == 0)
+			size = std::filesystem::file_size(spilled->filePath());
+	}
+	CMemberSource& member = spilled ? *spilled : data;
 
-	std::list<CFileFmtInfo> fileFmtInfos;
-	fileFmtInfos.push_back(CFileFmtInfo(".*\\.zip", "zip", eng7z));
-	fileFmtInfos.push_back(CFileFmtInfo(".*\\.7z", "7z", eng7z));
-	fileFmtInfos.push_back(CFileFmtInfo(".*\\.tgz", "gz", eng7z));
-	fileFmtInfos.push_back(CFileFmtInfo(".*\\.tar", "tar", eng7z));
-	fileFmtInfos.push_back(CFileFmtInfo(".*\\.gz", "gz", eng7z));
-	fileFmtInfos.push_back(CFileFmtInfo(".*\\.cab", "cab", eng7z));
-	// not working:
-	// fileFmtInfos.push_back(CFileFmtInfo(".*\\.bz2", "bz2", eng7z));
-	// fileFmtInfos.push_back(CFileFmtInfo(".*\\.xz", "xz", eng7z));
-
-	for (CFileFmtInfo& fmti : fileFmtInfos) {
-		const boost::regex filter(fmti.regex, boost::regex_constants::icase);
-		if (boost::regex_match(p.filename().string(), what, filter)) {
-			if (m_nozip) {
-				// we dont process archives, even if nozip is specified.
-				fmtHint = "";
-				return engUnknown;
+	logIndent++;
+	switch (engine) {
+	case engFile:
+		if (m_duplicates ? m_duplicates->addMember(member.filePath(), size, crc) : fileHasNewCrcOrNotChecked(member.filePath(), crc, true)) {
+			if (s_memberSink) {
+				// pipelined scan: the consume stage calls process_stream
+				CScanItem item;
+				item.path = member.filePath();
+				item.logicalFilename = logicalFilename;
+				item.crc = crc;
+				item.size = size;
+				item.engine = engine;
+				item.member = true;
+				item.storage = member.fileOwner();
+				(*s_memberSink)(std::move(item));
 			}
 			else {
-				fmtHint = fmti.hint;
-				return fmti.engine;
+				deliverStream(member, logicalFilename, crc, size);
+				fileReader().close();
 			}
 		}
+		else if (m_duplicates) {
+			m_metrics->add(CScanMetrics::counterDedupHits);
+		}
+		break;
+	case eng7z:
+		if (s_archiveDepth >= m_maxArchiveDepth) {
+			SCANNER_LOG(levelWarning, logIndent) << "not searching archive " << logicalFilename.filename() << ": nested deeper than " << m_maxArchiveDepth;
+		}
+		else if (!member.filePath().empty()) {
+			process_7z(member.filePath(), logicalFilename, format);
+		}
+		else if (!scanArchive({}, logicalFilename, [&](const CArchiveReader::Select& select, const CArchiveReader::Consume& consume) {
+				return m_archiveReader->streamNested(member, size, logicalFilename.filename(), format, select, consume);
+			})) {
+			// the backend can't read this archive from a stream
+			std::unique_ptr<CFileMemberSource> extracted = spillToFile(member, logicalFilename.filename(), size);
+			process_7z(extracted->filePath(), logicalFilename, format);
+		}
+		break;
+	case engUnknown:
+		break;
 	}
+	logIndent--;
+}
 
-	bool included = false;
-	for (size_t i = 0; i < m_filespecs.size(); i++)
-	{
-		const boost::regex file_filter(m_filespecs[i], boost::regex_constants::icase);
-		if (boost::regex_match(p.filename().string(), what, file_filter)) {
-			included = true;
-			break;
+CDirectoryScanner::EEngine CDirectoryScanner::chooseEngine(const std::filesystem::path& p, EArchiveFormat& format)
+{
+	const std::string filename = p.filename().string();
+	format = fmtNone;
+
+	int fmtIndex = m_archiveMatcher->find(filename);
+	if (fmtIndex >= 0) {
+		if (m_nozip) {
+			// we dont process archives, even if nozip is specified.
+			return engUnknown;
 		}
-	}
-	if (included) {
-		for (size_t i = 0; i < m_excludeFilespecs.size(); i++)
-		{
-			const boost::regex file_filter(m_excludeFilespecs[i], boost::regex_constants::icase);
-			if (boost::regex_match(p.filename().string(), what, file_filter)) {
-				included = false;
-				break;
-			}
+		else {
+			format = fileFmtInfos[fmtIndex].format;
+			return eng7z;
 		}
 	}
-	if (included)
+
+	if (m_includeMatcher->matches(filename) && !m_excludeMatcher->matches(filename))
 		return engFile;
 	else 
 		return engUnknown;
 }
 
-bool CDirectoryScanner::fileHasNewCrcOrNotChecked(const std::filesystem::path& p, crc_t& crc)
+CDirectoryScanner::EEngine CDirectoryScanner::detectEngine(const std::filesystem::path& p, EEngine engine, const char* head, size_t size, EArchiveFormat& format)
 {
-	if (m_crcCheck) {
+	EArchiveFormat detected = CFormatDetector::detect(head, size);
+	if (detected != fmtNone) {
+		if (detected != format) {
+			SCANNER_LOG(levelDebug, logIndent) << "archive " << p.filename() << " detected as " << CFormatDetector::name(detected);
+		}
+		format = detected;
+		return eng7z;
+	}
+	if (engine == eng7z) {
+		// named like an archive, but it isn't one
+		format = fmtNone;
+		const std::string filename = p.filename().string();
+		return m_includeMatcher->matches(filename) && !m_excludeMatcher->matches(filename) ? engFile : engUnknown;
+	}
+	return engine;
+}
+
+bool CDirectoryScanner::sniffs(const std::filesystem::path& p, EEngine engine) const
+{
+	if (!sniffFormats())
+		return false;
+	const std::string filename = p.filename().string();
+	switch (engine) {
+	case engFile:
+		// asked for by name: a .docx is a document, even though it is a zip archive
+		return !m_explicitMatcher->matches(filename);
+	case eng7z:
+		return true;
+	case engUnknown:
+		// archives named without an extension are opened whatever the file specifications
+		return !p.filename().has_extension() && !m_excludeMatcher->matches(filename);
+	}
+	return false;
+}
+
+CDirectoryScanner::EEngine CDirectoryScanner::identifyFile(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, EEngine engine, EArchiveFormat& format,
+	bool& changed)
+{
+	bool sniff = sniffs(logicalFilename, engine);
+	if (engine == engUnknown && sniff) {
+		// only an archive would be scanned, and the head has to be read to know
+		engine = sniffFile(p, logicalFilename, engine, format);
+		sniff = false;
+	}
+	// unchanged files are skipped before their data is read
+	changed = engine == engUnknown || checkIndex(p);
+	if (changed && sniff)
+		engine = sniffFile(p, logicalFilename, engine, format);
+	return engine;
+}
+
+CDirectoryScanner::EEngine CDirectoryScanner::sniffFile(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, EEngine engine, EArchiveFormat& format,
+	bool stable)
+{
+	try {
+		CFileReader& reader = readFile(p, stable);
+		const char* head = nullptr;
+		size_t size = reader.head(head, CFormatDetector::headSize);
+		engine = detectEngine(logicalFilename, engine, head, size, format);
+		if (engine == eng7z) {
+			// archives are read by the archive backend
+			reader.close();
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		// keep the engine chosen by name, the error is reported when the file is processed
+		SCANNER_LOG(levelWarning, logIndent) << "can't detect format of " << p.filename() << ": " << ex.what();
+	}
+	return engine;
+}
+
+void CDirectoryScanner::compileFilters()
+{
+	std::vector<std::string> fmtPatterns;
+	for (const CFileFmtInfo& fmti : fileFmtInfos)
+		fmtPatterns.push_back(fmti.regex);
+	m_archiveMatcher->compile(fmtPatterns);
+	m_includeMatcher->compile(m_filespecs);
+	std::vector<std::string> explicitFilespecs;
+	std::copy_if(m_filespecs.begin(), m_filespecs.end(), std::back_inserter(explicitFilespecs), [](const std::string& spec) { return spec != ".*"; });
+	m_explicitMatcher->compile(explicitFilespecs);
+	m_excludeMatcher->compile(m_excludeFilespecs);
+	m_predicate->configure(m_predicateOptions, std::chrono::system_clock::now());
+}
+
+bool CDirectoryScanner::matchesPredicates(CDirHandle& dir, const CDirEntry& entry, const std::filesystem::path& p, EEngine& engine, EArchiveFormat& format)
+{
+	if (!m_predicate->active())
+		return true;
+	engine = chooseEngine(p, format);
+	if (engine != engFile)
+		return engine != engUnknown || sniffs(p, engine);
+	CFileStat st;
+	st.symlink = entry.type == CDirEntry::typeSymlink;
+	if (m_predicate->needsStat()) {
+		CScanMetrics::CScopedTimer timer(*m_metrics, CScanMetrics::timerEnumerate);
+		if (!m_enumerator->stat(dir, entry, st))
+			return false;
+	}
+	return m_predicate->matches(st);
+}
+
+bool CDirectoryScanner::fileHasNewCrcOrNotChecked(const std::filesystem::path& p, crc_t& crc, bool stable)
+{
+	if (m_duplicates) {
+		// the size is known to the reader which sniffs and delivers the file, without another stat
+		if (m_duplicates->addFile(p, readFile(p, stable).size()))
+			return true;
+		m_metrics->add(CScanMetrics::counterDedupHits);
+		return false;
+	}
+	else if (m_crcCheck) {
 		if (crc == 0) {
 			// crc is not known: calculate it
-			crc = calculate_crc32(p.string());
+			crc = calculate_crc32(p, stable);
 		}
 		else {
 			// crc is known (from zip file information):  do nothing
 		}
-		if (crcSet.find(crc) == crcSet.end()) {
-			// crc is new: insert end return true
-			crcSet.insert(crc);
+		if (m_crcStore->insert(crc)) {
+			// crc was new and has been inserted
 			return true;
 		}
 		else {
 			// crc is known
+			m_metrics->add(CScanMetrics::counterDedupHits);
 			return false;
 		}
 
@@ -373,56 +1729,103 @@ bool CDirectoryScanner::fileHasNewCrcOrNotChecked(const std::filesystem::path& p
 	}
 }
 
-CDirectoryScanner::crc_t CDirectoryScanner::calculate_crc32(std::string filename)
+bool CDirectoryScanner::checkIndex(const std::filesystem::path& p)
 {
-	std::ifstream ifs(filename, std::ios::binary);
-	if (!ifs) throw std::runtime_error("Can't calculate crc checksum. File not found: " + filename);
+	if (!m_index)
+		return true;
+
+	CScanIndexEntry current, previous;
+	if (!CScanIndex::stat(p, current))
+		return true;
 
-	logs(logIndent) << "determining crc...";
+	switch (m_index->update(CScanIndex::key(p), current, previous)) {
+	case CScanIndex::stateNew:
+		process_change(p, changeAdded);
+		return true;
+	case CScanIndex::stateModified:
+		process_change(p, changeModified);
+		return true;
+	default:
+		break;
+	}
+
+	SCANNER_LOG(levelDebug, logIndent) << "unchanged: " << p.filename();
+	if (m_duplicates) {
+		// contents delivered by earlier scans still count as already processed
+		if (!previous.isArchive)
+			m_duplicates->addFile(p, previous.size);
+		for (const CScanIndexMember& member : previous.members) {
+			m_duplicates->addMember({}, member.size, member.crc);
+		}
+	}
+	else if (m_crcCheck) {
+		// contents delivered by earlier scans still count as already processed
+		if (!previous.isArchive && previous.crc != 0)
+			m_crcStore->insert(previous.crc);
+		for (const CScanIndexMember& member : previous.members) {
+			if (member.crc != 0)
+				m_crcStore->insert(member.crc);
+		}
+	}
+	return false;
+}
+
+CDirectoryScanner::crc_t CDirectoryScanner::calculate_crc32(const std::filesystem::path& p, bool stable)
+{
+	CScanMetrics::CScopedTimer timer(*m_metrics, CScanMetrics::timerCrc32);
+	CFileReader& reader = readFile(p, stable);
 
-	boost::crc_32_type crc;
-	const int bufSize = 0xffff;
-	char* buf = new char[bufSize];
-	while (ifs) {
-		ifs.read(buf, bufSize);
-		std::streamsize nread = ifs.gcount();
-		crc.process_bytes(buf, nread);
+	CCrc32 crc;
+	const char* data;
+	size_t size;
+	uint64_t hashed = 0;
+	while (reader.next(data, size)) {
+		crc.process_bytes(data, size);
+		hashed += size;
 	}
-	delete[] buf;
-	logs() << std::hex << crc.checksum() << std::dec << "\n";
+	m_metrics->add(CScanMetrics::counterBytesHashed, hashed);
+	reader.rewind();
+	SCANNER_LOG(levelDebug, logIndent) << "crc of " << p.filename() << ": " << std::hex << crc.checksum();
 	return crc.checksum();
 }
 
-inline std::filesystem::path CDirectoryScanner::generate_unique_path(const std::filesystem::path& base_dir) 
+CFileReader& CDirectoryScanner::fileReader()
 {
-	// Use the current time as a seed for random number generation
-	auto now = std::chrono::system_clock::now();
-	auto seed = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
-
-	std::mt19937 generator(static_cast<unsigned int>(seed));
-	std::uniform_int_distribution<int> distribution(0, 15);
-	auto random_char = []() -> char {
-		static const char characters[] = "0123456789abcdef";
-		static std::mt19937 generator(std::random_device{}());
-		static std::uniform_int_distribution<int> distribution(0, 15);
-		return characters[distribution(generator)];
-		};
+	static thread_local CFileReader reader;
+	return reader;
+}
 
-	// Generate a unique filename by checking if the file already exists
-	std::filesystem::path unique_path;
-	do {
-		std::string random_filename(16, '\0');
-		for (char& c : random_filename) {
-			c = random_char();
-		}
-		unique_path = base_dir / random_filename;
-	} while (std::filesystem::exists(unique_path));
+CDirectoryScanner::CReaderScope::~CReaderScope()
+{
+	fileReader().close();
+}
 
-	return unique_path;
+CFileReader& CDirectoryScanner::readFile(const std::filesystem::path& p, bool stable)
+{
+	CFileReader& reader = fileReader();
+	if (reader.holds(p)) {
+		reader.rewind();
+	}
+	else {
+		reader.open(p, stable);
+	}
+	return reader;
+}
+
+inline std::filesystem::path CDirectoryScanner::generate_unique_path(const std::filesystem::path& base_dir) 
+{
+	return CTempDirectory::uniquePath(base_dir);
+}
+
+CLogLine CDirectoryScanner::log(ELogLevel level, int indent)
+{
+	if (level == levelError)
+		m_metrics->add(CScanMetrics::counterErrors);
+	return CLogLine(*m_logger, level, indent);
 }
 
-std::ostream& CDirectoryScanner::logs(int indent)
+void CDirectoryScanner::setLogger(std::shared_ptr<CLogger> logger)
 {
-	return std::cout;
+	m_logger = logger ? logger : CLogger::console();
 }
 
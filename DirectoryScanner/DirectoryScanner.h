@@ -23,13 +23,39 @@
 #pragma once
 
 
+#include <cstdint>
+#include <functional>
 #include <ostream>
 #include <set>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
-namespace SevenZip {
-	class SevenZipLibrary;
-}
+#include "ScanPipeline.h"
+#include "ArchiveReader.h"
+#include "Logger.h"
+#include "ScanIterator.h"
+#include "ScanBatch.h"
+#include "PathFilter.h"
+#include "FilePredicate.h"
+#include "ArchiveScheduler.h"
+
+class CMemberSource;
+class CFileMemberSource;
+class CFileNameMatcher;
+class CWorkStealingPool;
+class CTempStorage;
+class CDirEnumerator;
+class CDirHandle;
+struct CDirEntry;
+class CFileReader;
+class CScanIndex;
+class CDuplicateDetector;
+class CDedupStore;
+class CScanMetrics;
+class CInodeSet;
 
 namespace boost {
 	namespace program_options {
@@ -37,6 +63,26 @@ namespace boost {
 	}
 }
 
+//! Log a line through the scanner: SCANNER_LOG(levelDebug, logIndent) << "crc " << crc;
+//! The message is not evaluated if the level is disabled at compile time or at runtime.
+//! The macro ends in its own else, so it can't capture an else of the caller; still brace it
+//! as the body of an if, compilers warn about the ambiguous looking else otherwise.
+#define SCANNER_LOG(level, indent) SCANNER_LOG_TO(*this, level, indent)
+//! SCANNER_LOG through the given scanner, for the helpers of the scanner
+#define SCANNER_LOG_TO(scanner, level, indent) if (!(scanner).logEnabled(level)) {} else (scanner).log((level), (indent))
+
+//! Scans directories and archives recursively and passes the files found to process_file / process_stream.
+//!
+//! Thread safety: with --threads > 1 the directories are scanned by a pool of worker threads.
+//! process_file, process_stream, process_7z and process_change are then called concurrently from the
+//! workers, and overrides must synchronize access to their own state. The state of the
+//! scanner itself (crc set) is synchronized. All calls of one scanPath are complete when
+//! it returns.
+//! With --pipeline enumeration, filtering, hashing, extraction and process_file / process_stream
+//! run in separate stages with their own threads, connected by bounded queues. The callbacks are then
+//! called concurrently as well, and files are no longer delivered in directory order.
+//! With --archive-workers archives are read by a pool of archive workers, which call the callbacks
+//! for the members concurrently, even if the directories are scanned by a single thread.
 class CDirectoryScanner
 {
 public:
@@ -54,11 +100,79 @@ public:
 	typedef unsigned int crc_t;
 
 	virtual void scanPath(const std::filesystem::path& rootPath);
+	//! Scan several roots like one scan: the archive backend, the index and the metrics are loaded once.
+	//! Roots which are inside another root or given twice are skipped. The roots are grouped by their
+	//! storage device and the devices are scanned at the same time, each by threads of its own: a spinning
+	//! disk by a single thread, other devices by --threads threads. The callbacks are called concurrently
+	//! if the roots are on several devices. With --pipeline the roots are scanned one after the other.
+	//! Errors of a root are logged and the other roots are scanned.
+	virtual void scanPaths(const std::vector<std::filesystem::path>& roots);
+	//! Scan rootPath lazily: the files found are produced one by one in the order of a sequential scan,
+	//! instead of being passed to process_file / process_stream:
+	//!   for (const CScanEntry& entry : scanner.entries(root)) ...
+	//! The scan advances only when the next entry is requested and stops when the range is destroyed.
+	//! The index is only updated if the scan has been completed. --threads and --pipeline are ignored.
+	//! Only one range may exist per scanner, and scanPath must not be called while it does.
+	CScanRange entries(const std::filesystem::path& rootPath);
 	virtual void process_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc);
-	virtual void process_7z(const std::filesystem::path& zipPath, const std::filesystem::path& logicalFilename, const std::string& fmtHint);
+	//! called for every accepted file inside an archive. The data is read from source.
+	//! The default implementation passes the member on to process_file, spilling it to a
+	//! temporary file first if the source is not backed by a file.
+	virtual void process_stream(CMemberSource& source, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size);
+	//! called for archives on disk. Nested archives are read from the stream of the outer archive
+	//! if the archive backend supports it, and are passed to process_7z as extracted files otherwise.
+	virtual void process_7z(const std::filesystem::path& zipPath, const std::filesystem::path& logicalFilename, EArchiveFormat format);
+	//! With --batch-size: called instead of process_file / process_stream with up to batch size files at once.
+	//! Archive members are passed as extracted files. A batch is passed on when it is full, when a file is
+	//! added after the flush interval has passed and at the end of scanPath, also if the scan fails. Like
+	//! process_file it is called concurrently with --threads and --pipeline. The default implementation
+	//! calls process_file for every entry.
+	virtual void process_batch(std::span<const CBatchEntry> entries);
+
+	enum EChange
+	{
+		changeAdded,
+		changeModified,
+		changeRemoved
+	};
+	//! With --index: called for every file which was added, modified or removed since the last scan
+	//! of the same index, before the file is processed. Unchanged files and archives are skipped.
+	virtual void process_change(const std::filesystem::path& p, EChange change);
+
+	//! counters of the stages of the running or of the last pipelined scan
+	std::vector<CPipelineStageStats> pipelineStats() const;
+
+	//! Logger receiving the output of the scanner. Default is CLogger::console(), nullptr restores it.
+	void setLogger(std::shared_ptr<CLogger> logger);
+
+	//! Counters and timings of the running or of the last scan. May be read while the scan is running.
+	const CScanMetrics& metrics() const { return *m_metrics; }
+
+	//! duplicate detection of --dedup, nullptr without --dedup
+	const CDuplicateDetector* duplicateDetector() const { return m_duplicates.get(); }
 
 protected:
-	void scanPathRec(const std::filesystem::path& rootPath, int indent);
+	//! Reader of the calling thread, opened on p. If the crc of p has just been calculated on
+	//! this thread the data of a file which fits into the reader's buffer is still held by the
+	//! reader and is not read from disk again. The reader is closed when process_file /
+	//! process_stream returns. stable is passed on to CFileReader::open: the files of members
+	//! are extracted by the scanner and its backends, nobody else truncates them.
+	CFileReader& readFile(const std::filesystem::path& p, bool stable = false);
+	static CFileReader& fileReader();
+
+	//! load the scan state: filters, enumerator, archive reader, index
+	void beginScan();
+	//! the directory enumeration backend of a scan, the one chosen by --enumerator
+	virtual std::unique_ptr<CDirEnumerator> createEnumerator();
+	//! update and save the index, write the metrics
+	void endScan(const std::vector<std::filesystem::path>& roots);
+	//! end a scan which has thrown: wait for the calls still running and pass on the pending batch.
+	//! The index is not saved.
+	void abortScan();
+	//! scan one root with the given number of directory scanning threads, or pipelined
+	void scanRoot(const std::filesystem::path& rootPath, unsigned int threads);
+	//! roots without the ones inside another root and duplicates, in the order given
+	std::vector<std::filesystem::path> uniqueRoots(const std::vector<std::filesystem::path>& roots);
 
 	enum EEngine
 	{
@@ -67,24 +181,241 @@ protected:
 		eng7z
 	};
 
-	void dispatch_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc);
-	EEngine chooseEngine(const std::filesystem::path& p, std::string& fmtHint);
-	bool fileHasNewCrcOrNotChecked(const std::filesystem::path& p, crc_t& knownCrc);
-	crc_t calculate_crc32(std::string filename);
+	//! scan rootPath on the calling thread
+	void scanSequential(const std::filesystem::path& rootPath);
+	//! The engine and format passed to onFile have been chosen by matchesPredicates, engine is engUnknown if not yet.
+	typedef std::function<void(const std::filesystem::path&, const CPathFilter::DirectoryPtr&, EEngine, EArchiveFormat)> OnFile;
+	//! Depth-first walk of the tree below rootPath passing every file accepted by the pruning rules to onFile,
+	//! in directory order, with s_directory set. The open directories are kept on an explicit stack, so the
+	//! walk can be advanced file by file. Errors in a subdirectory are logged and the rest of the subdirectory
+	//! is skipped, errors in rootPath are thrown.
+	class CTreeWalk
+	{
+	public:
+		CTreeWalk(CDirectoryScanner& scanner, const std::filesystem::path& rootPath);
+		~CTreeWalk();
+
+		//! walk on to the next accepted file and pass it to onFile. Returns false at the end of the tree.
+		bool next(const OnFile& onFile);
+
+	private:
+		struct CLevel;
+
+		CDirectoryScanner& m_scanner;
+		std::vector<CLevel> m_stack;	//!< the open directories, innermost last
+	};
+	//! walk the whole tree below rootPath
+	void walkTree(const std::filesystem::path& rootPath, const OnFile& onFile);
+	//! scan the files of one directory and queue its subdirectories as new tasks
+	void scanDirectoryTask(CWorkStealingPool& pool, const CPathFilter::DirectoryPtr& directory, int indent);
+	//! the subdirectory name of parent, nullptr if it is pruned
+	CPathFilter::DirectoryPtr enterDirectory(const CPathFilter::DirectoryPtr& parent, const std::string& name, int indent);
+	//! subdirectories are entered if they are directories or, with --follow-symlinks, symlinks to directories
+	bool isSubdirectory(const CDirEntry& entry) const;
+	//! Check the identity of the opened directory dir. Returns false if it is to be skipped because it is
+	//! on another file system than the root of directory with --xdev, or has been scanned before through
+	//! a bind mount or a symlink.
+	bool checkDirectoryIdentity(const CDirHandle& dir, const CPathFilter::CDirectory& directory, int indent);
+	//! false if the file has the identity of a file scanned before with --inode-dedup, e.g. a hardlink
+	bool checkFileIdentity(const CDirEntry& entry, const std::filesystem::path& p);
+
+	//! file travelling through the stages of a pipelined scan
+	struct CScanItem
+	{
+		std::filesystem::path path;	//!< file on disk
+		std::filesystem::path logicalFilename;
+		crc_t crc = 0;
+		uint64_t size = 0;
+		EEngine engine = engUnknown;
+		EArchiveFormat format = fmtNone;
+		bool member = false;	//!< extracted archive member, consumed through process_stream
+		std::shared_ptr<CTempStorage> storage;	//!< keeps an extracted member alive until it is consumed
+		CPathFilter::DirectoryPtr directory;	//!< directory holding the file on disk, for the pruning rules of archive members
+	};
+	typedef CPipeline<CScanItem> ScanPipeline;
+
+	void scanPathPipelined(const std::filesystem::path& rootPath);
+	//! m_enumerator->open and next, counted and timed in the metrics
+	std::unique_ptr<CDirHandle> openDirectory(const std::filesystem::path& dirPath, const CDirHandle* parent);
+	bool nextEntry(CDirHandle& dir, CDirEntry& entry);
+
+	//! engine and format are the ones chosen by chooseEngine, engUnknown if the engine hasn't been chosen yet
+	void dispatch_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc,
+		EEngine engine = engUnknown, EArchiveFormat format = fmtNone);
+	void dispatch_member(CMemberSource& source, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size);
+	//! pass an accepted file on to process_file / process_stream or to the consumer of entries()
+	void deliverFile(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc);
+	void deliverStream(CMemberSource& source, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size);
+	//! add a file to the current batch and pass the batch on if it is due
+	void addToBatch(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size,
+		std::shared_ptr<CTempStorage> owner);
+	//! pass the current batch on to process_batch, if it isn't empty
+	void flushBatch();
+	void passBatch(std::unique_ptr<CScanBatch> batch);
+	//! Select and dispatch the members of an archive opened by read, enforcing the nesting limits.
+	//! archivePath is the file of an archive on disk, empty for nested archives. Returns false if read
+	//! returned false because the backend can't read the archive, errors are reported here.
+	typedef std::function<bool(const CArchiveReader::Select& select, const CArchiveReader::Consume& consume)> ArchiveRead;
+	bool scanArchive(const std::filesystem::path& archivePath, const std::filesystem::path& logicalFilename, const ArchiveRead& read);
+	//! queue an archive on disk for the archive workers
+	void scheduleArchive(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, EArchiveFormat format);
+	//! Ranges of member indices of an archive on disk to be read by separate archive workers, empty if the
+	//! archive is read in one piece: it is small, nested, or its members aren't compressed independently.
+	std::vector<CArchiveScheduler::Range> archiveParts(const std::filesystem::path& zipPath, EArchiveFormat format);
+	//! engine by the name of p. Archives are recognized by their extension.
+	EEngine chooseEngine(const std::filesystem::path& p, EArchiveFormat& format);
+	//! Evaluate the metadata predicates on the file p, the entry of dir last returned by the enumerator,
+	//! with the stat data of the enumerator. Archives pass, the predicates apply to their members.
+	//! If predicates are given the engine is chosen here and returned in engine and format for the dispatch,
+	//! files without an engine don't match unless they are sniffed. Otherwise engine is left engUnknown.
+	bool matchesPredicates(CDirHandle& dir, const CDirEntry& entry, const std::filesystem::path& p, EEngine& engine, EArchiveFormat& format);
+	//! Correct the engine chosen by name with the format detected from the first bytes of the data:
+	//! archives are opened whatever their name, files named like archives which aren't are treated as files.
+	EEngine detectEngine(const std::filesystem::path& p, EEngine engine, const char* head, size_t size, EArchiveFormat& format);
+	//! detectEngine for a file on disk. Reads the head through the reader of the calling thread,
+	//! so a following crc calculation doesn't read it again.
+	EEngine sniffFile(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, EEngine engine, EArchiveFormat& format,
+		bool stable = false);
+	//! archive formats are detected from the contents of the files
+	bool sniffFormats() const { return !m_trustExtension && !m_nozip; }
+	//! Whether the format of p, for which its name selected engine, is to be detected from its contents.
+	//! Files selected by a file specification other than ".*" are delivered as files even if they are
+	//! containers like .docx. Files whose name selects nothing are sniffed if they have no extension.
+	bool sniffs(const std::filesystem::path& p, EEngine engine) const;
+	//! Check the file p against the index and sniff its format if sniffs() says so. Only changed files
+	//! are sniffed, except those whose name selects nothing: whether they are archives is needed first.
+	//! changed is false for files which are unchanged since the last scan.
+	EEngine identifyFile(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, EEngine engine, EArchiveFormat& format,
+		bool& changed);
+	//! compile the file specifications into the matchers used by chooseEngine and parse the predicates
+	void compileFilters();
+	bool fileHasNewCrcOrNotChecked(const std::filesystem::path& p, crc_t& knownCrc, bool stable = false);
+	//! look p up in the scan index. Returns false if p is unchanged since the last scan and is to be skipped.
+	//! Only the stat data is compared, whether p is an archive is taken from the index.
+	bool checkIndex(const std::filesystem::path& p);
+	crc_t calculate_crc32(const std::filesystem::path& p, bool stable = false);
+	//! Write the rest of source to a temporary file which lives as long as the returned source. Members of
+	//! a known size up to --memory-spill-limit are written to a memory file, the others to --temp-dir.
+	std::unique_ptr<CFileMemberSource> spillToFile(CMemberSource& source, const std::filesystem::path& filename, uint64_t size);
+	//! --temp-dir or the temporary directory of the system
+	std::filesystem::path tempDirectory() const;
 	std::filesystem::path generate_unique_path(const std::filesystem::path& base_dir = std::filesystem::temp_directory_path());
-	virtual std::ostream& logs(int indent = 0);
+	//! line of log output, use SCANNER_LOG to skip disabled levels
+	CLogLine log(ELogLevel level, int indent = 0);
+	//! --quiet logs errors only, --verbose everything
+	bool logEnabled(ELogLevel level) const
+	{
+		return level <= DIRECTORYSCANNER_MAX_LOG_LEVEL && level <= (m_quiet ? levelError : m_verbose ? levelDebug : levelInfo);
+	}
+
+	static thread_local int logIndent;
+	//! set on the extract workers of a pipelined scan: archive members are passed on to the consume stage
+	static thread_local const ScanPipeline::Emit* s_memberSink;
+	//! number of archives being scanned on this thread, the archive on disk and the ones nested in it
+	static thread_local unsigned int s_archiveDepth;
+	//! bytes decompressed from the archive on disk being scanned on this thread, including nested archives
+	static thread_local uint64_t s_expandedBytes;
+	//! directory of the file on disk being dispatched on this thread, nullptr for a file passed as root
+	static thread_local const CPathFilter::DirectoryPtr* s_directory;
+	static const CPathFilter::CDirectory* currentDirectory() { return s_directory ? s_directory->get() : nullptr; }
+
+	//! sets s_directory for its lifetime
+	class CDirectoryScope
+	{
+	public:
+		explicit CDirectoryScope(const CPathFilter::DirectoryPtr& dir) : m_previous(s_directory) { s_directory = &dir; }
+		~CDirectoryScope() { s_directory = m_previous; }
+	private:
+		const CPathFilter::DirectoryPtr* m_previous;
+	};
 
-	int logIndent;
-	std::set<crc_t> crcSet;
+	//! closes the reader of the calling thread at the end of its lifetime, also if an exception is thrown.
+	//! Members are passed as names like /proc/self/fd/N which name another file once they are released.
+	class CReaderScope
+	{
+	public:
+		~CReaderScope();
+	};
+
+	//! the thread-local state of the archive being scanned on the calling thread, for the workers reading its parts
+	struct CArchiveContext
+	{
+		int indent = logIndent;
+		unsigned int depth = s_archiveDepth;
+		const CPathFilter::DirectoryPtr* directory = s_directory;
+
+		//! set the state on the calling thread
+		void apply() const
+		{
+			logIndent = indent;
+			s_archiveDepth = depth;
+			s_directory = directory;
+		}
+	};
 
 	bool m_nozip;
 	bool m_crcCheck;
+	bool m_dedup;	//!< detect duplicates by size and contents instead of crc
+	bool m_trustExtension;	//!< recognize archives by their names only, don't read the files
 	bool m_verbose;
 	bool m_quiet;
+	unsigned int m_threads;	//!< number of directory scanning threads, 1: scan on the calling thread
+	bool m_pipeline;	//!< scan with separate stages connected by bounded queues
+	unsigned int m_filterWorkers;
+	unsigned int m_hashWorkers;
+	unsigned int m_extractWorkers;
+	unsigned int m_consumeWorkers;
+	size_t m_queueSize;	//!< capacity of each queue between pipeline stages
+	std::string m_enumeratorName;	//!< directory enumeration backend, see CDirEnumerator::create
+	std::string m_indexPath;	//!< scan index file, empty: no index
+	std::string m_archiveBackend;	//!< archive reader backend, see CArchiveReader::create
+	unsigned int m_maxArchiveDepth;	//!< archives nested deeper are not opened, 1: archives on disk only
+	uint64_t m_maxExpandedBytes;	//!< limit of the bytes decompressed from one archive on disk, 0: no limit
+	std::string m_metricsPath;	//!< JSON file receiving the metrics at the end of scanPath, empty: none
+	size_t m_batchSize;	//!< files per process_batch call, 0: files are passed to process_file one by one
+	unsigned int m_batchInterval;	//!< milliseconds after which a batch is passed on even if it isn't full
+	bool m_xdev;	//!< don't enter directories on other file systems than the root
+	bool m_followSymlinks;	//!< enter symlinks to directories
+	bool m_inodeDedup;	//!< skip files and directories whose identity has been seen before
+	std::string m_tempDir;	//!< directory of the temporary files of extracted members, empty: system default
+	uint64_t m_memorySpillLimit;	//!< members up to this size are spilled to memory files, 0: never
+	unsigned int m_archiveWorkers;	//!< threads decompressing archives, 0: archives are read by the thread finding them
+	uint64_t m_archiveSplitSize;	//!< bytes of an archive file per part read by a separate worker, 0: no parts
+	std::unique_ptr<CInodeSet> m_inodes;	//!< identities seen during the scan
 
 	std::vector<std::string> m_filespecs;
 	std::vector<std::string> m_excludeFilespecs;
+	std::vector<std::string> m_includeDirs;	//!< directory name patterns, see CPathFilter
+	std::vector<std::string> m_excludeDirs;
+	unsigned int m_maxDepth;	//!< directory levels entered below the root
+	std::vector<std::string> m_ignoreFiles;	//!< names of .gitignore-style files read in every directory
+	std::unique_ptr<CPathFilter> m_pathFilter;
+	std::unique_ptr<CFileNameMatcher> m_archiveMatcher;	//!< one pattern per entry of the archive format table
+	std::unique_ptr<CFileNameMatcher> m_includeMatcher;
+	std::unique_ptr<CFileNameMatcher> m_explicitMatcher;	//!< the file specifications except the catch-all ".*"
+	std::unique_ptr<CFileNameMatcher> m_excludeMatcher;
+	CFilePredicate::COptions m_predicateOptions;
+	std::unique_ptr<CFilePredicate> m_predicate;	//!< ages are relative to the start of the scan
+	std::unique_ptr<CDedupStore> m_crcStore;	//!< crcs of the files processed with --checkcrc
+	std::shared_ptr<CLogger> m_logger;
+	std::unique_ptr<CScanMetrics> m_metrics;
+	class CEntryFeed;
+	CEntryFeed* m_entryFeed;	//!< set while a range returned by entries() exists
+
+	std::mutex m_batchMutex;	//!< protects the members below
+	std::unique_ptr<CScanBatch> m_batch;	//!< batch being filled
+	std::vector<std::unique_ptr<CScanBatch>> m_spareBatches;	//!< passed on batches, kept for their buffers
 	std::string m_7zDllPath;	//!< path to 7z.dll
-	std::unique_ptr<SevenZip::SevenZipLibrary> m_7zlib;
+	std::unique_ptr<CArchiveReader> m_archiveReader;	//!< created by scanPath unless m_nozip
+	std::unique_ptr<CDirEnumerator> m_enumerator;
+	std::unique_ptr<CDuplicateDetector> m_duplicates;	//!< created by the first scanPath with m_dedup
+	std::unique_ptr<CScanIndex> m_index;	//!< loaded from m_indexPath for the duration of scanPath
+
+	mutable std::mutex m_pipelineMutex;	//!< protects the members below
+	std::shared_ptr<ScanPipeline> m_activePipeline;
+	std::vector<CPipelineStageStats> m_pipelineStats;
+
+	//! created by scanPath with m_archiveWorkers. Declared last: its workers use the members above.
+	std::unique_ptr<CArchiveScheduler> m_archiveScheduler;
 };
 
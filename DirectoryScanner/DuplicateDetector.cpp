@@ -0,0 +1,395 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "DuplicateDetector.h"
+#include "Crc32.h"
+#include "FileReader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	//! MurmurHash3 x64 128 bit, fed incrementally
+	class CHash128
+	{
+	public:
+		CHash128()
+			: m_h1(0), m_h2(0), m_length(0), m_pending(0)
+		{}
+
+		void process_bytes(const void* data, size_t size)
+		{
+			const unsigned char* p = static_cast<const unsigned char*>(data);
+			m_length += size;
+			if (m_pending > 0) {
+				size_t n = std::min(size, sizeof(m_block) - m_pending);
+				memcpy(m_block + m_pending, p, n);
+				m_pending += n;
+				p += n;
+				size -= n;
+				if (m_pending < sizeof(m_block))
+					return;
+				processBlock(m_block);
+				m_pending = 0;
+			}
+			for (; size >= sizeof(m_block); p += sizeof(m_block), size -= sizeof(m_block))
+				processBlock(p);
+			memcpy(m_block, p, size);
+			m_pending = size;
+		}
+
+		std::pair<uint64_t, uint64_t> checksum() const
+		{
+			uint64_t h1 = m_h1, h2 = m_h2;
+			uint64_t k1 = 0, k2 = 0;
+			for (size_t i = m_pending; i > 8; i--)
+				k2 |= uint64_t(m_block[i - 1]) << (8 * (i - 9));
+			for (size_t i = std::min<size_t>(m_pending, 8); i > 0; i--)
+				k1 |= uint64_t(m_block[i - 1]) << (8 * (i - 1));
+			if (m_pending > 8) {
+				k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+			}
+			if (m_pending > 0) {
+				k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+			}
+
+			h1 ^= m_length;
+			h2 ^= m_length;
+			h1 += h2;
+			h2 += h1;
+			h1 = fmix(h1);
+			h2 = fmix(h2);
+			h1 += h2;
+			h2 += h1;
+			return { h1, h2 };
+		}
+
+	private:
+		static const uint64_t c1 = 0x87c37b91114253d5ULL;
+		static const uint64_t c2 = 0x4cf5c819b2d2a435ULL;
+
+		static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+		static uint64_t fmix(uint64_t k)
+		{
+			k ^= k >> 33;
+			k *= 0xff51afd7ed558ccdULL;
+			k ^= k >> 33;
+			k *= 0xc4ceb9fe1a85ec53ULL;
+			k ^= k >> 33;
+			return k;
+		}
+
+		static uint64_t load64(const unsigned char* p)
+		{
+			uint64_t v = 0;
+			for (int i = 7; i >= 0; i--)
+				v = (v << 8) | p[i];
+			return v;
+		}
+
+		void processBlock(const unsigned char* p)
+		{
+			uint64_t k1 = load64(p);
+			uint64_t k2 = load64(p + 8);
+			k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; m_h1 ^= k1;
+			m_h1 = rotl(m_h1, 27); m_h1 += m_h2; m_h1 = m_h1 * 5 + 0x52dce729;
+			k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; m_h2 ^= k2;
+			m_h2 = rotl(m_h2, 31); m_h2 += m_h1; m_h2 = m_h2 * 5 + 0x38495ab5;
+		}
+
+		uint64_t m_h1;
+		uint64_t m_h2;
+		uint64_t m_length;
+		unsigned char m_block[16];
+		size_t m_pending;
+	};
+
+	CFileReader& threadReader()
+	{
+		static thread_local CFileReader reader;
+		return reader;
+	}
+}
+
+struct CDuplicateDetector::CCandidate
+{
+	std::mutex mutex;	//!< protects the members below, which are calculated on demand
+	std::filesystem::path path;	//!< empty if the contents can't be read (anymore)
+	bool stable = false;	//!< path is a member extracted by the caller, which may be mapped
+	uint64_t size = 0;
+	bool hasCrc = false;
+	uint32_t crc = 0;
+	bool hasSample = false;
+	uint64_t sample = 0;
+	bool hasFullHash = false;
+	std::pair<uint64_t, uint64_t> fullHash;
+};
+
+CDuplicateDetector::CDuplicateDetector(size_t sampleSize)
+	: m_sampleSize(sampleSize)
+	, m_files(0)
+	, m_duplicates(0)
+	, m_sampleHashes(0)
+	, m_fullHashes(0)
+	, m_crcHashes(0)
+{
+}
+
+CDuplicateDetector::~CDuplicateDetector()
+{
+}
+
+bool CDuplicateDetector::addFile(const std::filesystem::path& p, uint64_t size)
+{
+	auto candidate = std::make_shared<CCandidate>();
+	candidate->path = p;
+	candidate->size = size;
+	return add(candidate);
+}
+
+bool CDuplicateDetector::addMember(const std::filesystem::path& p, uint64_t size, uint32_t crc)
+{
+	auto candidate = std::make_shared<CCandidate>();
+	candidate->path = p;
+	candidate->stable = true;
+	candidate->size = size;
+	candidate->hasCrc = crc != 0;
+	candidate->crc = crc;
+	bool isNew = add(candidate);
+
+	// The extracted file is deleted after the member has been processed. Without a crc from the header
+	// later members and files could not be compared with it: fingerprint the data while it is there.
+	if (isNew && crc == 0)
+		ensureFullHash(*candidate);
+	std::lock_guard<std::mutex> lock(candidate->mutex);
+	candidate->path.clear();
+	return isNew;
+}
+
+bool CDuplicateDetector::hasMember(uint64_t size, uint32_t crc) const
+{
+	if (crc == 0)
+		return false;
+
+	std::vector<std::shared_ptr<CCandidate>> bucket;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_buckets.find(size);
+		if (it == m_buckets.end())
+			return false;
+		bucket = it->second;
+	}
+	for (const auto& candidate : bucket)
+	{
+		std::lock_guard<std::mutex> lock(candidate->mutex);
+		if (candidate->hasCrc && candidate->crc == crc)
+			return true;
+	}
+	return false;
+}
+
+bool CDuplicateDetector::add(const std::shared_ptr<CCandidate>& candidate)
+{
+	m_files++;
+
+	// register the candidate before comparing, so concurrent copies of the same contents
+	// see each other: at least one of them compares against the other
+	std::vector<std::shared_ptr<CCandidate>> earlier;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto& bucket = m_buckets[candidate->size];
+		earlier = bucket;
+		bucket.push_back(candidate);
+	}
+
+	for (const auto& other : earlier)
+	{
+		if (sameContents(*candidate, *other)) {
+			// duplicates are not needed for later comparisons
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto& bucket = m_buckets[candidate->size];
+			bucket.erase(std::find(bucket.begin(), bucket.end(), candidate));
+			m_duplicates++;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool CDuplicateDetector::sameContents(CCandidate& a, CCandidate& b)
+{
+	if (a.size == 0)
+		return true;
+
+	{
+		std::scoped_lock lock(a.mutex, b.mutex);
+		if (a.hasCrc && b.hasCrc && a.crc != b.crc)
+			return false;
+		if (a.hasFullHash && b.hasFullHash)
+			return a.fullHash == b.fullHash;
+		if (a.hasSample && b.hasSample && a.sample != b.sample)
+			return false;
+	}
+
+	// small files are hashed completely right away, their sample would cover most of the file anyway
+	if (a.size > 2 * m_sampleSize) {
+		bool sampled = ensureSample(b) && ensureSample(a);
+		if (sampled && a.sample != b.sample)
+			return false;
+	}
+	if (ensureFullHash(b) && ensureFullHash(a))
+		return a.fullHash == b.fullHash;
+
+	// the data of a member is gone: size and crc is all that can be compared
+	return ensureCrc(b) && ensureCrc(a) && a.crc == b.crc;
+}
+
+bool CDuplicateDetector::ensureSample(CCandidate& c)
+{
+	std::lock_guard<std::mutex> lock(c.mutex);
+	if (c.hasSample)
+		return true;
+	if (c.path.empty())
+		return false;
+
+	CFileReader& reader = threadReader();
+	try {
+		reader.open(c.path, c.stable);
+	}
+	catch (const std::exception&)
+	{
+		// the file has disappeared: it can't be compared by contents any more
+		c.path.clear();
+		return false;
+	}
+	// the first and the last bytes, hashed as one block
+	CHash128 hash;
+	bool complete = true;
+	try {
+		const uint64_t offsets[] = { 0, c.size - m_sampleSize };
+		for (uint64_t offset : offsets) {
+			const char* data;
+			const size_t size = reader.read(offset, data, m_sampleSize);
+			hash.process_bytes(data, size);
+			complete = complete && size == m_sampleSize;
+		}
+	}
+	catch (const std::exception&)
+	{
+		complete = false;
+	}
+	reader.close();
+	if (!complete)
+		return false;
+
+	c.sample = hash.checksum().first;
+	c.hasSample = true;
+	m_sampleHashes++;
+	return true;
+}
+
+bool CDuplicateDetector::ensureFullHash(CCandidate& c)
+{
+	std::lock_guard<std::mutex> lock(c.mutex);
+	if (c.hasFullHash)
+		return true;
+	if (c.path.empty())
+		return false;
+
+	CFileReader& reader = threadReader();
+	try {
+		reader.open(c.path, c.stable);
+	}
+	catch (const std::exception&)
+	{
+		// the file has disappeared: it can't be compared by contents any more
+		c.path.clear();
+		return false;
+	}
+	CHash128 hash;
+	CCrc32 crc;
+	const char* data;
+	size_t size;
+	while (reader.next(data, size)) {
+		hash.process_bytes(data, size);
+		if (!c.hasCrc)
+			crc.process_bytes(data, size);
+	}
+	reader.close();
+
+	c.fullHash = hash.checksum();
+	c.hasFullHash = true;
+	if (!c.hasCrc) {
+		// calculated on the way, for comparisons with members whose data is gone
+		c.crc = crc.checksum();
+		c.hasCrc = true;
+	}
+	m_fullHashes++;
+	return true;
+}
+
+bool CDuplicateDetector::ensureCrc(CCandidate& c)
+{
+	std::lock_guard<std::mutex> lock(c.mutex);
+	if (c.hasCrc)
+		return true;
+	if (c.path.empty())
+		return false;
+
+	CFileReader& reader = threadReader();
+	try {
+		reader.open(c.path, c.stable);
+	}
+	catch (const std::exception&)
+	{
+		// the file has disappeared: it can't be compared by contents any more
+		c.path.clear();
+		return false;
+	}
+	CCrc32 crc;
+	const char* data;
+	size_t size;
+	while (reader.next(data, size))
+		crc.process_bytes(data, size);
+	reader.close();
+
+	c.crc = crc.checksum();
+	c.hasCrc = true;
+	m_crcHashes++;
+	return true;
+}
+
+CDuplicateDetector::CStats CDuplicateDetector::stats() const
+{
+	CStats stats;
+	stats.files = m_files;
+	stats.duplicates = m_duplicates;
+	stats.sampleHashes = m_sampleHashes;
+	stats.fullHashes = m_fullHashes;
+	stats.crcHashes = m_crcHashes;
+	return stats;
+}
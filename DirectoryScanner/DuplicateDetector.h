@@ -0,0 +1,89 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+//! Detects files with identical contents, reading as little as possible.
+//! Files are grouped by size first: a file with a size not seen before is new without being read.
+//! Within a size group a hash over the first and last sampleSize bytes is compared, and only if
+//! that collides as well a 128 bit hash of the whole contents decides.
+//! Archive members are filtered by the size and crc of the archive header. Their extracted data
+//! is only available while they are added; later comparisons with them fall back to size and crc.
+//! Members without a crc in the header are hashed completely while they are added.
+//! All methods are thread safe.
+class CDuplicateDetector
+{
+public:
+	struct CStats
+	{
+		uint64_t files = 0;	//!< files and members added
+		uint64_t duplicates = 0;
+		uint64_t sampleHashes = 0;	//!< files whose prefix and suffix have been hashed
+		uint64_t fullHashes = 0;	//!< files which have been hashed completely
+		uint64_t crcHashes = 0;	//!< files whose crc had to be calculated to compare them with members
+	};
+
+	explicit CDuplicateDetector(size_t sampleSize = 4096);
+	~CDuplicateDetector();
+
+	//! Add a file on disk. The file must stay readable until the detector is destroyed.
+	//! Returns true if no file with the same contents has been added before.
+	bool addFile(const std::filesystem::path& p, uint64_t size);
+
+	//! Add an archive member extracted to p, which needs to be readable during the call only.
+	//! p may be empty if the data is not available. crc is taken from the archive header, 0 if unknown.
+	//! Returns true if no file with the same contents has been added before.
+	bool addMember(const std::filesystem::path& p, uint64_t size, uint32_t crc);
+
+	//! true if a member with the same size and crc has been added, i.e. the member can be skipped without extracting it
+	bool hasMember(uint64_t size, uint32_t crc) const;
+
+	CStats stats() const;
+
+private:
+	struct CCandidate;
+
+	bool add(const std::shared_ptr<CCandidate>& candidate);
+	bool sameContents(CCandidate& a, CCandidate& b);
+	bool ensureCrc(CCandidate& c);
+	bool ensureSample(CCandidate& c);
+	bool ensureFullHash(CCandidate& c);
+
+	size_t m_sampleSize;
+	mutable std::mutex m_mutex;	//!< protects m_buckets
+	std::unordered_map<uint64_t, std::vector<std::shared_ptr<CCandidate>>> m_buckets;	//!< candidates by size
+
+	std::atomic<uint64_t> m_files;
+	std::atomic<uint64_t> m_duplicates;
+	std::atomic<uint64_t> m_sampleHashes;
+	std::atomic<uint64_t> m_fullHashes;
+	std::atomic<uint64_t> m_crcHashes;
+};
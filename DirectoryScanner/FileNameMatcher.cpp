@@ -0,0 +1,129 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "pch.h"
+#include "FileNameMatcher.h"
+
+#include <cctype>
+#include <cstring>
+
+CFileNameMatcher::CFileNameMatcher()
+	: m_matchAll(-1)
+{
+}
+
+void CFileNameMatcher::compile(const std::vector<std::string>& patterns)
+{
+	m_matchAll = -1;
+	m_names.clear();
+	m_suffixes.clear();
+	m_regexes.clear();
+
+	for (size_t i = 0; i < patterns.size(); i++)
+	{
+		const std::string& pattern = patterns[i];
+		int index = static_cast<int>(i);
+		std::string literal;
+
+		if (pattern == ".*") {
+			if (m_matchAll < 0) m_matchAll = index;
+		}
+		else if (pattern.compare(0, 2, ".*") == 0 && parseLiteral(pattern, 2, literal) && literal.find('.') != std::string::npos) {
+			literal = toLower(literal);
+			std::string ext = literal.substr(literal.rfind('.') + 1);
+			m_suffixes[ext].push_back({ literal, index });
+		}
+		else if (parseLiteral(pattern, 0, literal)) {
+			m_names.emplace(toLower(literal), index);
+		}
+		else {
+			m_regexes.push_back({ boost::regex(pattern, boost::regex_constants::icase), index });
+		}
+	}
+}
+
+int CFileNameMatcher::find(const std::string& filename) const
+{
+	int best = m_matchAll;
+
+	if (!m_names.empty() || !m_suffixes.empty()) {
+		std::string lowerName = toLower(filename);
+
+		auto itName = m_names.find(lowerName);
+		if (itName != m_names.end() && (best < 0 || itName->second < best))
+			best = itName->second;
+
+		size_t dot = lowerName.rfind('.');
+		if (dot != std::string::npos) {
+			auto itExt = m_suffixes.find(lowerName.substr(dot + 1));
+			if (itExt != m_suffixes.end()) {
+				for (const CSuffix& s : itExt->second) {
+					if ((best < 0 || s.index < best) && lowerName.size() >= s.suffix.size()
+						&& lowerName.compare(lowerName.size() - s.suffix.size(), s.suffix.size(), s.suffix) == 0)
+						best = s.index;
+				}
+			}
+		}
+	}
+
+	// only patterns preceding the best hit so far can change the result
+	for (const CRegex& r : m_regexes)
+	{
+		if (best >= 0 && r.index > best) break;
+		if (boost::regex_match(filename, r.regex)) {
+			best = r.index;
+			break;
+		}
+	}
+	return best;
+}
+
+//! true if pattern, starting at start, matches exactly one string. The string is returned in literal.
+bool CFileNameMatcher::parseLiteral(const std::string& pattern, size_t start, std::string& literal)
+{
+	literal.clear();
+	for (size_t i = start; i < pattern.size(); i++)
+	{
+		char c = pattern[i];
+		if (c == '\\') {
+			// escaped punctuation is literal, escapes like \d or \w are not
+			if (i + 1 >= pattern.size() || std::isalnum(static_cast<unsigned char>(pattern[i + 1])))
+				return false;
+			literal += pattern[++i];
+		}
+		else if (strchr(".[]{}()*+?|^$", c)) {
+			return false;
+		}
+		else {
+			literal += c;
+		}
+	}
+	return true;
+}
+
+std::string CFileNameMatcher::toLower(const std::string& s)
+{
+	std::string lower(s);
+	for (char& c : lower)
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	return lower;
+}
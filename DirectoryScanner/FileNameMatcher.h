@@ -0,0 +1,68 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/regex.hpp>
+
+//! Set of file name patterns, compiled once and matched many times.
+//! Patterns are regular expressions which must match the whole file name, case-insensitively.
+//! Patterns which are a plain name (e.g. "readme.txt") or ".*" followed by a plain suffix
+//! (e.g. ".*\.zip") are matched with hash lookups; the regex engine only runs for the rest.
+class CFileNameMatcher
+{
+public:
+	CFileNameMatcher();
+
+	//! replace the patterns. Throws boost::regex_error for invalid expressions.
+	void compile(const std::vector<std::string>& patterns);
+
+	//! index of the first pattern matching filename, -1 if none matches
+	int find(const std::string& filename) const;
+
+	bool matches(const std::string& filename) const { return find(filename) >= 0; }
+
+private:
+	struct CSuffix
+	{
+		std::string suffix;
+		int index;
+	};
+
+	struct CRegex
+	{
+		boost::regex regex;
+		int index;
+	};
+
+	static bool parseLiteral(const std::string& pattern, size_t start, std::string& literal);
+	static std::string toLower(const std::string& s);
+
+	int m_matchAll;	//!< index of the first ".*" pattern or -1
+	std::unordered_map<std::string, int> m_names;	//!< lower case literal name -> pattern index
+	std::unordered_map<std::string, std::vector<CSuffix>> m_suffixes;	//!< lower case extension -> suffixes ending with it
+	std::vector<CRegex> m_regexes;	//!< in pattern order
+};
@@ -0,0 +1,186 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "FilePredicate.h"
+#include "ArchiveReader.h"
+
+#include <cctype>
+#include <stdexcept>
+#include <vector>
+
+#ifndef _WIN32
+#include <pwd.h>
+#endif
+
+namespace {
+	//! the leading decimal or octal number of value and the rest
+	uint64_t parseNumber(const std::string& value, int base, std::string& suffix)
+	{
+		size_t end = 0;
+		uint64_t number = 0;
+		try {
+			number = std::stoull(value, &end, base);
+		}
+		catch (std::exception&)
+		{
+			throw std::invalid_argument("Invalid number: '" + value + "'");
+		}
+		if (value[0] == '-')
+			throw std::invalid_argument("Invalid number: '" + value + "'");
+		suffix = value.substr(end);
+		for (char& c : suffix)
+			c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+		return number;
+	}
+
+	uint32_t resolveOwner(const std::string& owner)
+	{
+		if (!owner.empty() && std::isdigit(static_cast<unsigned char>(owner[0]))) {
+			std::string suffix;
+			uint64_t uid = parseNumber(owner, 10, suffix);
+			if (suffix.empty())
+				return static_cast<uint32_t>(uid);
+		}
+#ifdef _WIN32
+		throw std::invalid_argument("Owners can't be resolved on this platform: '" + owner + "'");
+#else
+		passwd pwd;
+		passwd* result = nullptr;
+		std::vector<char> buffer(0x4000);
+		if (::getpwnam_r(owner.c_str(), &pwd, buffer.data(), buffer.size(), &result) != 0 || !result)
+			throw std::invalid_argument("Unknown user: '" + owner + "'");
+		return static_cast<uint32_t>(result->pw_uid);
+#endif
+	}
+}
+
+CFilePredicate::CFilePredicate()
+	: m_active(false)
+	, m_needsStat(false)
+	, m_permissions(0)
+	, m_type(typeAny)
+{
+}
+
+void CFilePredicate::configure(const COptions& options, std::chrono::system_clock::time_point now)
+{
+	const int64_t nowSeconds = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+	auto optionalValue = [](const std::string& value, auto parse) -> std::optional<decltype(parse(value))> {
+		if (value.empty())
+			return std::nullopt;
+		return parse(value);
+	};
+
+	m_minSize = optionalValue(options.minSize, parseSize);
+	m_maxSize = optionalValue(options.maxSize, parseSize);
+	// a file modified at most maxAge ago was modified after now - maxAge
+	std::optional<int64_t> maxAge = optionalValue(options.maxAge, parseDuration);
+	std::optional<int64_t> minAge = optionalValue(options.minAge, parseDuration);
+	std::optional<int64_t> changedWithin = optionalValue(options.changedWithin, parseDuration);
+	m_mtimeFrom = maxAge ? std::optional<int64_t>(nowSeconds - *maxAge) : std::nullopt;
+	m_mtimeTo = minAge ? std::optional<int64_t>(nowSeconds - *minAge) : std::nullopt;
+	m_ctimeFrom = changedWithin ? std::optional<int64_t>(nowSeconds - *changedWithin) : std::nullopt;
+	m_uid = optionalValue(options.owner, resolveOwner);
+
+	m_permissions = 0;
+	if (!options.permissions.empty()) {
+		std::string suffix;
+		uint64_t bits = parseNumber(options.permissions, 8, suffix);
+		if (!suffix.empty() || bits > 07777)
+			throw std::invalid_argument("Invalid permissions: '" + options.permissions + "'");
+		m_permissions = static_cast<uint32_t>(bits);
+	}
+
+	if (options.type.empty())
+		m_type = typeAny;
+	else if (options.type == "f")
+		m_type = typeRegular;
+	else if (options.type == "l")
+		m_type = typeSymlink;
+	else
+		throw std::invalid_argument("Invalid file type: '" + options.type + "'");
+
+	m_needsStat = m_minSize || m_maxSize || m_mtimeFrom || m_mtimeTo || m_ctimeFrom || m_uid || m_permissions;
+	m_active = m_needsStat || m_type != typeAny;
+}
+
+bool CFilePredicate::matches(const CFileStat& st) const
+{
+	if (m_type != typeAny && st.symlink != (m_type == typeSymlink))
+		return false;
+	if (st.size && ((m_minSize && *st.size < *m_minSize) || (m_maxSize && *st.size > *m_maxSize)))
+		return false;
+	if (st.mtime && ((m_mtimeFrom && *st.mtime < *m_mtimeFrom) || (m_mtimeTo && *st.mtime > *m_mtimeTo)))
+		return false;
+	if (st.ctime && m_ctimeFrom && *st.ctime < *m_ctimeFrom)
+		return false;
+	if (st.uid && m_uid && *st.uid != *m_uid)
+		return false;
+	if (st.mode && (*st.mode & m_permissions) != m_permissions)
+		return false;
+	return true;
+}
+
+CFileStat CFilePredicate::memberStat(const CArchiveMember& member)
+{
+	CFileStat st;
+	st.size = member.size;
+	if (member.mtime)
+		st.mtime = member.mtime;
+	if (member.ctime)
+		st.ctime = member.ctime;
+	st.uid = member.uid;
+	st.mode = member.mode;
+	return st;
+}
+
+uint64_t CFilePredicate::parseSize(const std::string& value)
+{
+	std::string suffix;
+	uint64_t size = parseNumber(value, 10, suffix);
+	if (suffix == "b" || suffix.empty())
+		return size;
+	static const std::string units = "kmgt";
+	size_t unit = units.find(suffix[0]);
+	if (unit == std::string::npos || (suffix.size() > 1 && suffix.substr(1) != "b" && suffix.substr(1) != "ib"))
+		throw std::invalid_argument("Invalid size: '" + value + "'");
+	return size << (10 * (unit + 1));
+}
+
+int64_t CFilePredicate::parseDuration(const std::string& value)
+{
+	std::string suffix;
+	int64_t duration = static_cast<int64_t>(parseNumber(value, 10, suffix));
+	if (suffix.empty() || suffix == "s")
+		return duration;
+	if (suffix == "m")
+		return duration * 60;
+	if (suffix == "h")
+		return duration * 3600;
+	if (suffix == "d")
+		return duration * 86400;
+	if (suffix == "w")
+		return duration * 7 * 86400;
+	throw std::invalid_argument("Invalid duration: '" + value + "'");
+}
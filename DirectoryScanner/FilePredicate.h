@@ -0,0 +1,98 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+struct CArchiveMember;
+
+//! Metadata of a file or of an archive member, as far as it is known without opening it.
+struct CFileStat
+{
+	std::optional<uint64_t> size;
+	std::optional<int64_t> mtime;	//!< last write time in seconds since 1970
+	std::optional<int64_t> ctime;	//!< status change time in seconds since 1970
+	std::optional<uint32_t> uid;	//!< owner
+	std::optional<uint32_t> mode;	//!< permission bits
+	bool symlink = false;	//!< reached through a symbolic link
+};
+
+//! Predicates on the metadata of files: size range, age of the last write and the last status change,
+//! owner, permission bits and type. A predicate on a field which isn't known passes, e.g. the owner
+//! of a zip member.
+class CFilePredicate
+{
+public:
+	//! values of the command line options, empty if not given
+	struct COptions
+	{
+		std::string minSize;	//!< bytes with an optional k, m, g or t suffix (powers of 1024)
+		std::string maxSize;
+		std::string maxAge;	//!< duration with an optional s, m, h, d or w suffix, seconds by default
+		std::string minAge;
+		std::string changedWithin;	//!< maximum age of the last status change
+		std::string owner;	//!< user name or uid
+		std::string permissions;	//!< octal bits which must all be set
+		std::string type;	//!< f: regular files only, l: symbolic links only
+	};
+
+	CFilePredicate();
+
+	//! Parse the options. Ages are relative to now. Throws std::invalid_argument for invalid values.
+	void configure(const COptions& options, std::chrono::system_clock::time_point now);
+	//! false if no predicate is configured and every file matches
+	bool active() const { return m_active; }
+	//! true if a predicate needs more than the type of the file
+	bool needsStat() const { return m_needsStat; }
+
+	bool matches(const CFileStat& st) const;
+	//! the metadata recorded for an archive member
+	static CFileStat memberStat(const CArchiveMember& member);
+
+	static uint64_t parseSize(const std::string& value);
+	//! duration in seconds
+	static int64_t parseDuration(const std::string& value);
+
+private:
+	enum EType
+	{
+		typeAny,
+		typeRegular,
+		typeSymlink
+	};
+
+	bool m_active;
+	bool m_needsStat;
+	std::optional<uint64_t> m_minSize;
+	std::optional<uint64_t> m_maxSize;
+	std::optional<int64_t> m_mtimeFrom;
+	std::optional<int64_t> m_mtimeTo;
+	std::optional<int64_t> m_ctimeFrom;
+	std::optional<uint32_t> m_uid;
+	uint32_t m_permissions;
+	EType m_type;
+};
@@ -0,0 +1,331 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "FileReader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const size_t pageSize = 4096;
+
+	//! largest window mapped at once. 32 bit processes map large files piece by piece.
+	const size_t maxViewSize = sizeof(void*) >= 8 ? SIZE_MAX : size_t(64) << 20;
+
+#ifdef _WIN32
+	//! Windows refuses to truncate a file while it is mapped
+	const bool mappingIsSafe = true;
+#else
+	//! reading a page of a mapped file which has been truncated raises SIGBUS
+	const bool mappingIsSafe = false;
+#endif
+
+	std::runtime_error readError(const std::string& what, const std::filesystem::path& p)
+	{
+#ifdef _WIN32
+		return std::runtime_error(what + " " + p.string() + ": error " + std::to_string(GetLastError()));
+#else
+		return std::runtime_error(what + " " + p.string() + ": " + std::strerror(errno));
+#endif
+	}
+
+	char* allocatePageAligned(size_t size)
+	{
+#ifdef _WIN32
+		void* p = _aligned_malloc(size, pageSize);
+#else
+		void* p = nullptr;
+		if (posix_memalign(&p, pageSize, size) != 0)
+			p = nullptr;
+#endif
+		if (!p) throw std::bad_alloc();
+		return static_cast<char*>(p);
+	}
+
+	void freePageAligned(char* p)
+	{
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+}
+
+CFileReader::CFileReader(size_t mapThreshold)
+	: m_mapThreshold(std::max(mapThreshold, pageSize))
+	, m_isOpen(false)
+	, m_mapped(false)
+	, m_size(0)
+	, m_offset(0)
+	, m_buffer(nullptr)
+	, m_bufferOffset(0)
+	, m_bufferSize(0)
+	, m_eof(false)
+	, m_view(nullptr)
+	, m_viewOffset(0)
+	, m_viewSize(0)
+#ifdef _WIN32
+	, m_file(INVALID_HANDLE_VALUE)
+	, m_mapping(nullptr)
+#else
+	, m_fd(-1)
+#endif
+{
+}
+
+CFileReader::~CFileReader()
+{
+	close();
+	if (m_buffer)
+		freePageAligned(m_buffer);
+}
+
+void CFileReader::open(const std::filesystem::path& p, bool stable)
+{
+	close();
+	m_path = p;
+#ifdef _WIN32
+	m_file = CreateFileW(p.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		throw readError("Can't open", p);
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size))
+	{
+		auto err = readError("Can't determine size of", p);
+		close();
+		throw err;
+	}
+	m_size = static_cast<uint64_t>(size.QuadPart);
+#else
+	m_fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+	if (m_fd < 0)
+		throw readError("Can't open", p);
+	struct stat st;
+	if (fstat(m_fd, &st) != 0)
+	{
+		auto err = readError("Can't determine size of", p);
+		close();
+		throw err;
+	}
+	m_size = static_cast<uint64_t>(st.st_size);
+#endif
+	m_isOpen = true;
+	m_mapped = (stable || mappingIsSafe) && m_size > m_mapThreshold;
+#ifndef _WIN32
+	if (!m_mapped)
+		posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+void CFileReader::seekBuffer(uint64_t offset)
+{
+	if (offset == m_bufferOffset)
+		return;
+	const uint64_t filePos = m_bufferOffset + m_bufferSize;
+	if (offset != filePos)
+	{
+#ifdef _WIN32
+		LARGE_INTEGER pos;
+		pos.QuadPart = static_cast<LONGLONG>(offset);
+		if (!SetFilePointerEx(m_file, pos, nullptr, FILE_BEGIN))
+			throw readError("Can't seek", m_path);
+#else
+		if (::lseek(m_fd, static_cast<off_t>(offset), SEEK_SET) < 0)
+			throw readError("Can't seek", m_path);
+#endif
+		m_eof = false;
+	}
+	m_bufferOffset = offset;
+	m_bufferSize = 0;
+}
+
+void CFileReader::fillBuffer(size_t upTo)
+{
+	if (!m_buffer)
+		m_buffer = allocatePageAligned(m_mapThreshold);
+	upTo = std::min(upTo, m_mapThreshold);
+#ifdef _WIN32
+	DWORD nread = 0;
+	while (!m_eof && m_bufferSize < upTo)
+	{
+		if (!ReadFile(m_file, m_buffer + m_bufferSize, static_cast<DWORD>(upTo - m_bufferSize), &nread, nullptr))
+			throw readError("Can't read", m_path);
+		if (nread == 0)
+			m_eof = true;
+		m_bufferSize += nread;
+	}
+#else
+	while (!m_eof && m_bufferSize < upTo)
+	{
+		ssize_t nread = ::read(m_fd, m_buffer + m_bufferSize, upTo - m_bufferSize);
+		if (nread < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw readError("Can't read", m_path);
+		}
+		if (nread == 0)
+			m_eof = true;
+		m_bufferSize += static_cast<size_t>(nread);
+	}
+#endif
+}
+
+void CFileReader::mapView(uint64_t offset)
+{
+	if (m_view && m_viewOffset == offset)
+		return;
+	size_t viewSize = static_cast<size_t>(std::min<uint64_t>(m_size - offset, maxViewSize));
+	unmap();
+#ifdef _WIN32
+	if (!m_mapping)
+	{
+		m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_mapping)
+			throw readError("Can't map", m_path);
+	}
+	m_view = MapViewOfFile(m_mapping, FILE_MAP_READ, static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), viewSize);
+	if (!m_view)
+		throw readError("Can't map", m_path);
+#else
+	void* view = mmap(nullptr, viewSize, PROT_READ, MAP_PRIVATE, m_fd, static_cast<off_t>(offset));
+	if (view == MAP_FAILED)
+		throw readError("Can't map", m_path);
+	madvise(view, viewSize, MADV_SEQUENTIAL);
+	m_view = view;
+#endif
+	m_viewOffset = offset;
+	m_viewSize = viewSize;
+}
+
+void CFileReader::close()
+{
+	unmap();
+#ifdef _WIN32
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	m_mapping = nullptr;
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_fd >= 0)
+		::close(m_fd);
+	m_fd = -1;
+#endif
+	m_path.clear();
+	m_isOpen = false;
+	m_mapped = false;
+	m_size = 0;
+	m_offset = 0;
+	m_bufferOffset = 0;
+	m_bufferSize = 0;
+	m_eof = false;
+}
+
+void CFileReader::unmap()
+{
+	if (!m_view)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(m_view);
+#else
+	munmap(m_view, m_viewSize);
+#endif
+	m_view = nullptr;
+	m_viewOffset = 0;
+	m_viewSize = 0;
+}
+
+bool CFileReader::next(const char*& data, size_t& size)
+{
+	if (!m_isOpen)
+		return false;
+
+	if (!m_mapped)
+	{
+		// the end of the file is where reading ends, even if the file has changed size since it was opened
+		if (m_eof && m_offset == m_bufferOffset + m_bufferSize)
+			return false;
+		seekBuffer(m_offset);
+		fillBuffer(m_mapThreshold);
+		if (m_eof)
+			m_size = m_bufferOffset + m_bufferSize;
+		if (m_bufferSize == 0)
+			return false;
+		data = m_buffer;
+		size = m_bufferSize;
+		m_offset += m_bufferSize;
+		return true;
+	}
+
+	if (m_offset >= m_size)
+		return false;
+	mapView(m_offset);
+	data = static_cast<const char*>(m_view);
+	size = m_viewSize;
+	m_offset += m_viewSize;
+	return true;
+}
+
+size_t CFileReader::read(uint64_t offset, const char*& data, size_t size)
+{
+	if (!m_isOpen)
+		return 0;
+
+	if (!m_mapped)
+	{
+		seekBuffer(offset);
+		fillBuffer(size);
+		data = m_buffer;
+		return std::min(size, m_bufferSize);
+	}
+
+	if (offset >= m_size)
+		return 0;
+	// the window holding offset, as mapped by next()
+	mapView(offset - offset % maxViewSize);
+	const size_t skip = static_cast<size_t>(offset - m_viewOffset);
+	data = static_cast<const char*>(m_view) + skip;
+	return std::min(size, m_viewSize - skip);
+}
@@ -0,0 +1,117 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+//! Reads whole files with as little copying as possible.
+//! Files are read into a page-aligned buffer of the map threshold's size, which is allocated once
+//! and reused for every file, until the end of the file is reached: a file which has grown or
+//! shrunk since it was opened is read as it is now. Files larger than the map threshold are
+//! memory-mapped for sequential access instead if they are stable (see open()), like the
+//! archive members extracted by the scanner; other files are mapped on Windows only.
+//! Reading starts with the first call to head() or next(): looking at the head of a file reads
+//! only the head, the rest is read when the file is consumed.
+//! The data is handed out in chunks by next(); rewind() delivers it again. Files which fit into
+//! the buffer and mapped files aren't read again, so hashing a file and consuming it afterwards
+//! reads it from disk only once. Larger files which aren't mapped are read again.
+//! A reader is used by one thread at a time.
+class CFileReader
+{
+public:
+	static const size_t defaultMapThreshold = 1 << 20;
+
+	explicit CFileReader(size_t mapThreshold = defaultMapThreshold);
+	~CFileReader();
+
+	CFileReader(const CFileReader&) = delete;
+	CFileReader& operator=(const CFileReader&) = delete;
+
+	//! open p, closing the previous file. Throws std::runtime_error if the file can't be opened.
+	//! head() and next() throw std::runtime_error if it can't be read.
+	//! stable promises that the file isn't truncated while it is open, such as the temporary files
+	//! of the caller. Only stable files are mapped on POSIX: reading a page of a mapped file which
+	//! has been truncated raises SIGBUS. Windows refuses to truncate mapped files.
+	void open(const std::filesystem::path& p, bool stable = false);
+	void close();
+
+	bool isOpen() const { return m_isOpen; }
+	//! true if the open file is p. Only the names are compared: a file whose name may refer to
+	//! another file later, like /proc/self/fd/N once the descriptor is reused, is to be closed
+	//! before it is released.
+	bool holds(const std::filesystem::path& p) const { return m_isOpen && m_path == p; }
+	const std::filesystem::path& path() const { return m_path; }
+	uint64_t size() const { return m_size; }
+	bool isMapped() const { return m_mapped; }
+
+	//! next chunk of the file. Returns false at the end of the file.
+	//! The chunk stays valid until the next call to next(), rewind(), open() or close().
+	//! Small files and, on 64 bit platforms, mapped files are delivered in a single chunk.
+	bool next(const char*& data, size_t& size);
+
+	//! start delivering the file from the beginning again
+	void rewind() { m_offset = 0; }
+
+	//! The first bytes of the file, at most size. Returns the number of bytes available at data,
+	//! which stay valid until the next call of any method except head(). Does not change the
+	//! position of next().
+	size_t head(const char*& data, size_t size) { return read(0, data, size); }
+
+	//! The bytes of the file at offset, at most size, like head(). Reads only these bytes.
+	size_t read(uint64_t offset, const char*& data, size_t size);
+
+private:
+	void unmap();
+	//! let the buffer start at offset of the file, keeping its contents if it does already
+	void seekBuffer(uint64_t offset);
+	//! read until the buffer holds upTo bytes or the rest of the file
+	void fillBuffer(size_t upTo);
+	//! map the window starting at offset unless it is mapped already
+	void mapView(uint64_t offset);
+
+	size_t m_mapThreshold;
+	std::filesystem::path m_path;
+	bool m_isOpen;
+	bool m_mapped;
+	uint64_t m_size;	//!< size when the file was opened, the size read once the end is reached
+	uint64_t m_offset;	//!< position of the next chunk
+
+	char* m_buffer;	//!< page-aligned, m_mapThreshold bytes
+	uint64_t m_bufferOffset;	//!< position of m_buffer in the file
+	size_t m_bufferSize;	//!< bytes of the current file held in m_buffer
+	bool m_eof;	//!< the file ends after the bytes in m_buffer
+
+	void* m_view;	//!< mapped window
+	uint64_t m_viewOffset;
+	size_t m_viewSize;
+
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_fd;
+#endif
+};
@@ -0,0 +1,76 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "FormatDetector.h"
+
+#include <cstring>
+
+namespace
+{
+	struct CMagic
+	{
+		EArchiveFormat format;
+		size_t offset;
+		const char* bytes;
+		size_t size;
+	};
+
+	const CMagic magics[] = {
+		{ fmtZip, 0, "PK\x03\x04", 4 },
+		{ fmtZip, 0, "PK\x05\x06", 4 },	// empty archive
+		{ fmtZip, 0, "PK\x07\x08", 4 },	// spanned archive
+		{ fmt7z, 0, "7z\xbc\xaf\x27\x1c", 6 },
+		{ fmtGzip, 0, "\x1f\x8b", 2 },
+		{ fmtXz, 0, "\xfd" "7zXZ\0", 6 },
+		{ fmtCab, 0, "MSCF\0\0\0\0", 8 },
+		{ fmtTar, 257, "ustar", 5 },
+	};
+}
+
+EArchiveFormat CFormatDetector::detect(const char* head, size_t size)
+{
+	for (const CMagic& magic : magics)
+	{
+		if (size >= magic.offset + magic.size && memcmp(head + magic.offset, magic.bytes, magic.size) == 0)
+			return magic.format;
+	}
+	// "BZh" followed by the block size 1..9
+	if (size >= 4 && memcmp(head, "BZh", 3) == 0 && head[3] >= '1' && head[3] <= '9')
+		return fmtBzip2;
+	return fmtNone;
+}
+
+const char* CFormatDetector::name(EArchiveFormat format)
+{
+	switch (format) {
+	case fmtZip: return "zip";
+	case fmt7z: return "7z";
+	case fmtTar: return "tar";
+	case fmtGzip: return "gz";
+	case fmtBzip2: return "bz2";
+	case fmtXz: return "xz";
+	case fmtCab: return "cab";
+	default: return "none";
+	}
+}
@@ -0,0 +1,53 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+
+//! archive formats which can be opened
+enum EArchiveFormat
+{
+	fmtNone,
+	fmtZip,
+	fmt7z,
+	fmtTar,
+	fmtGzip,
+	fmtBzip2,
+	fmtXz,
+	fmtCab
+};
+
+//! Recognizes archive formats by the magic numbers at the start of the data.
+class CFormatDetector
+{
+public:
+	//! bytes needed by detect: the ustar magic of tar archives is at offset 257
+	static const size_t headSize = 512;
+
+	//! format of the data starting with head, fmtNone if it is not an archive.
+	//! size may be less than headSize for short files.
+	static EArchiveFormat detect(const char* head, size_t size);
+
+	static const char* name(EArchiveFormat format);
+};
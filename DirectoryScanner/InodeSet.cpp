@@ -0,0 +1,89 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "InodeSet.h"
+
+namespace
+{
+	const unsigned int inodeBits = 48;
+}
+
+CInodeSet::CInodeSet()
+	: m_deviceCount(0)
+{
+	for (auto& device : m_devices)
+		device.store(0, std::memory_order_relaxed);
+}
+
+CInodeSet::~CInodeSet()
+{
+}
+
+size_t CInodeSet::deviceIndex(uint64_t device)
+{
+	// a scan sees few devices: a linear search without the lock finds them
+	size_t count = m_deviceCount.load(std::memory_order_acquire);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (m_devices[i].load(std::memory_order_relaxed) == device)
+			return i;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	count = m_deviceCount.load(std::memory_order_relaxed);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (m_devices[i].load(std::memory_order_relaxed) == device)
+			return i;
+	}
+	if (count == maxDevices)
+		return maxDevices;
+	m_devices[count].store(device, std::memory_order_relaxed);
+	m_deviceCount.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+bool CInodeSet::insert(uint64_t device, uint64_t inode)
+{
+	size_t index = deviceIndex(device);
+	if (index < maxDevices && (inode >> inodeBits) == 0)
+		return m_keys.insert((static_cast<uint64_t>(index) << inodeBits) | inode);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_overflow.insert({ device, inode }).second;
+}
+
+size_t CInodeSet::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_keys.size() + m_overflow.size();
+}
+
+void CInodeSet::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_keys.clear();
+	m_overflow.clear();
+	m_deviceCount.store(0, std::memory_order_release);
+}
@@ -0,0 +1,65 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <utility>
+
+#include "DedupStore.h"
+
+//! Set of file identities (device, inode), which parallel scanners test and insert atomically.
+//! Identities are packed into the 64 bit keys of a CDedupStore: 16 bits for the index of the device,
+//! 48 bits for the inode, so an identity takes 8 bytes. Identities which don't fit, on more than
+//! maxDevices devices or with larger inode numbers, are kept in an ordered set.
+class CInodeSet
+{
+public:
+	CInodeSet();
+	~CInodeSet();
+
+	CInodeSet(const CInodeSet&) = delete;
+	CInodeSet& operator=(const CInodeSet&) = delete;
+
+	//! insert the identity. Returns true if it was not in the set before.
+	bool insert(uint64_t device, uint64_t inode);
+	size_t size() const;
+	void clear();
+
+	static const size_t maxDevices = 64;
+
+private:
+	//! index of device in m_devices, added if it isn't there. maxDevices if the table is full.
+	size_t deviceIndex(uint64_t device);
+
+	CDedupStore m_keys;
+	std::array<std::atomic<uint64_t>, maxDevices> m_devices;	//!< read without the lock
+	std::atomic<size_t> m_deviceCount;
+	mutable std::mutex m_mutex;	//!< protects the members below and adding devices
+	std::set<std::pair<uint64_t, uint64_t>> m_overflow;
+};
@@ -0,0 +1,331 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+
+#ifdef DIRECTORYSCANNER_WITH_LIBARCHIVE
+
+#include "LibArchiveReader.h"
+#include "MemberSource.h"
+#include "ScanMetrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+namespace
+{
+	//! formats which libarchive can only read from a seekable source
+	bool needsSeek(EArchiveFormat format)
+	{
+		return format == fmtZip || format == fmt7z || format == fmtCab;
+	}
+
+	//! libarchive read handle for one pass over an archive
+	class CArchiveHandle
+	{
+	public:
+		//! reading stops quietly once cancel is set, see cancelled()
+		CArchiveHandle(const std::filesystem::path& archivePath, EArchiveFormat format, const std::atomic<bool>* cancel)
+			: m_archivePath(archivePath)
+			, m_a(archive_read_new())
+			, m_source(nullptr)
+			, m_cancel(cancel)
+		{
+			supportFormats(format);
+#ifdef _WIN32
+			int res = archive_read_open_filename_w(m_a, archivePath.c_str(), 0x10000);
+#else
+			int res = archive_read_open_filename(m_a, archivePath.c_str(), 0x10000);
+#endif
+			if (res != ARCHIVE_OK)
+				fail("Can't open archive");
+		}
+
+		//! archive read from source. Formats which need to seek are read into memory first.
+		CArchiveHandle(CMemberSource& source, const std::filesystem::path& archiveName, EArchiveFormat format, const std::atomic<bool>* cancel)
+			: m_archivePath(archiveName)
+			, m_a(archive_read_new())
+			, m_source(&source)
+			, m_cancel(cancel)
+		{
+			supportFormats(format);
+			int res;
+			if (needsSeek(format)) {
+				size_t nread;
+				do {
+					size_t pos = m_buffer.size();
+					m_buffer.resize(pos + 0x10000);
+					nread = source.read(m_buffer.data() + pos, 0x10000);
+					m_buffer.resize(pos + nread);
+				} while (nread > 0);
+				res = archive_read_open_memory(m_a, m_buffer.data(), m_buffer.size());
+			}
+			else {
+				m_buffer.resize(0x10000);
+				res = archive_read_open(m_a, this, nullptr, &CArchiveHandle::readSource, nullptr);
+			}
+			if (res != ARCHIVE_OK)
+				fail("Can't open archive");
+		}
+
+		~CArchiveHandle()
+		{
+			archive_read_free(m_a);
+		}
+
+		CArchiveHandle(const CArchiveHandle&) = delete;
+		CArchiveHandle& operator=(const CArchiveHandle&) = delete;
+
+		//! advance to the next member, returns false at the end of the archive or if reading has been cancelled
+		bool next(CArchiveMember& member)
+		{
+			if (cancelled())
+				return false;
+			archive_entry* entry;
+			int res = archive_read_next_header(m_a, &entry);
+			if (res == ARCHIVE_EOF)
+				return false;
+			if (res < ARCHIVE_WARN) {
+				if (cancelled())
+					return false;
+				fail("Can't read archive");
+			}
+
+#ifdef _WIN32
+			const wchar_t* name = archive_entry_pathname_w(entry);
+#else
+			const char* name = archive_entry_pathname(entry);
+#endif
+			member.name = name ? std::filesystem::path(name) : std::filesystem::path();
+			if (archive_format(m_a) == ARCHIVE_FORMAT_RAW) {
+				// the raw format names its only member "data": name it after the archive like 7z does
+				member.name = m_archivePath.stem();
+				if (m_archivePath.extension() == ".tgz")
+					member.name += ".tar";
+			}
+			member.size = archive_entry_size_is_set(entry) ? static_cast<uint64_t>(archive_entry_size(entry)) : 0;
+			member.crc = 0;
+			member.isDirectory = archive_entry_filetype(entry) == AE_IFDIR;
+			member.mtime = archive_entry_mtime_is_set(entry) ? static_cast<int64_t>(archive_entry_mtime(entry)) : 0;
+			member.ctime = archive_entry_ctime_is_set(entry) ? static_cast<int64_t>(archive_entry_ctime(entry)) : 0;
+			// only the unix formats record owners, the others report 0
+			const int base = archive_format(m_a) & ARCHIVE_FORMAT_BASE_MASK;
+			if (base == ARCHIVE_FORMAT_TAR || base == ARCHIVE_FORMAT_CPIO)
+				member.uid = static_cast<uint32_t>(archive_entry_uid(entry));
+			else
+				member.uid.reset();
+			if (base != ARCHIVE_FORMAT_RAW)
+				member.mode = static_cast<uint32_t>(archive_entry_perm(entry));
+			else
+				member.mode.reset();
+			return true;
+		}
+
+		size_t read(char* buf, size_t size)
+		{
+			la_ssize_t nread = archive_read_data(m_a, buf, size);
+			if (nread < 0) {
+				if (cancelled())
+					return 0;
+				fail("Can't read archive member");
+			}
+			return static_cast<size_t>(nread);
+		}
+
+		[[noreturn]] void fail(const std::string& what)
+		{
+			// errors of the source are passed on unchanged
+			if (m_sourceError)
+				std::rethrow_exception(m_sourceError);
+			const char* error = archive_error_string(m_a);
+			throw std::runtime_error(what + " " + m_archivePath.string() + ": " + (error ? error : "unknown error"));
+		}
+
+		bool cancelled() const { return m_cancel && *m_cancel; }
+
+	private:
+		void supportFormats(EArchiveFormat format)
+		{
+			archive_read_support_filter_all(m_a);
+			// compressed single files have no container format. Like 7z, a .tgz is a gzip file containing a tar archive
+			if (format == fmtGzip || format == fmtXz || format == fmtBzip2)
+				archive_read_support_format_raw(m_a);
+			else
+				archive_read_support_format_all(m_a);
+		}
+
+		//! archive_read_callback: exceptions must not pass through libarchive, they are rethrown by fail
+		static la_ssize_t readSource(archive* a, void* clientData, const void** buffer)
+		{
+			CArchiveHandle* self = static_cast<CArchiveHandle*>(clientData);
+			*buffer = self->m_buffer.data();
+			if (self->cancelled()) {
+				archive_set_error(a, ECANCELED, "Reading cancelled");
+				return ARCHIVE_FATAL;
+			}
+			try {
+				return static_cast<la_ssize_t>(self->m_source->read(self->m_buffer.data(), self->m_buffer.size()));
+			}
+			catch (...) {
+				self->m_sourceError = std::current_exception();
+				archive_set_error(a, -1, "Can't read nested archive");
+				return -1;
+			}
+		}
+
+		std::filesystem::path m_archivePath;
+		archive* m_a;
+		CMemberSource* m_source;	//!< nullptr if the archive is read from a file
+		std::vector<char> m_buffer;
+		std::exception_ptr m_sourceError;
+		const std::atomic<bool>* m_cancel;
+	};
+
+	//! data of the current member of an archive handle
+	class CArchiveMemberSource : public CMemberSource
+	{
+	public:
+		//! the time spent decompressing is added to readTime
+		CArchiveMemberSource(CArchiveHandle& handle, std::chrono::steady_clock::duration& readTime)
+			: m_handle(handle)
+			, m_readTime(readTime)
+		{}
+
+		virtual size_t read(char* buf, size_t size) override
+		{
+			auto start = std::chrono::steady_clock::now();
+			size_t nread = m_handle.read(buf, size);
+			m_readTime += std::chrono::steady_clock::now() - start;
+			return nread;
+		}
+
+	private:
+		CArchiveHandle& m_handle;
+		std::chrono::steady_clock::duration& m_readTime;
+	};
+
+	//! members with absolute paths or ".." would be written outside of the extraction directory
+	bool isSafeMemberPath(const std::filesystem::path& name)
+	{
+		if (name.empty() || name.has_root_path())
+			return false;
+		for (const auto& part : name.lexically_normal())
+		{
+			if (part == "..")
+				return false;
+		}
+		return true;
+	}
+
+	//! Listing and extraction are interleaved in a single pass, so the time spent reading headers and the
+	//! time spent reading member data are summed up separately and recorded once the archive is complete.
+	void streamMembers(CArchiveHandle& handle, const CArchiveReader::Select& select, const CArchiveReader::Consume& consume, CScanMetrics* metrics)
+	{
+		std::chrono::steady_clock::duration listTime{};
+		std::chrono::steady_clock::duration readTime{};
+		CArchiveMember member;
+		for (unsigned int index = 0; ; index++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			bool more = handle.next(member);
+			listTime += std::chrono::steady_clock::now() - start;
+			if (!more)
+				break;
+			if (member.isDirectory || !select(index, member))
+				continue;
+			// libarchive skips what the consumer has not read when advancing to the next header
+			CArchiveMemberSource source(handle, readTime);
+			consume(index, member, source);
+		}
+		if (metrics) {
+			metrics->record(CScanMetrics::timerArchiveList, listTime);
+			metrics->record(CScanMetrics::timerArchiveExtract, readTime);
+		}
+	}
+}
+
+std::vector<CArchiveMember> CLibArchiveReader::list(const std::filesystem::path& archivePath, EArchiveFormat format)
+{
+	CArchiveHandle handle(archivePath, format, nullptr);
+	std::vector<CArchiveMember> members;
+	CArchiveMember member;
+	while (handle.next(member))
+		members.push_back(member);
+	return members;
+}
+
+void CLibArchiveReader::extract(const std::filesystem::path& archivePath, EArchiveFormat format,
+	const std::vector<unsigned int>& indices, const std::filesystem::path& dir)
+{
+	std::vector<unsigned int> sorted(indices);
+	std::sort(sorted.begin(), sorted.end());
+	stream(archivePath, format,
+		[&sorted](unsigned int index, const CArchiveMember& member) {
+			return std::binary_search(sorted.begin(), sorted.end(), index) && isSafeMemberPath(member.name);
+		},
+		[this, &dir](unsigned int, const CArchiveMember& member, CMemberSource& source) {
+			std::filesystem::path p = dir / member.name;
+			std::filesystem::create_directories(p.parent_path());
+			std::ofstream ofs(p, std::ios::binary);
+			std::vector<char> buf(0x10000);
+			size_t nread;
+			uint64_t written = 0;
+			while ((nread = source.read(buf.data(), buf.size())) > 0) {
+				ofs.write(buf.data(), nread);
+				written += nread;
+			}
+			if (!ofs)
+				throw std::runtime_error("Can't write " + p.string());
+			if (m_metrics)
+				m_metrics->add(CScanMetrics::counterTempBytesWritten, written);
+		});
+}
+
+void CLibArchiveReader::stream(const std::filesystem::path& archivePath, EArchiveFormat format,
+	const Select& select, const Consume& consume)
+{
+	CArchiveHandle handle(archivePath, format, m_cancel);
+	streamMembers(handle, select, consume, m_metrics);
+}
+
+bool CLibArchiveReader::streamNested(CMemberSource& source, uint64_t size, const std::filesystem::path& archiveName,
+	EArchiveFormat format, const Select& select, const Consume& consume)
+{
+	// a large or unknown size would have to be held in memory
+	if (needsSeek(format) && (size == 0 || size > maxBufferedArchive))
+		return false;
+	CArchiveHandle handle(source, archiveName, format, m_cancel);
+	streamMembers(handle, select, consume, m_metrics);
+	return true;
+}
+
+#endif
@@ -0,0 +1,46 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include "ArchiveReader.h"
+
+//! Archive backend using libarchive. Available if DIRECTORYSCANNER_WITH_LIBARCHIVE is defined.
+//! Members are decompressed in a single forward pass and streamed to the consumer without
+//! temporary files. Nested archives are read from the decompressed stream of the outer archive,
+//! formats which need to seek (zip, 7z, cab) up to maxBufferedArchive bytes from a memory buffer.
+//! libarchive does not report member crcs, they are always 0.
+class CLibArchiveReader : public CArchiveReader
+{
+public:
+	virtual std::string name() const override { return "libarchive"; }
+	virtual std::vector<CArchiveMember> list(const std::filesystem::path& archivePath, EArchiveFormat format) override;
+	virtual void extract(const std::filesystem::path& archivePath, EArchiveFormat format,
+		const std::vector<unsigned int>& indices, const std::filesystem::path& dir) override;
+	virtual void stream(const std::filesystem::path& archivePath, EArchiveFormat format,
+		const Select& select, const Consume& consume) override;
+	virtual bool streamNested(CMemberSource& source, uint64_t size, const std::filesystem::path& archiveName,
+		EArchiveFormat format, const Select& select, const Consume& consume) override;
+
+	static const uint64_t maxBufferedArchive = 64 << 20;
+};
@@ -0,0 +1,223 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	//! Streams of the log lines alive on this thread. A line logged while the message of another
+	//! line is being formatted gets the next stream.
+	struct CLineStreams
+	{
+		std::vector<std::unique_ptr<std::ostringstream>> streams;
+		size_t used = 0;
+	};
+	thread_local CLineStreams lineStreams;
+
+	std::ostringstream& acquireStream()
+	{
+		if (lineStreams.used == lineStreams.streams.size())
+			lineStreams.streams.push_back(std::make_unique<std::ostringstream>());
+		return *lineStreams.streams[lineStreams.used++];
+	}
+
+	void releaseStream(std::ostringstream& stream)
+	{
+		// keep the buffer, reset the contents and the formatting state
+		stream.str(std::string());
+		stream.clear();
+		stream.flags(std::ios_base::dec | std::ios_base::skipws);
+		stream.precision(6);
+		stream.width(0);
+		stream.fill(' ');
+		lineStreams.used--;
+	}
+
+	const char spaces[] = "                                                                ";
+}
+
+// Bounded multi-producer queue after D. Vyukov: every slot carries a sequence number which tells
+// whether it is free for the position a producer has claimed or filled for the consumer.
+struct CLogger::CSlot
+{
+	std::atomic<uint64_t> sequence;
+	ELogLevel level;
+	int indent;
+	std::string text;
+};
+
+CLogger::CLogger(std::ostream& out, std::ostream& err, size_t capacity)
+	: m_out(out)
+	, m_err(err)
+	, m_enqueuePos(0)
+	, m_signal(0)
+	, m_written(0)
+	, m_sleeping(false)
+	, m_stop(false)
+{
+	size_t size = 2;
+	while (size < capacity)
+		size *= 2;
+	m_slots = std::make_unique<CSlot[]>(size);
+	m_mask = size - 1;
+	for (size_t i = 0; i < size; i++)
+		m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	m_writer = std::thread(&CLogger::run, this);
+}
+
+CLogger::~CLogger()
+{
+	m_stop.store(true);
+	m_signal.fetch_add(1, std::memory_order_release);
+	m_signal.notify_one();
+	m_writer.join();
+}
+
+std::shared_ptr<CLogger> CLogger::console()
+{
+	static std::shared_ptr<CLogger> logger = std::make_shared<CLogger>(std::cout, std::cerr);
+	return logger;
+}
+
+void CLogger::write(ELogLevel level, int indent, std::string_view text)
+{
+	uint64_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+	CSlot* slot;
+	for (;;)
+	{
+		slot = &m_slots[pos & m_mask];
+		uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+		int64_t diff = static_cast<int64_t>(sequence - pos);
+		if (diff == 0) {
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0) {
+			// full: wait for the writer
+			std::this_thread::yield();
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+		else {
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+
+	slot->level = level;
+	slot->indent = indent;
+	// the slot strings keep their capacity: no allocation once the lines have been long enough
+	slot->text.assign(text);
+	slot->sequence.store(pos + 1, std::memory_order_release);
+
+	// Either the writer sees the line before it goes to sleep or we see that it is sleeping
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_sleeping.load(std::memory_order_relaxed)) {
+		m_signal.fetch_add(1, std::memory_order_release);
+		m_signal.notify_one();
+	}
+}
+
+void CLogger::flush()
+{
+	uint64_t target = m_enqueuePos.load(std::memory_order_acquire);
+	uint64_t written = m_written.load(std::memory_order_acquire);
+	while (written < target)
+	{
+		m_written.wait(written, std::memory_order_acquire);
+		written = m_written.load(std::memory_order_acquire);
+	}
+}
+
+void CLogger::run()
+{
+	uint64_t pos = 0;
+	auto ready = [this, &pos]() {
+		return m_slots[pos & m_mask].sequence.load(std::memory_order_acquire) == pos + 1;
+	};
+
+	for (;;)
+	{
+		size_t batch = 0;
+		while (ready())
+		{
+			CSlot& slot = m_slots[pos & m_mask];
+			std::ostream& os = slot.level <= levelWarning ? m_err : m_out;
+			for (size_t indent = 2 * static_cast<size_t>(std::max(slot.indent, 0)); indent > 0; ) {
+				size_t n = std::min(indent, sizeof(spaces) - 1);
+				os.write(spaces, n);
+				indent -= n;
+			}
+			os.write(slot.text.data(), slot.text.size());
+			os.put('\n');
+			slot.text.clear();
+			slot.sequence.store(pos + m_mask + 1, std::memory_order_release);
+			pos++;
+
+			// let flush() return without waiting for an empty queue
+			if (++batch == 256) {
+				m_written.store(pos, std::memory_order_release);
+				m_written.notify_all();
+				batch = 0;
+			}
+		}
+
+		m_out.flush();
+		m_err.flush();
+		m_written.store(pos, std::memory_order_release);
+		m_written.notify_all();
+
+		if (m_stop.load())
+			break;
+
+		// lines arriving shortly are picked up without the logging threads having to wake the writer
+		for (int spin = 0; spin < 64 && !ready(); spin++)
+			std::this_thread::yield();
+		if (ready())
+			continue;
+
+		m_sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		uint64_t signal = m_signal.load(std::memory_order_acquire);
+		if (!ready() && !m_stop.load())
+			m_signal.wait(signal, std::memory_order_acquire);
+		m_sleeping.store(false, std::memory_order_relaxed);
+	}
+}
+
+CLogLine::CLogLine(CLogger& logger, ELogLevel level, int indent)
+	: m_logger(logger)
+	, m_level(level)
+	, m_indent(indent)
+	, m_stream(acquireStream())
+{
+}
+
+CLogLine::~CLogLine()
+{
+	m_logger.write(m_level, m_indent, m_stream.view());
+	releaseStream(m_stream);
+}
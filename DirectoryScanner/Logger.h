@@ -0,0 +1,127 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+enum ELogLevel
+{
+	levelError = 0,
+	levelWarning = 1,
+	levelInfo = 2,
+	levelDebug = 3
+};
+
+//! Messages above this level are removed at compile time. Define it as 0..3 to remove the
+//! debug output from a release build, for example.
+#ifndef DIRECTORYSCANNER_MAX_LOG_LEVEL
+#define DIRECTORYSCANNER_MAX_LOG_LEVEL 3
+#endif
+
+//! Asynchronous sink for log lines.
+//! Logging threads queue complete lines into a bounded lock-free ring buffer; a background thread
+//! indents them and writes errors and warnings to err, everything else to out. A logging thread
+//! only waits if the ring buffer is full. Lines of one thread are written in the order they are logged.
+class CLogger
+{
+public:
+	explicit CLogger(std::ostream& out, std::ostream& err, size_t capacity = 4096);
+	//! writes the queued lines
+	~CLogger();
+
+	CLogger(const CLogger&) = delete;
+	CLogger& operator=(const CLogger&) = delete;
+
+	//! queue a copy of text as one line. text has no line break at the end.
+	void write(ELogLevel level, int indent, std::string_view text);
+
+	//! wait until all lines queued so far have been written
+	void flush();
+
+	//! logger writing to std::cout and std::cerr, shared by all scanners which have no logger of their own
+	static std::shared_ptr<CLogger> console();
+
+private:
+	struct CSlot;
+
+	void run();
+
+	std::ostream& m_out;
+	std::ostream& m_err;
+	std::unique_ptr<CSlot[]> m_slots;
+	size_t m_mask;	//!< capacity - 1, the capacity is a power of 2
+
+	alignas(64) std::atomic<uint64_t> m_enqueuePos;	//!< next slot claimed by a logging thread
+	alignas(64) std::atomic<uint64_t> m_signal;	//!< changed to wake the writer, which waits on it
+	alignas(64) std::atomic<uint64_t> m_written;	//!< lines written by the writer thread
+	std::atomic<bool> m_sleeping;	//!< the writer waits on m_signal
+	std::atomic<bool> m_stop;
+	std::thread m_writer;
+};
+
+//! One line of log output, collected with operator<< and queued when the line is destroyed.
+//! The formatting state of the line (std::hex, ...) ends with the line.
+//! The text is formatted into a stream of the calling thread which is reused by its next lines.
+class CLogLine
+{
+public:
+	CLogLine(CLogger& logger, ELogLevel level, int indent);
+	~CLogLine();
+
+	CLogLine(const CLogLine&) = delete;
+	CLogLine& operator=(const CLogLine&) = delete;
+
+	template<class T>
+	CLogLine& operator<<(const T& value)
+	{
+		m_stream << value;
+		return *this;
+	}
+
+	CLogLine& operator<<(std::ostream& (*manipulator)(std::ostream&))
+	{
+		m_stream << manipulator;
+		return *this;
+	}
+
+	CLogLine& operator<<(std::ios_base& (*manipulator)(std::ios_base&))
+	{
+		m_stream << manipulator;
+		return *this;
+	}
+
+private:
+	CLogger& m_logger;
+	ELogLevel m_level;
+	int m_indent;
+	std::ostringstream& m_stream;
+};
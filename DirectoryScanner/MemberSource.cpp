@@ -0,0 +1,203 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "pch.h"
+#include "MemberSource.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+CTempDirectory::CTempDirectory(const std::filesystem::path& p)
+	: m_path(p)
+{
+	std::filesystem::create_directories(m_path);
+}
+
+CTempDirectory::~CTempDirectory()
+{
+	std::error_code ec;
+	std::filesystem::remove_all(m_path, ec);
+}
+
+std::filesystem::path CTempDirectory::uniquePath(const std::filesystem::path& base_dir)
+{
+	auto random_char = []() -> char {
+		static const char characters[] = "0123456789abcdef";
+		static thread_local std::mt19937 generator(std::random_device{}());
+		static thread_local std::uniform_int_distribution<int> distribution(0, 15);
+		return characters[distribution(generator)];
+		};
+
+	// Generate a unique filename by checking if the file already exists
+	std::filesystem::path unique_path;
+	do {
+		std::string random_filename(16, '\0');
+		for (char& c : random_filename) {
+			c = random_char();
+		}
+		unique_path = base_dir / random_filename;
+	} while (std::filesystem::exists(unique_path));
+
+	return unique_path;
+}
+
+#ifdef __linux__
+CMemoryFile::CMemoryFile(const std::string& name)
+	: m_fd(::memfd_create(name.c_str(), MFD_CLOEXEC))
+{
+	if (m_fd < 0)
+		throw std::system_error(errno, std::system_category(), "memfd_create");
+}
+
+CMemoryFile::~CMemoryFile()
+{
+	::close(m_fd);
+}
+
+void CMemoryFile::write(const char* data, size_t size)
+{
+	while (size > 0) {
+		ssize_t written = ::write(m_fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			throw std::system_error(errno, std::system_category(), "Can't write memory file");
+		}
+		data += written;
+		size -= static_cast<size_t>(written);
+	}
+}
+
+std::filesystem::path CMemoryFile::path() const
+{
+	return "/proc/self/fd/" + std::to_string(m_fd);
+}
+#endif
+
+class CMemberSource::CStreamBuf : public std::streambuf
+{
+public:
+	CStreamBuf(CMemberSource& source)
+		: m_source(source)
+		, m_buffer(0x10000)
+	{}
+
+protected:
+	virtual int_type underflow() override
+	{
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+		size_t nread = m_source.read(m_buffer.data(), m_buffer.size());
+		if (nread == 0)
+			return traits_type::eof();
+		setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + nread);
+		return traits_type::to_int_type(*gptr());
+	}
+
+private:
+	CMemberSource& m_source;
+	std::vector<char> m_buffer;
+};
+
+CMemberSource::CMemberSource()
+{
+}
+
+CMemberSource::~CMemberSource()
+{
+}
+
+std::filesystem::path CMemberSource::filePath() const
+{
+	return std::filesystem::path();
+}
+
+std::shared_ptr<CTempStorage> CMemberSource::fileOwner() const
+{
+	return nullptr;
+}
+
+std::istream& CMemberSource::stream()
+{
+	if (!m_stream) {
+		m_streamBuf = std::make_unique<CStreamBuf>(*this);
+		m_stream = std::make_unique<std::istream>(m_streamBuf.get());
+	}
+	return *m_stream;
+}
+
+CFileMemberSource::CFileMemberSource(const std::filesystem::path& p, std::shared_ptr<CTempStorage> owner)
+	: m_path(p)
+	, m_owner(owner)
+	, m_ifs(p, std::ios::binary)
+{
+	if (!m_ifs) throw std::runtime_error("Can't open extracted file " + p.string());
+}
+
+size_t CFileMemberSource::read(char* buf, size_t size)
+{
+	m_ifs.read(buf, size);
+	return static_cast<size_t>(m_ifs.gcount());
+}
+
+std::filesystem::path CFileMemberSource::filePath() const
+{
+	return m_path;
+}
+
+std::shared_ptr<CTempStorage> CFileMemberSource::fileOwner() const
+{
+	return m_owner;
+}
+
+CReadAheadMemberSource::CReadAheadMemberSource(CMemberSource& source, size_t headSize)
+	: m_source(source)
+	, m_head(headSize)
+	, m_headPos(0)
+{
+	size_t size = 0;
+	size_t nread;
+	while (size < headSize && (nread = source.read(m_head.data() + size, headSize - size)) > 0)
+		size += nread;
+	m_head.resize(size);
+}
+
+size_t CReadAheadMemberSource::read(char* buf, size_t size)
+{
+	if (m_headPos < m_head.size()) {
+		size_t n = std::min(size, m_head.size() - m_headPos);
+		memcpy(buf, m_head.data() + m_headPos, n);
+		m_headPos += n;
+		return n;
+	}
+	return m_source.read(buf, size);
+}
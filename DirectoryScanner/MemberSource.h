@@ -0,0 +1,146 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+//! Owner of the temporary storage of extracted archive members, which is released on destruction.
+class CTempStorage
+{
+public:
+	virtual ~CTempStorage() = default;
+};
+
+//! Temporary directory which is removed with all its contents on destruction.
+class CTempDirectory : public CTempStorage
+{
+public:
+	CTempDirectory(const std::filesystem::path& p);
+	~CTempDirectory();
+
+	CTempDirectory(const CTempDirectory&) = delete;
+	CTempDirectory& operator=(const CTempDirectory&) = delete;
+
+	const std::filesystem::path& path() const { return m_path; }
+
+	//! random path in base_dir which does not exist yet
+	static std::filesystem::path uniquePath(const std::filesystem::path& base_dir = std::filesystem::temp_directory_path());
+
+private:
+	std::filesystem::path m_path;
+};
+
+#ifdef __linux__
+//! Anonymous file in memory created by memfd_create. No directory entry is created and nothing is written
+//! to disk. Its path /proc/self/fd/N can be opened by this process as long as the object exists; the
+//! path has no file name or extension of its own.
+class CMemoryFile : public CTempStorage
+{
+public:
+	//! name is shown in the link target of the path, for diagnostics only. Throws std::system_error.
+	explicit CMemoryFile(const std::string& name);
+	virtual ~CMemoryFile();
+
+	CMemoryFile(const CMemoryFile&) = delete;
+	CMemoryFile& operator=(const CMemoryFile&) = delete;
+
+	//! append data. Throws std::system_error.
+	void write(const char* data, size_t size);
+	std::filesystem::path path() const;
+
+private:
+	int m_fd;
+};
+#endif
+
+//! Source of the decompressed data of an archive member.
+//! Data is pulled in chunks with read(). For consumers which prefer the iostream
+//! interface stream() returns an std::istream reading from the same source.
+class CMemberSource
+{
+public:
+	CMemberSource();
+	virtual ~CMemberSource();
+
+	CMemberSource(const CMemberSource&) = delete;
+	CMemberSource& operator=(const CMemberSource&) = delete;
+
+	//! read up to size bytes into buf. Returns the number of bytes read, 0 at the end of the data.
+	virtual size_t read(char* buf, size_t size) = 0;
+
+	//! path of a file holding the member data, or an empty path if the data is not backed by a file.
+	virtual std::filesystem::path filePath() const;
+
+	//! owner of the file returned by filePath(). Holding it keeps the file valid after the source is gone.
+	virtual std::shared_ptr<CTempStorage> fileOwner() const;
+
+	//! istream view of the member data. Do not mix with calls to read().
+	std::istream& stream();
+
+private:
+	class CStreamBuf;
+	std::unique_ptr<CStreamBuf> m_streamBuf;
+	std::unique_ptr<std::istream> m_stream;
+};
+
+//! Member data which has been extracted to a file.
+class CFileMemberSource : public CMemberSource
+{
+public:
+	CFileMemberSource(const std::filesystem::path& p, std::shared_ptr<CTempStorage> owner = nullptr);
+
+	virtual size_t read(char* buf, size_t size) override;
+	virtual std::filesystem::path filePath() const override;
+	virtual std::shared_ptr<CTempStorage> fileOwner() const override;
+
+private:
+	std::filesystem::path m_path;
+	std::shared_ptr<CTempStorage> m_owner;
+	std::ifstream m_ifs;
+};
+
+//! Stream member data whose first bytes have been read ahead, for example to detect its format.
+//! read() delivers the bytes read ahead before the rest of the data of source.
+class CReadAheadMemberSource : public CMemberSource
+{
+public:
+	//! reads up to headSize bytes from source
+	CReadAheadMemberSource(CMemberSource& source, size_t headSize);
+
+	const char* head() const { return m_head.data(); }
+	size_t headSize() const { return m_head.size(); }
+
+	virtual size_t read(char* buf, size_t size) override;
+
+private:
+	CMemberSource& m_source;
+	std::vector<char> m_head;
+	size_t m_headPos;	//!< bytes of m_head delivered by read()
+};
@@ -0,0 +1,303 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "PathFilter.h"
+#include "FileNameMatcher.h"
+
+#include <fstream>
+#include <iterator>
+
+void CIgnoreRules::parse(std::string_view text)
+{
+	while (!text.empty()) {
+		size_t eol = text.find('\n');
+		std::string_view line = text.substr(0, eol);
+		text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+		// trailing blanks are ignored unless they are escaped
+		while (!line.empty() && (line.back() == '\r' || line.back() == ' ')
+			&& !(line.back() == ' ' && line.size() > 1 && line[line.size() - 2] == '\\'))
+			line.remove_suffix(1);
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		CRule rule{ {}, false, false, false };
+		if (line[0] == '!') {
+			rule.negated = true;
+			line.remove_prefix(1);
+		}
+		if (!line.empty() && line.back() == '/') {
+			rule.directoryOnly = true;
+			line.remove_suffix(1);
+		}
+		rule.anchored = line.find('/') != std::string_view::npos;
+		if (!line.empty() && line[0] == '/')
+			line.remove_prefix(1);
+		if (line.empty())
+			continue;
+		rule.pattern = line;
+		m_rules.push_back(std::move(rule));
+	}
+}
+
+bool CIgnoreRules::load(const std::filesystem::path& p)
+{
+	std::ifstream ifs(p, std::ios::binary);
+	if (!ifs)
+		return false;
+	std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	parse(text);
+	return true;
+}
+
+CIgnoreRules::EMatch CIgnoreRules::match(std::string_view relativePath, bool isDirectory) const
+{
+	size_t slash = relativePath.rfind('/');
+	std::string_view name = slash == std::string_view::npos ? relativePath : relativePath.substr(slash + 1);
+	for (auto rule = m_rules.rbegin(); rule != m_rules.rend(); ++rule) {
+		if (rule->directoryOnly && !isDirectory)
+			continue;
+		if (globMatch(rule->pattern, rule->anchored ? relativePath : name))
+			return rule->negated ? matchIncluded : matchIgnored;
+	}
+	return matchNone;
+}
+
+bool CIgnoreRules::globMatch(std::string_view pattern, std::string_view text)
+{
+	size_t p = 0;
+	size_t t = 0;
+	while (p < pattern.size()) {
+		char c = pattern[p];
+		if (c == '*') {
+			if (p + 1 < pattern.size() && pattern[p + 1] == '*') {
+				std::string_view rest = pattern.substr(p + 2);
+				if (!rest.empty() && rest[0] == '/') {
+					// "**/" matches zero or more whole directories
+					rest.remove_prefix(1);
+					for (size_t s = t; ; s++) {
+						if (globMatch(rest, text.substr(s)))
+							return true;
+						s = text.find('/', s);
+						if (s == std::string_view::npos)
+							return false;
+					}
+				}
+				// "**" anywhere else matches everything, including '/'
+				for (size_t s = t; s <= text.size(); s++) {
+					if (globMatch(rest, text.substr(s)))
+						return true;
+				}
+				return false;
+			}
+			std::string_view rest = pattern.substr(p + 1);
+			for (size_t s = t; ; s++) {
+				if (globMatch(rest, text.substr(s)))
+					return true;
+				if (s == text.size() || text[s] == '/')
+					return false;
+			}
+		}
+
+		if (t == text.size())
+			return false;
+		const unsigned char ch = static_cast<unsigned char>(text[t]);
+		if (c == '?') {
+			if (ch == '/')
+				return false;
+		}
+		else if (c == '[' && pattern.find(']', p + 2) != std::string_view::npos) {
+			size_t i = p + 1;
+			const bool negate = pattern[i] == '!' || pattern[i] == '^';
+			if (negate)
+				i++;
+			// a ']' directly after the opening bracket is part of the class
+			const size_t first = i;
+			bool found = false;
+			for (; i < pattern.size() && (pattern[i] != ']' || i == first); i++) {
+				unsigned char lo = static_cast<unsigned char>(pattern[i]);
+				unsigned char hi = lo;
+				if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+					hi = static_cast<unsigned char>(pattern[i + 2]);
+					i += 2;
+				}
+				if (lo <= ch && ch <= hi)
+					found = true;
+			}
+			if (i == pattern.size() || found == negate || ch == '/')
+				return false;
+			p = i;
+		}
+		else {
+			if (c == '\\' && p + 1 < pattern.size())
+				c = pattern[++p];
+			if (static_cast<unsigned char>(c) != ch)
+				return false;
+		}
+		p++;
+		t++;
+	}
+	return t == text.size();
+}
+
+namespace {
+	void appendComponent(std::string& path, const std::string& name)
+	{
+		if (!path.empty())
+			path += '/';
+		path += name;
+	}
+}
+
+CPathFilter::CPathFilter()
+	: m_active(false)
+	, m_hasIncludes(false)
+	, m_maxDepth(noDepthLimit)
+	, m_includeDirs(std::make_unique<CFileNameMatcher>())
+	, m_excludeDirs(std::make_unique<CFileNameMatcher>())
+{
+}
+
+CPathFilter::~CPathFilter()
+{
+}
+
+void CPathFilter::configure(const std::vector<std::string>& includeDirs, const std::vector<std::string>& excludeDirs,
+	unsigned int maxDepth, const std::vector<std::string>& ignoreFileNames)
+{
+	m_includeDirs->compile(includeDirs);
+	m_excludeDirs->compile(excludeDirs);
+	m_hasIncludes = !includeDirs.empty();
+	m_maxDepth = maxDepth;
+	m_ignoreFileNames = ignoreFileNames;
+	m_active = m_hasIncludes || !excludeDirs.empty() || maxDepth != noDepthLimit || !ignoreFileNames.empty();
+}
+
+CPathFilter::DirectoryPtr CPathFilter::root(const std::filesystem::path& rootPath, uint64_t rootDevice) const
+{
+	auto dir = std::make_shared<CDirectory>();
+	dir->path = rootPath;
+	dir->rootDevice = rootDevice;
+	dir->included = !m_hasIncludes;
+	loadIgnoreRules(*dir);
+	return dir;
+}
+
+CPathFilter::DirectoryPtr CPathFilter::enter(const DirectoryPtr& parent, const std::string& name) const
+{
+	if (m_active && (parent->depth >= m_maxDepth || m_excludeDirs->matches(name)))
+		return nullptr;
+
+	auto dir = std::make_shared<CDirectory>();
+	dir->parent = parent;
+	dir->path = parent->path / name;
+	dir->depth = parent->depth + 1;
+	dir->included = parent->included || m_includeDirs->matches(name);
+	dir->rootDevice = parent->rootDevice;
+	if (m_ignoreFileNames.empty())
+		return dir;
+
+	dir->relativePath = parent->relativePath;
+	appendComponent(dir->relativePath, name);
+	if (ignored(parent.get(), dir->relativePath, true))
+		return nullptr;
+	loadIgnoreRules(*dir);
+	return dir;
+}
+
+bool CPathFilter::acceptsFile(const CDirectory& dir, const std::string& name) const
+{
+	if (!m_active)
+		return true;
+	if (!dir.included)
+		return false;
+	if (m_ignoreFileNames.empty())
+		return true;
+	std::string relativePath = dir.relativePath;
+	appendComponent(relativePath, name);
+	return !ignored(&dir, relativePath, false);
+}
+
+bool CPathFilter::acceptsMember(const CDirectory* dir, const std::filesystem::path& archivePath, const std::filesystem::path& memberName) const
+{
+	if (!m_active)
+		return true;
+
+	unsigned int depth = dir ? dir->depth : 0;
+	bool included = dir ? dir->included : !m_hasIncludes;
+	const bool checkIgnored = dir && !m_ignoreFileNames.empty();
+	std::string relativePath;
+	if (checkIgnored) {
+		relativePath = dir->relativePath;
+		appendComponent(relativePath, archivePath.generic_string());
+	}
+
+	for (const std::filesystem::path& component : memberName.parent_path().relative_path()) {
+		const std::string name = component.string();
+		if (name.empty() || name == ".")
+			continue;
+		if (depth++ >= m_maxDepth || m_excludeDirs->matches(name))
+			return false;
+		if (checkIgnored) {
+			appendComponent(relativePath, name);
+			if (ignored(dir, relativePath, true))
+				return false;
+		}
+		included = included || m_includeDirs->matches(name);
+	}
+	if (!included)
+		return false;
+	if (checkIgnored) {
+		appendComponent(relativePath, memberName.filename().string());
+		return !ignored(dir, relativePath, false);
+	}
+	return true;
+}
+
+void CPathFilter::loadIgnoreRules(CDirectory& dir) const
+{
+	for (const std::string& name : m_ignoreFileNames) {
+		if (!dir.ignoreRules)
+			dir.ignoreRules = std::make_unique<CIgnoreRules>();
+		dir.ignoreRules->load(dir.path / name);
+	}
+	if (dir.ignoreRules && dir.ignoreRules->empty())
+		dir.ignoreRules.reset();
+}
+
+bool CPathFilter::ignored(const CDirectory* dir, const std::string& relativePath, bool isDirectory) const
+{
+	// the rules of the innermost ignore file take precedence
+	for (; dir; dir = dir->parent.get()) {
+		if (!dir->ignoreRules)
+			continue;
+		std::string_view path = relativePath;
+		if (!dir->relativePath.empty())
+			path.remove_prefix(dir->relativePath.size() + 1);
+		CIgnoreRules::EMatch match = dir->ignoreRules->match(path, isDirectory);
+		if (match != CIgnoreRules::matchNone)
+			return match == CIgnoreRules::matchIgnored;
+	}
+	return false;
+}
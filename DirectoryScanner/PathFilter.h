@@ -0,0 +1,129 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class CFileNameMatcher;
+
+//! Rules of one ignore file in the syntax of .gitignore: one glob pattern per line, '#' starts a comment,
+//! '!' negates a pattern, a trailing '/' restricts it to directories, and a pattern containing a '/' is
+//! matched against the whole path relative to the directory of the ignore file, otherwise against the
+//! last component only. '*' and '?' don't match '/', "**" matches any number of directories.
+class CIgnoreRules
+{
+public:
+	enum EMatch
+	{
+		matchNone,	//!< no rule matches
+		matchIgnored,
+		matchIncluded	//!< the last matching rule is negated
+	};
+
+	void parse(std::string_view text);
+	//! parse the ignore file p. Returns false if it can't be read.
+	bool load(const std::filesystem::path& p);
+	bool empty() const { return m_rules.empty(); }
+
+	//! relativePath: generic path relative to the directory of the ignore file. The last matching rule decides.
+	EMatch match(std::string_view relativePath, bool isDirectory) const;
+
+	//! glob matching of one pattern as described above
+	static bool globMatch(std::string_view pattern, std::string_view text);
+
+private:
+	struct CRule
+	{
+		std::string pattern;
+		bool negated;
+		bool directoryOnly;
+		bool anchored;	//!< matched against the whole relative path
+	};
+	std::vector<CRule> m_rules;
+};
+
+//! Rules deciding which directories are entered and which files in them are scanned.
+//! The rules of a directory are evaluated once, before it is opened, so pruned subtrees are never
+//! enumerated. The same rules are applied to the directories of archive members before they are extracted.
+//!  - exclude patterns: directories whose name matches are not entered
+//!  - include patterns: only files below a directory whose name matches are scanned. The other
+//!    directories are still entered to find such directories.
+//!  - maximum depth: directories more than this number of levels below the root are not entered
+//!  - ignore files: files like .gitignore found in a directory exclude files and directories below it
+class CPathFilter
+{
+public:
+	static constexpr unsigned int noDepthLimit = std::numeric_limits<unsigned int>::max();
+
+	//! directory being scanned, linked to its parent for the rules of the ignore files above it
+	struct CDirectory
+	{
+		std::shared_ptr<const CDirectory> parent;
+		std::filesystem::path path;
+		std::string relativePath;	//!< generic path relative to the root, empty for the root
+		unsigned int depth = 0;	//!< 0 for the root
+		bool included = false;	//!< below a directory matching the include patterns, or there are none
+		std::unique_ptr<CIgnoreRules> ignoreRules;	//!< rules of the ignore files in this directory, nullptr if there are none
+		uint64_t rootDevice = 0;	//!< device of the root directory, directories on other devices are skipped with --xdev
+	};
+	typedef std::shared_ptr<const CDirectory> DirectoryPtr;
+
+	CPathFilter();
+	~CPathFilter();
+
+	//! replace the rules. Throws boost::regex_error for invalid patterns.
+	void configure(const std::vector<std::string>& includeDirs, const std::vector<std::string>& excludeDirs,
+		unsigned int maxDepth, const std::vector<std::string>& ignoreFileNames);
+	//! false if no rule is configured, every directory is entered and every file accepted
+	bool active() const { return m_active; }
+
+	DirectoryPtr root(const std::filesystem::path& rootPath, uint64_t rootDevice = 0) const;
+	//! the subdirectory name of parent, with the rules of its ignore files loaded. nullptr if it is pruned.
+	DirectoryPtr enter(const DirectoryPtr& parent, const std::string& name) const;
+	//! true if the file name in dir is to be scanned
+	bool acceptsFile(const CDirectory& dir, const std::string& name) const;
+	//! True if the archive member memberName is to be scanned. dir is the directory on disk holding the
+	//! outermost archive, nullptr if the archive was passed as root. archivePath is the logical path of
+	//! the archive relative to dir. The member's directories count as directory levels below dir.
+	bool acceptsMember(const CDirectory* dir, const std::filesystem::path& archivePath, const std::filesystem::path& memberName) const;
+
+private:
+	//! read the ignore files in dir
+	void loadIgnoreRules(CDirectory& dir) const;
+	//! the decision of the ignore files of dir and its parents on relativePath, relative to the root
+	bool ignored(const CDirectory* dir, const std::string& relativePath, bool isDirectory) const;
+
+	bool m_active;
+	bool m_hasIncludes;
+	unsigned int m_maxDepth;
+	std::unique_ptr<CFileNameMatcher> m_includeDirs;
+	std::unique_ptr<CFileNameMatcher> m_excludeDirs;
+	std::vector<std::string> m_ignoreFileNames;
+};
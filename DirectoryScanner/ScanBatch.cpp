@@ -0,0 +1,81 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "ScanBatch.h"
+#include "MemberSource.h"
+
+CScanBatch::CScanBatch()
+{
+}
+
+CScanBatch::~CScanBatch()
+{
+}
+
+void CScanBatch::add(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, uint32_t crc, uint64_t size,
+	std::shared_ptr<CTempStorage> owner)
+{
+	if (m_slots.empty())
+		m_started = std::chrono::steady_clock::now();
+
+	const auto& path = p.native();
+	const auto& logical = logicalFilename.native();
+	CSlot slot;
+	slot.pathOffset = m_chars.size();
+	slot.pathLength = path.size();
+	m_chars.insert(m_chars.end(), path.begin(), path.end());
+	slot.logicalOffset = m_chars.size();
+	slot.logicalLength = logical.size();
+	m_chars.insert(m_chars.end(), logical.begin(), logical.end());
+	slot.crc = crc;
+	slot.size = size;
+	slot.member = owner != nullptr;
+	m_slots.push_back(slot);
+	if (owner)
+		m_owners.push_back(std::move(owner));
+}
+
+std::span<const CBatchEntry> CScanBatch::entries()
+{
+	m_entries.resize(m_slots.size());
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		const CSlot& slot = m_slots[i];
+		CBatchEntry& entry = m_entries[i];
+		entry.path = CBatchEntry::PathView(m_chars.data() + slot.pathOffset, slot.pathLength);
+		entry.logicalFilename = CBatchEntry::PathView(m_chars.data() + slot.logicalOffset, slot.logicalLength);
+		entry.crc = slot.crc;
+		entry.size = slot.size;
+		entry.member = slot.member;
+	}
+	return m_entries;
+}
+
+void CScanBatch::clear()
+{
+	m_chars.clear();
+	m_slots.clear();
+	m_entries.clear();
+	m_owners.clear();
+}
@@ -0,0 +1,90 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+class CTempStorage;
+
+//! file passed to process_batch. The views point into the buffer of the batch.
+struct CBatchEntry
+{
+	typedef std::basic_string_view<std::filesystem::path::value_type> PathView;
+
+	PathView path;	//!< file on disk or extracted archive member
+	PathView logicalFilename;
+	uint32_t crc = 0;	//!< 0 if not known
+	uint64_t size = 0;	//!< size of archive members, 0 for files on disk and if not known
+	bool member = false;	//!< archive member extracted to a temporary file
+};
+
+//! Files collected for one call of process_batch.
+//! The paths of all entries are stored in one character buffer, and the buffers keep their
+//! capacity when the batch is cleared, so a batch which is reused allocates nothing per file.
+class CScanBatch
+{
+public:
+	CScanBatch();
+	~CScanBatch();
+
+	//! Archive members are added with the owner of their temporary file, which keeps the file
+	//! alive until the batch is cleared. Files on disk have no owner.
+	void add(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, uint32_t crc, uint64_t size,
+		std::shared_ptr<CTempStorage> owner = nullptr);
+
+	//! the entries in the order they have been added, valid until the batch is changed
+	std::span<const CBatchEntry> entries();
+
+	size_t size() const { return m_slots.size(); }
+	bool empty() const { return m_slots.empty(); }
+	//! time the first entry has been added
+	std::chrono::steady_clock::time_point started() const { return m_started; }
+
+	void clear();
+
+private:
+	//! entry with offsets into m_chars, which may move while the batch grows
+	struct CSlot
+	{
+		size_t pathOffset;
+		size_t pathLength;
+		size_t logicalOffset;
+		size_t logicalLength;
+		uint32_t crc;
+		uint64_t size;
+		bool member;
+	};
+
+	std::vector<std::filesystem::path::value_type> m_chars;
+	std::vector<CSlot> m_slots;
+	std::vector<CBatchEntry> m_entries;
+	std::vector<std::shared_ptr<CTempStorage>> m_owners;
+	std::chrono::steady_clock::time_point m_started;
+};
@@ -0,0 +1,245 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "ScanIndex.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	const char indexMagic[4] = { 'D', 'S', 'I', 'X' };
+	const uint32_t indexVersion = 1;
+
+	// all numbers are stored little endian
+
+	void writeUInt(std::ostream& os, uint64_t v, int bytes)
+	{
+		char buf[8];
+		for (int i = 0; i < bytes; i++)
+			buf[i] = static_cast<char>((v >> (8 * i)) & 0xff);
+		os.write(buf, bytes);
+	}
+
+	void writeString(std::ostream& os, const std::string& s)
+	{
+		writeUInt(os, s.size(), 4);
+		os.write(s.data(), s.size());
+	}
+
+	uint64_t readUInt(std::istream& is, int bytes)
+	{
+		unsigned char buf[8];
+		if (!is.read(reinterpret_cast<char*>(buf), bytes))
+			throw std::runtime_error("Scan index is truncated");
+		uint64_t v = 0;
+		for (int i = 0; i < bytes; i++)
+			v |= uint64_t(buf[i]) << (8 * i);
+		return v;
+	}
+
+	std::string readString(std::istream& is)
+	{
+		std::string s(static_cast<size_t>(readUInt(is, 4)), '\0');
+		if (!is.read(s.data(), s.size()))
+			throw std::runtime_error("Scan index is truncated");
+		return s;
+	}
+
+	bool isBelow(const std::string& key, const std::string& rootKey)
+	{
+		if (key.compare(0, rootKey.size(), rootKey) != 0)
+			return false;
+		return key.size() == rootKey.size() || rootKey.empty() || rootKey.back() == '/' || key[rootKey.size()] == '/';
+	}
+}
+
+void CScanIndex::load(const std::filesystem::path& indexFile)
+{
+	std::ifstream ifs(indexFile, std::ios::binary);
+	if (!ifs)
+		return;
+
+	char magic[sizeof(indexMagic)];
+	if (!ifs.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), indexMagic))
+		throw std::runtime_error("Not a scan index: " + indexFile.string());
+	if (readUInt(ifs, 4) != indexVersion)
+		throw std::runtime_error("Unsupported scan index version: " + indexFile.string());
+
+	std::unordered_map<std::string, CItem> items;
+	uint64_t count = readUInt(ifs, 8);
+	for (uint64_t i = 0; i < count; i++)
+	{
+		std::string key = readString(ifs);
+		CScanIndexEntry& entry = items[key].entry;
+		entry.size = readUInt(ifs, 8);
+		entry.mtime = static_cast<int64_t>(readUInt(ifs, 8));
+		entry.inode = readUInt(ifs, 8);
+		entry.crc = static_cast<uint32_t>(readUInt(ifs, 4));
+		entry.isArchive = readUInt(ifs, 1) != 0;
+		uint64_t memberCount = readUInt(ifs, 4);
+		for (uint64_t m = 0; m < memberCount; m++)
+		{
+			CScanIndexMember member;
+			member.name = readString(ifs);
+			member.size = readUInt(ifs, 8);
+			member.crc = static_cast<uint32_t>(readUInt(ifs, 4));
+			entry.members.push_back(std::move(member));
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_items.swap(items);
+}
+
+void CScanIndex::save(const std::filesystem::path& indexFile) const
+{
+	std::filesystem::path tempFile = indexFile;
+	tempFile += ".tmp";
+	{
+		std::ofstream ofs(tempFile, std::ios::binary | std::ios::trunc);
+		if (!ofs)
+			throw std::runtime_error("Can't write scan index: " + tempFile.string());
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ofs.write(indexMagic, sizeof(indexMagic));
+		writeUInt(ofs, indexVersion, 4);
+		writeUInt(ofs, m_items.size(), 8);
+		for (const auto& item : m_items)
+		{
+			const CScanIndexEntry& entry = item.second.entry;
+			writeString(ofs, item.first);
+			writeUInt(ofs, entry.size, 8);
+			writeUInt(ofs, static_cast<uint64_t>(entry.mtime), 8);
+			writeUInt(ofs, entry.inode, 8);
+			writeUInt(ofs, entry.crc, 4);
+			writeUInt(ofs, entry.isArchive ? 1 : 0, 1);
+			writeUInt(ofs, entry.members.size(), 4);
+			for (const CScanIndexMember& member : entry.members)
+			{
+				writeString(ofs, member.name);
+				writeUInt(ofs, member.size, 8);
+				writeUInt(ofs, member.crc, 4);
+			}
+		}
+		if (!ofs.flush())
+			throw std::runtime_error("Can't write scan index: " + tempFile.string());
+	}
+	std::filesystem::rename(tempFile, indexFile);
+}
+
+std::string CScanIndex::key(const std::filesystem::path& p)
+{
+	std::u8string u8 = std::filesystem::absolute(p).lexically_normal().generic_u8string();
+	return std::string(u8.begin(), u8.end());
+}
+
+bool CScanIndex::stat(const std::filesystem::path& p, CScanIndexEntry& entry)
+{
+#ifdef _WIN32
+	std::error_code ec;
+	entry.size = std::filesystem::file_size(p, ec);
+	if (ec) return false;
+	entry.mtime = std::filesystem::last_write_time(p, ec).time_since_epoch().count();
+	if (ec) return false;
+	entry.inode = 0;
+#else
+	struct stat st;
+	if (::stat(p.c_str(), &st) != 0)
+		return false;
+	entry.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+	entry.mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	entry.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+	entry.inode = static_cast<uint64_t>(st.st_ino);
+#endif
+	return true;
+}
+
+CScanIndex::EState CScanIndex::update(const std::string& key, const CScanIndexEntry& current, CScanIndexEntry& previous)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto res = m_items.try_emplace(key);
+	CItem& item = res.first->second;
+	item.seen = true;
+	if (!res.second && item.entry.sameFile(current)) {
+		previous = item.entry;
+		return stateUnchanged;
+	}
+	item.entry = current;
+	item.entry.crc = 0;
+	item.entry.isArchive = false;
+	item.entry.members.clear();
+	return res.second ? stateNew : stateModified;
+}
+
+void CScanIndex::setCrc(const std::string& key, uint32_t crc)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_items.find(key);
+	if (it != m_items.end())
+		it->second.entry.crc = crc;
+}
+
+void CScanIndex::setMembers(const std::string& key, std::vector<CScanIndexMember> members)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_items.find(key);
+	if (it != m_items.end() && it->second.seen) {
+		it->second.entry.isArchive = true;
+		it->second.entry.members = std::move(members);
+	}
+}
+
+std::vector<std::string> CScanIndex::removeUnseen(const std::vector<std::string>& rootKeys)
+{
+	std::vector<std::string> removed;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto it = m_items.begin(); it != m_items.end(); )
+	{
+		auto below = [&it](const std::string& rootKey) { return isBelow(it->first, rootKey); };
+		if (!it->second.seen && std::any_of(rootKeys.begin(), rootKeys.end(), below)) {
+			removed.push_back(it->first);
+			it = m_items.erase(it);
+		}
+		else {
+			it->second.seen = false;
+			++it;
+		}
+	}
+	return removed;
+}
+
+size_t CScanIndex::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_items.size();
+}
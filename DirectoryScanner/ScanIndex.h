@@ -0,0 +1,104 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//! member of an archive recorded in the scan index
+struct CScanIndexMember
+{
+	std::string name;	//!< path inside the archive, UTF-8
+	uint64_t size = 0;
+	uint32_t crc = 0;
+};
+
+//! state of a file recorded in the scan index
+struct CScanIndexEntry
+{
+	uint64_t size = 0;
+	int64_t mtime = 0;	//!< last write time, platform dependent ticks
+	uint64_t inode = 0;	//!< 0 where the platform has no inode numbers
+	uint32_t crc = 0;	//!< 0 if the crc was not calculated
+	bool isArchive = false;
+	std::vector<CScanIndexMember> members;	//!< members of an archive, as listed by the last scan
+
+	bool sameFile(const CScanIndexEntry& other) const
+	{
+		return size == other.size && mtime == other.mtime && inode == other.inode;
+	}
+};
+
+//! On-disk index of the files seen by earlier scans, keyed by absolute path.
+//! A rescan compares the size, modification time and inode of every file with the index:
+//! unchanged files need neither hashing nor, for archives, listing.
+//! All methods are thread safe.
+class CScanIndex
+{
+public:
+	enum EState
+	{
+		stateNew,
+		stateUnchanged,
+		stateModified
+	};
+
+	//! read the index file. A missing file gives an empty index, a damaged one throws std::runtime_error.
+	void load(const std::filesystem::path& indexFile);
+	//! write the index file. The file is replaced atomically.
+	void save(const std::filesystem::path& indexFile) const;
+
+	//! key of p in the index: the absolute, normalized path in UTF-8
+	static std::string key(const std::filesystem::path& p);
+	//! size, modification time and inode of p. Returns false if p can't be accessed.
+	static bool stat(const std::filesystem::path& p, CScanIndexEntry& entry);
+
+	//! Mark key as seen by the current scan and compare current with the stored state.
+	//! previous receives the stored entry if the file is unchanged. New and modified files
+	//! are stored with the current state and without crc and members.
+	EState update(const std::string& key, const CScanIndexEntry& current, CScanIndexEntry& previous);
+	void setCrc(const std::string& key, uint32_t crc);
+	void setMembers(const std::string& key, std::vector<CScanIndexMember> members);
+
+	//! Remove the entries below one of rootKeys which have not been seen since the last call
+	//! and return their keys. Starts tracking a new scan. All roots of a scan are passed at once:
+	//! entries below the other roots are no longer marked as seen after the call.
+	std::vector<std::string> removeUnseen(const std::vector<std::string>& rootKeys);
+
+	size_t size() const;
+
+private:
+	struct CItem
+	{
+		CScanIndexEntry entry;
+		bool seen = false;
+	};
+
+	mutable std::mutex m_mutex;
+	std::unordered_map<std::string, CItem> m_items;
+};
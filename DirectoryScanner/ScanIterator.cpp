@@ -0,0 +1,70 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "ScanIterator.h"
+
+#include <stdexcept>
+
+CScanEntrySource::~CScanEntrySource()
+{
+}
+
+CScanIterator::CScanIterator()
+	: m_source(nullptr)
+	, m_entry(nullptr)
+{
+}
+
+CScanIterator::CScanIterator(CScanEntrySource* source)
+	: m_source(source)
+	, m_entry(source->next())
+{
+}
+
+CScanIterator& CScanIterator::operator++()
+{
+	m_entry = m_source->next();
+	return *this;
+}
+
+CScanRange::CScanRange(std::unique_ptr<CScanEntrySource> source)
+	: m_source(std::move(source))
+	, m_started(false)
+{
+}
+
+CScanRange::CScanRange(CScanRange&&) noexcept = default;
+CScanRange& CScanRange::operator=(CScanRange&&) noexcept = default;
+
+CScanRange::~CScanRange()
+{
+}
+
+CScanIterator CScanRange::begin()
+{
+	if (m_started)
+		throw std::logic_error("the entries of a scan can be iterated once only");
+	m_started = true;
+	return CScanIterator(m_source.get());
+}
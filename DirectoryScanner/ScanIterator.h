@@ -0,0 +1,101 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+
+class CMemberSource;
+
+//! file produced by CDirectoryScanner::entries
+struct CScanEntry
+{
+	std::filesystem::path path;	//!< file on disk, empty for archive members which are not backed by a file
+	std::filesystem::path logicalFilename;
+	uint32_t crc = 0;	//!< 0 if not known
+	uint64_t size = 0;	//!< size of archive members, 0 for files on disk and if not known
+	CMemberSource* source = nullptr;	//!< data of archive members, nullptr for files on disk
+
+	bool isMember() const { return source != nullptr; }
+};
+
+//! produces the entries of a scan one by one
+class CScanEntrySource
+{
+public:
+	virtual ~CScanEntrySource();
+	//! the next entry, valid until next is called again. nullptr at the end of the scan.
+	virtual const CScanEntry* next() = 0;
+};
+
+//! Input iterator over the entries of a scan. Advancing it continues the scan up to the next entry.
+class CScanIterator
+{
+public:
+	typedef std::input_iterator_tag iterator_category;
+	typedef CScanEntry value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef const CScanEntry* pointer;
+	typedef const CScanEntry& reference;
+
+	//! end iterator
+	CScanIterator();
+
+	reference operator*() const { return *m_entry; }
+	pointer operator->() const { return m_entry; }
+	CScanIterator& operator++();
+	void operator++(int) { ++*this; }
+
+	//! iterators are equal if both are at the end
+	bool operator==(const CScanIterator& other) const { return m_entry == other.m_entry; }
+
+private:
+	friend class CScanRange;
+	CScanIterator(CScanEntrySource* source);
+
+	CScanEntrySource* m_source;
+	const CScanEntry* m_entry;
+};
+
+//! The entries of a scan: for (const CScanEntry& entry : scanner.entries(root)) ...
+//! Nothing is scanned ahead of the entry being looked at, so a loop can stop at any time.
+//! Destroying the range stops the scan. begin may be called once only.
+class CScanRange
+{
+public:
+	explicit CScanRange(std::unique_ptr<CScanEntrySource> source);
+	CScanRange(CScanRange&&) noexcept;
+	CScanRange& operator=(CScanRange&&) noexcept;
+	~CScanRange();
+
+	CScanIterator begin();
+	CScanIterator end() { return CScanIterator(); }
+
+private:
+	std::unique_ptr<CScanEntrySource> m_source;
+	bool m_started;
+};
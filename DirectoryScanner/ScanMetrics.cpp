@@ -0,0 +1,188 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "ScanMetrics.h"
+
+#include <bit>
+#include <sstream>
+
+struct alignas(64) CScanMetrics::CShard
+{
+	struct CTimerData
+	{
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> totalNs;
+		std::array<std::atomic<uint64_t>, bucketCount> buckets;
+	};
+
+	std::array<std::atomic<uint64_t>, counterCount> counters;
+	std::array<CTimerData, timerCount> timers;
+};
+
+namespace
+{
+	const char* const counterNames[] = {
+		"directories", "directories_pruned", "files_matched", "files_skipped", "bytes_hashed", "members_listed",
+		"members_extracted", "archive_parts", "temp_bytes_written", "memory_bytes_written", "dedup_hits", "errors"
+	};
+	const char* const timerNames[] = { "enumerate", "crc32", "archive_list", "archive_extract", "process_file", "entry_feed" };
+
+	static_assert(sizeof(counterNames) / sizeof(counterNames[0]) == CScanMetrics::counterCount);
+	static_assert(sizeof(timerNames) / sizeof(timerNames[0]) == CScanMetrics::timerCount);
+
+	//! threads are spread over the shards in the order they first update metrics
+	std::atomic<size_t> nextShard(0);
+}
+
+CScanMetrics::CScanMetrics()
+	: m_shards(std::make_unique<CShard[]>(shardCount))
+{
+	reset();
+}
+
+CScanMetrics::~CScanMetrics()
+{
+}
+
+CScanMetrics::CShard& CScanMetrics::shard()
+{
+	thread_local const size_t index = nextShard.fetch_add(1, std::memory_order_relaxed) % shardCount;
+	return m_shards[index];
+}
+
+void CScanMetrics::add(ECounter counter, uint64_t value)
+{
+	shard().counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+void CScanMetrics::record(ETimer timer, std::chrono::steady_clock::duration duration)
+{
+	uint64_t ns = static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0));
+	size_t bucket = std::min<size_t>(std::bit_width(ns), bucketCount - 1);
+	CShard::CTimerData& data = shard().timers[timer];
+	data.count.fetch_add(1, std::memory_order_relaxed);
+	data.totalNs.fetch_add(ns, std::memory_order_relaxed);
+	data.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t CScanMetrics::counter(ECounter counter) const
+{
+	uint64_t sum = 0;
+	for (size_t i = 0; i < shardCount; i++)
+		sum += m_shards[i].counters[counter].load(std::memory_order_relaxed);
+	return sum;
+}
+
+CScanMetrics::CHistogram CScanMetrics::histogram(ETimer timer) const
+{
+	CHistogram histogram;
+	for (size_t i = 0; i < shardCount; i++)
+	{
+		const CShard::CTimerData& data = m_shards[i].timers[timer];
+		histogram.count += data.count.load(std::memory_order_relaxed);
+		histogram.totalNs += data.totalNs.load(std::memory_order_relaxed);
+		for (size_t b = 0; b < bucketCount; b++)
+			histogram.buckets[b] += data.buckets[b].load(std::memory_order_relaxed);
+	}
+	return histogram;
+}
+
+uint64_t CScanMetrics::CHistogram::percentileNs(double p) const
+{
+	uint64_t total = 0;
+	for (uint64_t n : buckets)
+		total += n;
+	if (total == 0)
+		return 0;
+	uint64_t rank = static_cast<uint64_t>(p / 100 * static_cast<double>(total) + 0.5);
+	uint64_t cumulative = 0;
+	for (size_t b = 0; b < bucketCount; b++)
+	{
+		cumulative += buckets[b];
+		if (cumulative >= rank && cumulative > 0)
+			return uint64_t(1) << b;
+	}
+	return uint64_t(1) << (bucketCount - 1);
+}
+
+void CScanMetrics::reset()
+{
+	for (size_t i = 0; i < shardCount; i++)
+	{
+		for (auto& counter : m_shards[i].counters)
+			counter.store(0, std::memory_order_relaxed);
+		for (auto& timer : m_shards[i].timers)
+		{
+			timer.count.store(0, std::memory_order_relaxed);
+			timer.totalNs.store(0, std::memory_order_relaxed);
+			for (auto& bucket : timer.buckets)
+				bucket.store(0, std::memory_order_relaxed);
+		}
+	}
+}
+
+const char* CScanMetrics::name(ECounter counter)
+{
+	return counterNames[counter];
+}
+
+const char* CScanMetrics::name(ETimer timer)
+{
+	return timerNames[timer];
+}
+
+std::string CScanMetrics::toJson() const
+{
+	std::ostringstream json;
+	json << "{\n  \"counters\": {";
+	for (size_t c = 0; c < counterCount; c++)
+	{
+		json << (c ? "," : "") << "\n    \"" << counterNames[c] << "\": " << counter(static_cast<ECounter>(c));
+	}
+	json << "\n  },\n  \"timers\": {";
+	for (size_t t = 0; t < timerCount; t++)
+	{
+		CHistogram h = histogram(static_cast<ETimer>(t));
+		json << (t ? "," : "") << "\n    \"" << timerNames[t] << "\": {"
+			<< "\"count\": " << h.count
+			<< ", \"total_ns\": " << h.totalNs
+			<< ", \"mean_ns\": " << (h.count ? h.totalNs / h.count : 0)
+			<< ", \"p50_ns\": " << h.percentileNs(50)
+			<< ", \"p90_ns\": " << h.percentileNs(90)
+			<< ", \"p99_ns\": " << h.percentileNs(99)
+			<< ", \"buckets\": [";
+		// [upper bound in ns, count] of the buckets which are not empty
+		bool first = true;
+		for (size_t b = 0; b < bucketCount; b++)
+		{
+			if (h.buckets[b] == 0)
+				continue;
+			json << (first ? "" : ", ") << "[" << (uint64_t(1) << b) << ", " << h.buckets[b] << "]";
+			first = false;
+		}
+		json << "]}";
+	}
+	json << "\n  }\n}\n";
+	return json.str();
+}
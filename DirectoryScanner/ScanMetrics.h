@@ -0,0 +1,132 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+//! Counters and latency histograms of a scan.
+//! Every thread updates its own cache-line aligned shard with relaxed atomic operations, so the
+//! metrics can stay enabled during parallel scans. Reading sums the shards and may be done while
+//! the scan is running; the values of one read are not a consistent snapshot.
+class CScanMetrics
+{
+public:
+	enum ECounter
+	{
+		counterDirectories,	//!< directories visited
+		counterDirectoriesPruned,	//!< directories not entered because of the pruning rules, on other file systems or seen before
+		counterFilesMatched,	//!< files and archive members matching the file specifications
+		counterFilesSkipped,	//!< files and archive members not matching the file specifications
+		counterBytesHashed,	//!< bytes read to calculate crcs
+		counterMembersListed,	//!< archive members reported by the archive backend
+		counterMembersExtracted,	//!< archive members decompressed
+		counterArchiveParts,	//!< parts of archives read by separate archive workers
+		counterTempBytesWritten,	//!< bytes written to temporary files
+		counterMemoryBytesWritten,	//!< bytes written to memory files
+		counterDedupHits,	//!< files and members skipped as duplicates
+		counterErrors,	//!< errors reported
+		counterCount
+	};
+
+	enum ETimer
+	{
+		timerEnumerate,	//!< opening a directory or reading its next entry
+		timerCrc32,	//!< calculate_crc32 of one file
+		timerArchiveList,	//!< reading the member list of one archive
+		timerArchiveExtract,	//!< decompressing the selected members of one archive
+		timerProcessFile,	//!< one call of process_file or process_stream, or adding an entry to a batch
+		timerEntryFeed,	//!< the consumer of entries() looking at one entry, until it asks for the next
+		timerCount
+	};
+
+	//! bucket i counts the durations below 2^i ns
+	static const size_t bucketCount = 48;
+
+	struct CHistogram
+	{
+		uint64_t count = 0;
+		uint64_t totalNs = 0;
+		std::array<uint64_t, bucketCount> buckets = {};
+
+		//! upper bound of the bucket containing the p-th percentile, 0 <= p <= 100
+		uint64_t percentileNs(double p) const;
+	};
+
+	CScanMetrics();
+	~CScanMetrics();
+
+	CScanMetrics(const CScanMetrics&) = delete;
+	CScanMetrics& operator=(const CScanMetrics&) = delete;
+
+	void add(ECounter counter, uint64_t value = 1);
+	void record(ETimer timer, std::chrono::steady_clock::duration duration);
+
+	uint64_t counter(ECounter counter) const;
+	CHistogram histogram(ETimer timer) const;
+
+	//! set everything to 0. Not to be called while the metrics are updated.
+	void reset();
+
+	//! {"counters": {"directories": n, ...}, "timers": {"enumerate": {"count": n, "total_ns": n, "p50_ns": n, ...}, ...}}
+	std::string toJson() const;
+
+	static const char* name(ECounter counter);
+	static const char* name(ETimer timer);
+
+	//! records the time from its construction to its destruction
+	class CScopedTimer
+	{
+	public:
+		CScopedTimer(CScanMetrics& metrics, ETimer timer)
+			: m_metrics(metrics)
+			, m_timer(timer)
+			, m_start(std::chrono::steady_clock::now())
+		{}
+		~CScopedTimer()
+		{
+			m_metrics.record(m_timer, std::chrono::steady_clock::now() - m_start);
+		}
+
+		CScopedTimer(const CScopedTimer&) = delete;
+		CScopedTimer& operator=(const CScopedTimer&) = delete;
+
+	private:
+		CScanMetrics& m_metrics;
+		ETimer m_timer;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+private:
+	struct CShard;
+	CShard& shard();
+
+	static const size_t shardCount = 16;
+	std::unique_ptr<CShard[]> m_shards;
+};
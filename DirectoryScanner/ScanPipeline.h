@@ -0,0 +1,288 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Blocking FIFO with a fixed capacity. push blocks while the queue is full, pop while it is empty.
+template<class T>
+class CBoundedQueue
+{
+public:
+	explicit CBoundedQueue(size_t capacity)
+		: m_capacity(capacity > 0 ? capacity : 1)
+		, m_closed(false)
+		, m_maxDepth(0)
+	{}
+
+	//! returns false if the queue has been closed
+	bool push(T&& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+		if (m_closed) return false;
+		m_items.push_back(std::move(item));
+		if (m_items.size() > m_maxDepth) m_maxDepth = m_items.size();
+		lock.unlock();
+		m_notEmpty.notify_one();
+		return true;
+	}
+
+	//! returns false once the queue is closed and empty
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+		if (m_items.empty()) return false;
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		lock.unlock();
+		m_notFull.notify_one();
+		return true;
+	}
+
+	//! no more items will be pushed. Items already queued are still handed out by pop.
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_closed = true;
+		}
+		m_notEmpty.notify_all();
+		m_notFull.notify_all();
+	}
+
+	size_t capacity() const { return m_capacity; }
+
+	size_t depth() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_items.size();
+	}
+
+	size_t maxDepth() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_maxDepth;
+	}
+
+private:
+	const size_t m_capacity;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_notEmpty;
+	std::condition_variable m_notFull;
+	std::deque<T> m_items;
+	bool m_closed;
+	size_t m_maxDepth;
+};
+
+//! Snapshot of the counters of one pipeline stage. Times are summed over all workers of the stage.
+struct CPipelineStageStats
+{
+	std::string name;
+	unsigned int workers = 0;
+	uint64_t items = 0;	//!< items taken from the input queue
+	uint64_t errors = 0;	//!< items whose processing threw
+	double busySeconds = 0;	//!< time spent processing items, excluding blocked pushes
+	double blockedSeconds = 0;	//!< time spent waiting for room in the next queue (backpressure)
+	double idleSeconds = 0;	//!< time spent waiting for input
+	size_t queueCapacity = 0;	//!< capacity of the input queue, 0 for the source stage
+	size_t queueDepth = 0;	//!< current number of queued input items
+	size_t maxQueueDepth = 0;
+};
+
+//! Chain of stages connected by bounded queues. Every stage has its own worker threads.
+//! A stage function takes one item and passes zero or more items on to the next stage through emit.
+//! The first stage is the source: it runs once on the calling thread of run().
+template<class T>
+class CPipeline
+{
+public:
+	typedef std::function<void(T&&)> Emit;
+	typedef std::function<void(T& item, const Emit& emit)> StageFunction;
+	typedef std::function<void(const Emit& emit)> SourceFunction;
+
+	explicit CPipeline(size_t queueCapacity)
+		: m_queueCapacity(queueCapacity)
+	{}
+
+	void addStage(const std::string& name, unsigned int workers, StageFunction function)
+	{
+		auto stage = std::make_unique<CStage>(name, workers > 0 ? workers : 1, m_queueCapacity);
+		stage->function = std::move(function);
+		m_stages.push_back(std::move(stage));
+	}
+
+	//! run the source on the calling thread and block until all stages have drained
+	void run(const std::string& sourceName, SourceFunction source)
+	{
+		m_sourceName = sourceName;
+		for (size_t i = 0; i < m_stages.size(); i++)
+		{
+			CStage& stage = *m_stages[i];
+			stage.active = stage.workers;
+			for (unsigned int w = 0; w < stage.workers; w++)
+				stage.threads.emplace_back(&CPipeline::workerLoop, this, i);
+		}
+
+		std::exception_ptr error;
+		int64_t sourceBlocked = 0;
+		auto start = Clock::now();
+		try {
+			if (m_stages.empty())
+				source([](T&&) {});
+			else
+				source(blockingEmit(m_stages.front().get(), sourceBlocked));
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		m_sourceBlocked = sourceBlocked;
+		m_sourceBusy = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() - sourceBlocked;
+
+		if (!m_stages.empty())
+			m_stages.front()->queue.close();
+		for (auto& stage : m_stages)
+		{
+			for (auto& t : stage->threads)
+				t.join();
+			stage->threads.clear();
+		}
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	//! counters of the source and of all stages. May be called while run() is executing;
+	//! the source counters are updated when it has finished.
+	std::vector<CPipelineStageStats> stats() const
+	{
+		std::vector<CPipelineStageStats> result;
+		CPipelineStageStats source;
+		source.name = m_sourceName;
+		source.workers = 1;
+		source.busySeconds = m_sourceBusy * 1e-9;
+		source.blockedSeconds = m_sourceBlocked * 1e-9;
+		result.push_back(source);
+
+		for (const auto& stage : m_stages)
+		{
+			CPipelineStageStats s;
+			s.name = stage->name;
+			s.workers = stage->workers;
+			s.items = stage->items;
+			s.errors = stage->errors;
+			s.busySeconds = stage->busy * 1e-9;
+			s.blockedSeconds = stage->blocked * 1e-9;
+			s.idleSeconds = stage->idle * 1e-9;
+			s.queueCapacity = stage->queue.capacity();
+			s.queueDepth = stage->queue.depth();
+			s.maxQueueDepth = stage->queue.maxDepth();
+			result.push_back(s);
+		}
+		return result;
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct CStage
+	{
+		CStage(const std::string& pName, unsigned int pWorkers, size_t capacity)
+			: name(pName), workers(pWorkers), queue(capacity)
+		{}
+
+		std::string name;
+		unsigned int workers;
+		CBoundedQueue<T> queue;	//!< input of this stage
+		StageFunction function;
+		std::vector<std::thread> threads;
+		std::atomic<unsigned int> active{ 0 };
+		std::atomic<uint64_t> items{ 0 };
+		std::atomic<uint64_t> errors{ 0 };
+		std::atomic<int64_t> busy{ 0 };
+		std::atomic<int64_t> blocked{ 0 };
+		std::atomic<int64_t> idle{ 0 };
+	};
+
+	//! emitter into stage which adds the time spent waiting for room to blocked
+	static Emit blockingEmit(CStage* stage, int64_t& blocked)
+	{
+		return [stage, &blocked](T&& item) {
+			auto start = Clock::now();
+			stage->queue.push(std::move(item));
+			blocked += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+		};
+	}
+
+	void workerLoop(size_t index)
+	{
+		CStage& stage = *m_stages[index];
+		CStage* next = index + 1 < m_stages.size() ? m_stages[index + 1].get() : nullptr;
+		int64_t itemBlocked = 0;
+		Emit emit = next ? blockingEmit(next, itemBlocked) : Emit([](T&&) {});
+
+		for (;;)
+		{
+			T item;
+			auto waitStart = Clock::now();
+			if (!stage.queue.pop(item)) break;
+			auto start = Clock::now();
+			stage.idle += std::chrono::duration_cast<std::chrono::nanoseconds>(start - waitStart).count();
+			stage.items++;
+
+			itemBlocked = 0;
+			try {
+				stage.function(item, emit);
+			}
+			catch (...)
+			{
+				stage.errors++;
+			}
+			int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+			stage.blocked += itemBlocked;
+			stage.busy += elapsed - itemBlocked;
+		}
+
+		// the last worker of a stage closes the input of the next stage
+		if (--stage.active == 0 && next)
+			next->queue.close();
+	}
+
+	size_t m_queueCapacity;
+	std::string m_sourceName;
+	std::atomic<int64_t> m_sourceBusy{ 0 };
+	std::atomic<int64_t> m_sourceBlocked{ 0 };
+	std::vector<std::unique_ptr<CStage>> m_stages;
+};
@@ -0,0 +1,175 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "SevenZipArchiveReader.h"
+#include "MemberSource.h"
+#include "ScanMetrics.h"
+
+#include <7zpp/7zpp.h>
+
+#include <chrono>
+#include <stdexcept>
+
+namespace
+{
+	//! seconds since 1970, 0 for an unset time
+	int64_t toUnixTime(const FILETIME& ft)
+	{
+		const uint64_t ticks = (static_cast<uint64_t>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+		if (ticks == 0)
+			return 0;
+		// FILETIME counts 100 ns intervals since 1601
+		return static_cast<int64_t>(ticks / 10000000) - 11644473600LL;
+	}
+
+	SevenZip::CompressionFormat::_Enum compressionFormat(EArchiveFormat format)
+	{
+		switch (format) {
+		case fmtZip: return SevenZip::CompressionFormat::Zip;
+		case fmt7z: return SevenZip::CompressionFormat::SevenZip;
+		case fmtTar: return SevenZip::CompressionFormat::Tar;
+		case fmtGzip: return SevenZip::CompressionFormat::GZip;
+		case fmtXz: return SevenZip::CompressionFormat::XZ;
+		case fmtBzip2: return SevenZip::CompressionFormat::BZip2;
+		case fmtCab: return SevenZip::CompressionFormat::Cab;
+		default:
+			throw std::logic_error(std::string("Unknown format: ") + CFormatDetector::name(format));
+		}
+	}
+
+	class ListCallBackOutput : public SevenZip::ListCallback
+	{
+	public:
+		ListCallBackOutput(std::vector<CArchiveMember>& members)
+			: m_members(members)
+		{}
+
+		virtual void OnFileFound(const SevenZip::intl::FileInfo& fileInfo) override
+		{
+			CArchiveMember member;
+			member.name = fileInfo.FileName;
+			member.size = fileInfo.Size;
+			member.crc = fileInfo.crc;
+			member.isDirectory = fileInfo.IsDirectory;
+			member.mtime = toUnixTime(fileInfo.LastWriteTime);
+			// archives created on unix keep the mode in the high word of the attributes
+			if (fileInfo.Attributes & 0x8000)
+				member.mode = (fileInfo.Attributes >> 16) & 07777;
+			m_members.push_back(member);
+		}
+
+		std::vector<CArchiveMember>& m_members;
+	};
+
+	//! 7-Zip polls OnCheckBreak while extracting and aborts with E_ABORT once the flag is set
+	class CCancelCallback : public SevenZip::ProgressCallback
+	{
+	public:
+		CCancelCallback(const std::atomic<bool>* cancel)
+			: m_cancel(cancel)
+		{}
+
+		virtual bool OnCheckBreak() override
+		{
+			return m_cancel && *m_cancel;
+		}
+
+	private:
+		const std::atomic<bool>* m_cancel;
+	};
+}
+
+CSevenZipArchiveReader::CSevenZipArchiveReader(const std::string& dllPath)
+	: m_7zlib(std::make_unique<SevenZip::SevenZipLibrary>())
+{
+	if (!m_7zlib->Load(dllPath))
+		throw std::runtime_error("Error loading 7z.dll from " + dllPath);
+}
+
+CSevenZipArchiveReader::~CSevenZipArchiveReader()
+{
+}
+
+std::vector<CArchiveMember> CSevenZipArchiveReader::list(const std::filesystem::path& archivePath, EArchiveFormat format)
+{
+	SevenZip::SevenZipLister lister(*m_7zlib, archivePath.string());
+	lister.SetCompressionFormat(compressionFormat(format));
+
+	std::vector<CArchiveMember> members;
+	ListCallBackOutput myListCallBack(members);
+	lister.ListArchive("", (SevenZip::ListCallback*) & myListCallBack);
+	return members;
+}
+
+void CSevenZipArchiveReader::extract(const std::filesystem::path& archivePath, EArchiveFormat format,
+	const std::vector<unsigned int>& indices, const std::filesystem::path& dir)
+{
+	SevenZip::SevenZipExtractor extractor(*m_7zlib, archivePath.string());
+	extractor.SetCompressionFormat(compressionFormat(format));
+	CCancelCallback callback(m_cancel);
+	extractor.ExtractFilesFromArchive(indices.data(), static_cast<unsigned int>(indices.size()), dir.string(), &callback);
+}
+
+void CSevenZipArchiveReader::stream(const std::filesystem::path& archivePath, EArchiveFormat format,
+	const Select& select, const Consume& consume)
+{
+	// select all members first, then extract them in a single pass.
+	// Extracting member by member restarts decompression for every member of solid archives.
+	auto start = std::chrono::steady_clock::now();
+	std::vector<CArchiveMember> members = list(archivePath, format);
+	if (m_metrics)
+		m_metrics->record(CScanMetrics::timerArchiveList, std::chrono::steady_clock::now() - start);
+	std::vector<unsigned int> selected;
+	for (unsigned int i = 0; i < members.size(); i++)
+	{
+		if (!members[i].isDirectory && select(i, members[i]))
+			selected.push_back(i);
+	}
+	if (selected.empty())
+		return;
+
+	// shared, because the members may be consumed after stream has returned
+	auto tempDir = std::make_shared<CTempDirectory>(m_tempDirectory.empty()
+		? CTempDirectory::uniquePath() : CTempDirectory::uniquePath(m_tempDirectory));
+	start = std::chrono::steady_clock::now();
+	extract(archivePath, format, selected, tempDir->path());
+	if (cancelled())
+		return;
+	if (m_metrics) {
+		m_metrics->record(CScanMetrics::timerArchiveExtract, std::chrono::steady_clock::now() - start);
+		uint64_t extractedBytes = 0;
+		for (unsigned int index : selected)
+			extractedBytes += members[index].size;
+		m_metrics->add(CScanMetrics::counterTempBytesWritten, extractedBytes);
+	}
+
+	// the indices are ascending, so members are consumed in archive order
+	for (unsigned int index : selected)
+	{
+		if (cancelled())
+			return;
+		CFileMemberSource source(tempDir->path() / members[index].name, tempDir);
+		consume(index, members[index], source);
+	}
+}
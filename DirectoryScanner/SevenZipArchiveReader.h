@@ -0,0 +1,51 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#pragma once
+
+#include "ArchiveReader.h"
+
+namespace SevenZip {
+	class SevenZipLibrary;
+}
+
+//! Archive backend using 7z.dll through 7zip-cpp.
+//! 7z.dll extracts into directories only, so stream() extracts the selected members into
+//! a temporary directory in one pass and hands them out as files.
+class CSevenZipArchiveReader : public CArchiveReader
+{
+public:
+	//! loads 7z.dll, throws std::runtime_error if that fails
+	explicit CSevenZipArchiveReader(const std::string& dllPath);
+	virtual ~CSevenZipArchiveReader();
+
+	virtual std::string name() const override { return "7z"; }
+	virtual std::vector<CArchiveMember> list(const std::filesystem::path& archivePath, EArchiveFormat format) override;
+	virtual void extract(const std::filesystem::path& archivePath, EArchiveFormat format,
+		const std::vector<unsigned int>& indices, const std::filesystem::path& dir) override;
+	virtual void stream(const std::filesystem::path& archivePath, EArchiveFormat format,
+		const Select& select, const Consume& consume) override;
+
+private:
+	std::unique_ptr<SevenZip::SevenZipLibrary> m_7zlib;
+};
@@ -0,0 +1,112 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+
+#include "pch.h"
+#include "StorageDevice.h"
+
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <winioctl.h>
+#else
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+#endif
+
+#ifdef _WIN32
+namespace {
+	//! mount point of the volume holding p, e.g. "C:\", empty if it can't be determined
+	std::wstring volumeOf(const std::filesystem::path& p)
+	{
+		wchar_t volume[MAX_PATH + 1];
+		std::error_code ec;
+		std::filesystem::path absolute = std::filesystem::absolute(p, ec);
+		if (ec || !GetVolumePathNameW(absolute.c_str(), volume, MAX_PATH + 1))
+			return std::wstring();
+		return volume;
+	}
+}
+#endif
+
+uint64_t CStorageDevice::id(const std::filesystem::path& p)
+{
+#ifdef _WIN32
+	std::wstring volume = volumeOf(p);
+	DWORD serialNumber = 0;
+	if (volume.empty() || !GetVolumeInformationW(volume.c_str(), nullptr, 0, &serialNumber, nullptr, nullptr, nullptr, 0))
+		return 0;
+	return serialNumber;
+#else
+	struct stat st;
+	if (::stat(p.c_str(), &st) != 0)
+		return 0;
+	return static_cast<uint64_t>(st.st_dev);
+#endif
+}
+
+bool CStorageDevice::isRotational(const std::filesystem::path& p)
+{
+#ifdef _WIN32
+	std::wstring volume = volumeOf(p);
+	if (volume.empty() || GetDriveTypeW(volume.c_str()) != DRIVE_FIXED)
+		return false;
+	// "C:\" -> "\\.\C:"
+	if (volume.back() == L'\\')
+		volume.pop_back();
+	HANDLE device = CreateFileW((L"\\\\.\\" + volume).c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr);
+	if (device == INVALID_HANDLE_VALUE)
+		return false;
+	STORAGE_PROPERTY_QUERY query = {};
+	query.PropertyId = StorageDeviceSeekPenaltyProperty;
+	query.QueryType = PropertyStandardQuery;
+	DEVICE_SEEK_PENALTY_DESCRIPTOR seekPenalty = {};
+	DWORD size = 0;
+	BOOL ok = DeviceIoControl(device, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), &seekPenalty, sizeof(seekPenalty), &size, nullptr);
+	CloseHandle(device);
+	return ok && size >= sizeof(seekPenalty) && seekPenalty.IncursSeekPenalty;
+#elif defined(__linux__)
+	struct stat st;
+	if (::stat(p.c_str(), &st) != 0 || major(st.st_dev) == 0)
+		return false;	// network and other virtual file systems have no block device
+	// partitions have no queue of their own, it is in the directory of the disk above them
+	std::error_code ec;
+	std::filesystem::path block = std::filesystem::canonical("/sys/dev/block/" + std::to_string(major(st.st_dev)) + ":" + std::to_string(minor(st.st_dev)), ec);
+	if (ec)
+		return false;
+	for (const std::filesystem::path& dir : { block, block.parent_path() }) {
+		std::ifstream ifs(dir / "queue" / "rotational");
+		int rotational;
+		if (ifs >> rotational)
+			return rotational != 0;
+	}
+	return false;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,143 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#include "pch.h"
+#include "WorkStealingPool.h"
+
+namespace {
+	thread_local CWorkStealingPool* currentPool = nullptr;
+	thread_local size_t currentWorker = 0;
+}
+
+CWorkStealingPool::CWorkStealingPool(unsigned int threadCount)
+	: m_pending(0)
+	, m_queued(0)
+	, m_sleeping(0)
+	, m_nextWorker(0)
+	, m_stop(false)
+{
+	if (threadCount == 0) threadCount = 1;
+	for (unsigned int i = 0; i < threadCount; i++)
+		m_workers.push_back(std::make_unique<CWorker>());
+	for (size_t i = 0; i < m_workers.size(); i++)
+		m_workers[i]->thread = std::thread(&CWorkStealingPool::workerLoop, this, i);
+}
+
+CWorkStealingPool::~CWorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_workAvailable.notify_all();
+	for (auto& worker : m_workers)
+		worker->thread.join();
+}
+
+void CWorkStealingPool::submit(Task task)
+{
+	m_pending++;
+	const size_t target = currentPool == this ? currentWorker : m_nextWorker++ % m_workers.size();
+	{
+		CWorker& worker = *m_workers[target];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(std::move(task));
+		m_queued++;
+	}
+	// A worker going to sleep counts itself in m_sleeping before it checks m_queued, under m_mutex:
+	// either it sees the task, or we see it and wake it once it waits.
+	if (m_sleeping > 0) {
+		{ std::lock_guard<std::mutex> lock(m_mutex); }
+		m_workAvailable.notify_one();
+	}
+}
+
+void CWorkStealingPool::wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_allDone.wait(lock, [this] { return m_pending == 0; });
+	if (m_error) {
+		std::exception_ptr error = m_error;
+		m_error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+bool CWorkStealingPool::popOrSteal(size_t index, Task& task)
+{
+	{
+		CWorker& own = *m_workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			m_queued--;
+			return true;
+		}
+	}
+	for (size_t i = 1; i < m_workers.size(); i++)
+	{
+		CWorker& victim = *m_workers[(index + i) % m_workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			m_queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void CWorkStealingPool::workerLoop(size_t index)
+{
+	currentPool = this;
+	currentWorker = index;
+
+	for (;;)
+	{
+		Task task;
+		if (!popOrSteal(index, task)) {
+			// sleep until a task is queued, which may have happened since the deques were looked at
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_sleeping++;
+			m_workAvailable.wait(lock, [this] { return m_stop || m_queued > 0; });
+			m_sleeping--;
+			if (m_stop) return;
+			continue;
+		}
+
+		try {
+			task();
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_error) m_error = std::current_exception();
+		}
+
+		if (--m_pending == 0) {
+			{ std::lock_guard<std::mutex> lock(m_mutex); }
+			m_allDone.notify_all();
+		}
+	}
+}
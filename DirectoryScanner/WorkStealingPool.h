@@ -0,0 +1,83 @@
+//MIT License
+//
+//Copyright(c) 2017-2024 m1bcodes
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy
+//of this software and associated documentation files(the "Software"), to deal
+//in the Software without restriction, including without limitation the rights
+//to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+//copies of the Software, and to permit persons to whom the Software is
+//furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all
+//copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+//AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+//SOFTWARE.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! Fixed size thread pool with one task deque per worker.
+//! A worker pushes the tasks it creates onto its own deque and pops them from the back (depth first).
+//! An idle worker steals from the front of the other deques, which holds the oldest and usually
+//! largest pieces of work. Submitting and picking up a task lock only the deque concerned, the
+//! pool mutex is taken to put idle workers to sleep and wake them up.
+class CWorkStealingPool
+{
+public:
+	typedef std::function<void()> Task;
+
+	explicit CWorkStealingPool(unsigned int threadCount);
+	~CWorkStealingPool();
+
+	CWorkStealingPool(const CWorkStealingPool&) = delete;
+	CWorkStealingPool& operator=(const CWorkStealingPool&) = delete;
+
+	//! queue a task. Tasks submitted from a worker go to the deque of that worker.
+	void submit(Task task);
+
+	//! block until all tasks, including the tasks submitted by tasks, are done.
+	//! Rethrows the first exception which escaped a task.
+	void wait();
+
+	unsigned int threadCount() const { return static_cast<unsigned int>(m_workers.size()); }
+
+private:
+	struct CWorker
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::thread thread;
+	};
+
+	void workerLoop(size_t index);
+	bool popOrSteal(size_t index, Task& task);
+
+	std::vector<std::unique_ptr<CWorker>> m_workers;
+
+	std::atomic<size_t> m_pending;	//!< tasks submitted but not finished
+	std::atomic<size_t> m_queued;	//!< tasks waiting in a deque, changed with the lock of the deque held
+	std::atomic<size_t> m_sleeping;	//!< workers waiting for m_workAvailable
+	std::atomic<size_t> m_nextWorker;	//!< round robin target for tasks submitted from outside
+
+	std::mutex m_mutex;	//!< protects the members below, and is held to notify the condition variables
+	std::condition_variable m_workAvailable;
+	std::condition_variable m_allDone;
+	bool m_stop;
+	std::exception_ptr m_error;
+};
@@ -23,11 +23,57 @@
 
 #include "pch.h"
 #include "DirectoryScannerMock.h"
+#include "MemberSource.h"
+#include "DirEnumerator.h"
 #include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+    //! enumerator failing to read the first directory it opens after a number of entries
+    class CFailingDirEnumerator : public CDirEnumerator
+    {
+    public:
+        CFailingDirEnumerator(std::unique_ptr<CDirEnumerator> inner, size_t failAfter)
+            : m_inner(std::move(inner)), m_failAfter(failAfter), m_root(nullptr), m_entries(0)
+        {}
+
+        virtual std::unique_ptr<CDirHandle> open(const std::filesystem::path& dirPath, const CDirHandle* parent) override
+        {
+            std::unique_ptr<CDirHandle> dir = m_inner->open(dirPath, parent);
+            if (!m_root)
+                m_root = dir.get();
+            return dir;
+        }
+
+        virtual bool next(CDirHandle& dir, CDirEntry& entry) override
+        {
+            if (&dir == m_root && ++m_entries > m_failAfter)
+                throw std::runtime_error("read error");
+            return m_inner->next(dir, entry);
+        }
+
+        virtual bool stat(CDirHandle& dir, const CDirEntry& entry, CFileStat& st) override { return m_inner->stat(dir, entry, st); }
+        virtual const char* name() const override { return "failing"; }
+
+    private:
+        std::unique_ptr<CDirEnumerator> m_inner;
+        size_t m_failAfter;
+        const CDirHandle* m_root;
+        size_t m_entries;
+    };
+}
 
 void CDirectoryScannerMock::process_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc)
 {
     std::cout << "processFile: path:" << p << ", filename: " << logicalFilename << ", crc: " << crc << "\n";
+    if (!namesRoot.empty()) {
+        std::lock_guard<std::mutex> lock(scannedFileInfoMutex);
+        names.push_back(std::filesystem::relative(logicalFilename, namesRoot).generic_string());
+        return;
+    }
     FileRecord fr;
     fr.path = p.string();
     fr.logicalFilename = logicalFilename.string();
@@ -64,5 +110,50 @@ void CDirectoryScannerMock::process_file(const std::filesystem::path& p, const s
         fr.fileNo = std::atoi(matchName[0].str().c_str());
     }
 
+    std::lock_guard<std::mutex> lock(scannedFileInfoMutex);
+    scannedFileInfo.push_back(fr);
+}
+
+void CDirectoryScannerMock::process_change(const std::filesystem::path& p, EChange change)
+{
+    std::cout << "processChange: path:" << p << ", change: " << change << "\n";
+    std::lock_guard<std::mutex> lock(scannedFileInfoMutex);
+    changes.push_back({ p.filename().string(), change });
+}
+
+std::vector<std::string> CDirectoryScannerMock::parseOptions(const std::string& options)
+{
+    std::istringstream args(options);
+    return parseCommandLineArguments({ std::istream_iterator<std::string>(args), std::istream_iterator<std::string>() });
+}
+
+std::unique_ptr<CDirEnumerator> CDirectoryScannerMock::createEnumerator()
+{
+    std::unique_ptr<CDirEnumerator> enumerator = CDirectoryScanner::createEnumerator();
+    if (failRootAfter == 0)
+        return enumerator;
+    return std::make_unique<CFailingDirEnumerator>(std::move(enumerator), failRootAfter);
+}
+
+void CDirectoryScannerStreamMock::process_stream(CMemberSource& source, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size)
+{
+    std::cout << "processStream: filename: " << logicalFilename << ", crc: " << crc << ", size: " << size << "\n";
+    FileRecord fr;
+    fr.logicalFilename = logicalFilename.string();
+    fr.crc = crc;
+
+    std::string line;
+    std::getline(source.stream(), line);
+    std::regex re("\\d+");
+    std::smatch matchContent;
+    ASSERT_TRUE(std::regex_search(line, matchContent, re)) << "File content is '" << line << "'";
+
+    std::smatch matchName;
+    std::string filename = logicalFilename.filename().string();
+    ASSERT_TRUE(std::regex_search(filename, matchName, re));
+    EXPECT_EQ(matchContent[0], matchName[0]);
+
+    fr.fileNo = std::atoi(matchName[0].str().c_str());
+    std::lock_guard<std::mutex> lock(scannedFileInfoMutex);
     scannedFileInfo.push_back(fr);
 }
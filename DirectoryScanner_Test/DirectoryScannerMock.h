@@ -25,6 +25,7 @@
 
 #include <regex>
 #include <filesystem>
+#include <mutex>
 
 class CDirectoryScannerMock :
     public CDirectoryScanner
@@ -41,6 +42,11 @@ public:
     virtual ~CDirectoryScannerMock() = default;
 
     virtual void process_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc) override;
+    virtual void process_change(const std::filesystem::path& p, EChange change) override;
+    virtual std::unique_ptr<CDirEnumerator> createEnumerator() override;
+
+    //! parse command line options given in one string, separated by white space
+    std::vector<std::string> parseOptions(const std::string& options);
 
     void listFilesFound(std::filesystem::path startPath) const
     {
@@ -59,6 +65,13 @@ public:
         int fileNo;
     };
     std::vector<FileRecord> scannedFileInfo;
+    std::mutex scannedFileInfoMutex;    //!< process_file is called concurrently when scanning with threads
+    std::vector<std::pair<std::string, EChange>> changes;   //!< reported with --index, protected by scannedFileInfoMutex
+    size_t failRootAfter = 0;   //!< reading the root directory fails after this many entries, 0 never
+    //! if set, the logical names of the files relative to namesRoot are collected in names instead of
+    //! checking the files against the naming scheme of the test directory
+    std::filesystem::path namesRoot;
+    std::vector<std::string> names;     //!< protected by scannedFileInfoMutex
 
     void testNoZip(bool nozip)
     {
@@ -86,3 +99,14 @@ public:
     }
 };
 
+//! mock which consumes archive members through the streaming interface
+class CDirectoryScannerStreamMock :
+    public CDirectoryScannerMock
+{
+public:
+    CDirectoryScannerStreamMock(bool nozip, bool crcCheck, const std::vector<std::string>& filespecs, const std::vector<std::string>& excludeFilespecs)
+        : CDirectoryScannerMock(nozip, crcCheck, filespecs, excludeFilespecs)
+    {}
+
+    virtual void process_stream(CMemberSource& source, const std::filesystem::path& logicalFilename, crc_t crc, uint64_t size) override;
+};
@@ -24,6 +24,32 @@
 #include "pch.h"
 
 #include "DirectoryScannerMock.h"
+#include "FileNameMatcher.h"
+#include "DirEnumerator.h"
+#include "Crc32.h"
+#include "FileReader.h"
+#include "DuplicateDetector.h"
+#include "DedupStore.h"
+#include "ArchiveReader.h"
+#include "FormatDetector.h"
+#include "Logger.h"
+#include "MemberSource.h"
+#include "ScanMetrics.h"
+#include "PathFilter.h"
+#include "FilePredicate.h"
+#include "InodeSet.h"
+#include "ArchiveScheduler.h"
+#include "StorageDevice.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include <boost/crc.hpp>
 
 const char* testDir = R"(..\Test)";
 
@@ -99,6 +125,22 @@ TEST(DirectoryScanner, With_Archives_Without_CRC_check)
   ASSERT_EQ(cds.scannedFileInfo.size(), 44);
 }
 
+TEST(DirectoryScanner, With_Archives_Streaming)
+{
+	CDirectoryScannerStreamMock cds(false, false, { ".*" }, { "" });
+	std::filesystem::path startPath = testDir;
+	cds.scanPath(startPath.string());
+
+	size_t streamed = 0;
+	for (const auto& fr : cds.scannedFileInfo)
+	{
+		if (fr.path.empty()) streamed++;
+	}
+
+	ASSERT_EQ(cds.scannedFileInfo.size(), 44);
+	ASSERT_EQ(streamed, 37);
+}
+
 TEST(DirectoryScanner, Without_Archives_Without_CRC_check)
 {
 	CDirectoryScannerMock cds(true, false, { ".*" }, { "" });
@@ -133,6 +175,67 @@ TEST(DirectoryScanner, With_Archives_With_CRC_check)
 	ASSERT_EQ(cds.scannedFileInfo.size(), 16);
 }
 
+TEST(DirectoryScanner, Parallel_With_Archives_Without_CRC_check)
+{
+	CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+	cds.parseCommandLineArguments({ "--threads", "4" });
+	std::filesystem::path startPath = testDir;
+	cds.scanPath(startPath.string());
+
+	ASSERT_EQ(cds.scannedFileInfo.size(), 44);
+}
+
+TEST(DirectoryScanner, Parallel_With_Archives_With_CRC_check)
+{
+	CDirectoryScannerMock cds(false, true, { ".*" }, { "" });
+	cds.parseCommandLineArguments({ "-j", "4" });
+	std::filesystem::path startPath = testDir;
+	cds.scanPath(startPath.string());
+
+	std::set<CDirectoryScanner::crc_t> crcs;
+	for (const auto& fr : cds.scannedFileInfo)
+	{
+		ASSERT_TRUE(crcs.insert(fr.crc).second);
+	}
+
+	ASSERT_EQ(cds.scannedFileInfo.size(), 16);
+}
+
+TEST(DirectoryScanner, Pipelined_With_Archives_Without_CRC_check)
+{
+	CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+	cds.parseCommandLineArguments({ "--pipeline", "--hash-workers", "2", "--consume-workers", "3", "--queue-size", "2" });
+	std::filesystem::path startPath = testDir;
+	cds.scanPath(startPath.string());
+
+	ASSERT_EQ(cds.scannedFileInfo.size(), 44);
+
+	auto stats = cds.pipelineStats();
+	ASSERT_EQ(stats.size(), 5);
+	ASSERT_EQ(stats[0].name, "enumerate");
+	ASSERT_EQ(stats[4].name, "consume");
+	ASSERT_EQ(stats[4].workers, 3);
+	ASSERT_EQ(stats[4].items, 44);
+	ASSERT_EQ(stats[4].errors, 0);
+	ASSERT_LE(stats[4].maxQueueDepth, 2);
+}
+
+TEST(DirectoryScanner, Pipelined_With_Archives_With_CRC_check)
+{
+	CDirectoryScannerMock cds(false, true, { ".*" }, { "" });
+	cds.parseCommandLineArguments({ "--pipeline", "--hash-workers", "2", "--extract-workers", "2" });
+	std::filesystem::path startPath = testDir;
+	cds.scanPath(startPath.string());
+
+	std::set<CDirectoryScanner::crc_t> crcs;
+	for (const auto& fr : cds.scannedFileInfo)
+	{
+		ASSERT_TRUE(crcs.insert(fr.crc).second);
+	}
+
+	ASSERT_EQ(cds.scannedFileInfo.size(), 16);
+}
+
 TEST(DirectoryScanner, IncludePattern)
 {
 	CDirectoryScannerMock cds(false, true, { "file_[0246]\\..*" }, { "" });
@@ -159,3 +262,1085 @@ TEST(DirectoryScanner, ExcludePattern)
 	ASSERT_EQ(cds.scannedFileInfo.size(), 4);
 }
 
+TEST(DirectoryScanner, FileNameMatcher)
+{
+	CFileNameMatcher matcher;
+	matcher.compile({ "file_[0246]\\..*", ".*\\.tar\\.gz", "Readme.TXT", ".*\\.txt", ".*", "" });
+
+	ASSERT_EQ(matcher.find("file_2.txt"), 0);	// regex precedes the suffix pattern
+	ASSERT_EQ(matcher.find("file_3.txt"), 3);
+	ASSERT_EQ(matcher.find("FILE_3.TXT"), 3);
+	ASSERT_EQ(matcher.find("a.TAR.gz"), 1);
+	ASSERT_EQ(matcher.find("readme.txt"), 2);
+	ASSERT_EQ(matcher.find("a.gz"), 4);
+
+	matcher.compile({ "" });
+	ASSERT_FALSE(matcher.matches("file_0.txt"));
+
+	matcher.compile({ ".*\\.zip", "\\d+" });
+	ASSERT_TRUE(matcher.matches(".zip"));
+	ASSERT_TRUE(matcher.matches("123"));
+	ASSERT_FALSE(matcher.matches("a.zip.txt"));
+}
+
+TEST(DirectoryScanner, DirEnumerators)
+{
+	auto listing = [](CDirEnumerator& enumerator, const std::filesystem::path& dirPath) {
+		std::set<std::pair<std::string, bool>> entries;
+		auto dir = enumerator.open(dirPath, nullptr);
+		CDirEntry entry;
+		while (enumerator.next(*dir, entry))
+		{
+			if (entry.isFile() || entry.isDirectory())
+				entries.insert({ entry.name, entry.isDirectory() });
+		}
+		return entries;
+	};
+
+	auto stdEnumerator = CDirEnumerator::create("std");
+	auto nativeEnumerator = CDirEnumerator::create("native");
+	for (const char* subdir : { "", "subdir_1", "archives" })
+	{
+		std::filesystem::path dirPath = std::filesystem::path(testDir) / subdir;
+		auto entries = listing(*stdEnumerator, dirPath);
+		ASSERT_FALSE(entries.empty());
+		ASSERT_EQ(entries, listing(*nativeEnumerator, dirPath));
+	}
+	ASSERT_THROW(CDirEnumerator::create("unknown"), std::invalid_argument);
+}
+
+TEST(DirectoryScanner, Crc32Kernels)
+{
+	// lengths around the 16 and 64 byte block sizes of the folding kernel, at odd offsets
+	std::vector<unsigned char> data(70000);
+	for (size_t i = 0; i < data.size(); i++)
+		data[i] = static_cast<unsigned char>(i * 7919 + (i >> 8));
+
+	for (CCrc32::EKernel kernel : { CCrc32::kernelReference, CCrc32::kernelSlicing16, CCrc32::kernelPclmul })
+	{
+		if (!CCrc32::isSupported(kernel))
+			continue;
+		for (size_t offset : { 0, 1, 3 })
+		{
+			for (size_t len : { 0, 1, 15, 16, 17, 63, 64, 65, 127, 128, 1000, 65536, 69000 })
+			{
+				boost::crc_32_type reference;
+				reference.process_bytes(data.data() + offset, len);
+				ASSERT_EQ(reference.checksum(), CCrc32::compute(data.data() + offset, len, kernel)) << CCrc32::kernelName(kernel) << " " << len;
+			}
+		}
+
+		// incremental updates must give the same result as a single call
+		CCrc32 crc(kernel);
+		crc.process_bytes(data.data(), 100);
+		crc.process_bytes(data.data() + 100, 5000);
+		crc.process_bytes(data.data() + 5100, data.size() - 5100);
+		ASSERT_EQ(CCrc32::compute(data.data(), data.size(), CCrc32::kernelReference), crc.checksum());
+	}
+	ASSERT_EQ(0xcbf43926u, CCrc32::compute("123456789", 9));
+}
+
+TEST(DirectoryScanner, FileReader)
+{
+	auto readAll = [](CFileReader& reader) {
+		std::string contents;
+		const char* data;
+		size_t size;
+		while (reader.next(data, size))
+			contents.append(data, size);
+		return contents;
+	};
+
+	std::filesystem::path filePath = std::filesystem::temp_directory_path() / "DirectoryScanner_FileReader.bin";
+	std::string expected;
+	for (int i = 0; i < 3000; i++)
+		expected += "line " + std::to_string(i) + "\n";
+	std::ofstream(filePath, std::ios::binary) << expected;
+
+	// buffered below the threshold, in chunks or mapped above it
+	for (size_t mapThreshold : { size_t(1) << 20, size_t(4096) })
+	{
+		for (bool stable : { false, true })
+		{
+			CFileReader reader(mapThreshold);
+			reader.open(filePath, stable);
+			ASSERT_EQ(expected.size(), reader.size());
+#ifdef _WIN32
+			ASSERT_EQ(mapThreshold < expected.size(), reader.isMapped());
+#else
+			ASSERT_EQ(stable && mapThreshold < expected.size(), reader.isMapped());
+#endif
+			const char* head;
+			ASSERT_EQ(512, reader.head(head, 512));
+			ASSERT_EQ(expected.substr(0, 512), std::string(head, 512));
+			ASSERT_EQ(expected, readAll(reader));
+			ASSERT_EQ("", readAll(reader));
+			reader.rewind();
+			ASSERT_EQ(expected, readAll(reader));
+			ASSERT_EQ(512, reader.head(head, 512));
+			ASSERT_EQ(expected.substr(0, 512), std::string(head, 512));
+			// the tail, without moving the position of next()
+			reader.rewind();
+			ASSERT_EQ(100, reader.read(expected.size() - 100, head, 512));
+			ASSERT_EQ(expected.substr(expected.size() - 100), std::string(head, 100));
+			ASSERT_EQ(expected, readAll(reader));
+			reader.close();
+			ASSERT_FALSE(reader.isOpen());
+		}
+	}
+
+	// files changing after they have been opened are read as they are when they are read
+	{
+		CFileReader reader(4096);
+		std::ofstream(filePath, std::ios::binary) << expected.substr(0, 100);
+		reader.open(filePath);
+		ASSERT_EQ(100, reader.size());
+		std::ofstream(filePath, std::ios::binary | std::ios::app) << expected.substr(100);
+		ASSERT_EQ(expected, readAll(reader));
+		ASSERT_EQ(expected.size(), reader.size());
+
+		reader.open(filePath);
+		std::filesystem::resize_file(filePath, 5000);
+		ASSERT_EQ(expected.substr(0, 5000), readAll(reader));
+		ASSERT_EQ(5000, reader.size());
+	}
+	std::filesystem::remove(filePath);
+
+	CFileReader reader;
+	ASSERT_THROW(reader.open(filePath), std::runtime_error);
+}
+
+TEST(DirectoryScanner, ScanIndex)
+{
+	std::filesystem::path workDir = std::filesystem::temp_directory_path() / "DirectoryScanner_ScanIndex";
+	std::filesystem::remove_all(workDir);
+	std::filesystem::path treeDir = workDir / "tree";
+	std::filesystem::create_directories(workDir);
+	std::filesystem::copy(testDir, treeDir, std::filesystem::copy_options::recursive);
+	std::string indexFile = (workDir / "scan.idx").string();
+
+	auto countChanges = [](const CDirectoryScannerMock& cds, CDirectoryScanner::EChange change) {
+		return std::count_if(cds.changes.begin(), cds.changes.end(), [change](const auto& c) { return c.second == change; });
+	};
+
+	{
+		CDirectoryScannerMock cds(false, true, { ".*" }, { "" });
+		cds.parseCommandLineArguments({ "--index", indexFile });
+		cds.scanPath(treeDir);
+		ASSERT_EQ(16, cds.scannedFileInfo.size());
+		// 7 text files and 6 archives on disk
+		ASSERT_EQ(13, countChanges(cds, CDirectoryScanner::changeAdded));
+		ASSERT_EQ(13, cds.changes.size());
+	}
+	{
+		// nothing changed: neither files nor archives are processed again
+		CDirectoryScannerMock cds(false, true, { ".*" }, { "" });
+		cds.parseCommandLineArguments({ "--index", indexFile });
+		cds.scanPath(treeDir);
+		ASSERT_EQ(0, cds.scannedFileInfo.size());
+		ASSERT_EQ(0, cds.changes.size());
+	}
+
+	std::filesystem::remove(treeDir / "file_0.txt");
+	std::ofstream(treeDir / "file_1.txt", std::ios::app) << "modified\r\n";
+	std::ofstream(treeDir / "subdir_2" / "file_8.txt", std::ios::binary) << "This is file 8\r\n";
+	{
+		CDirectoryScannerMock cds(false, true, { ".*" }, { "" });
+		cds.parseCommandLineArguments({ "--index", indexFile });
+		cds.scanPath(treeDir);
+		ASSERT_EQ(2, cds.scannedFileInfo.size());
+		ASSERT_EQ(3, cds.changes.size());
+		ASSERT_EQ(1, countChanges(cds, CDirectoryScanner::changeAdded));
+		ASSERT_EQ(1, countChanges(cds, CDirectoryScanner::changeModified));
+		ASSERT_EQ(1, countChanges(cds, CDirectoryScanner::changeRemoved));
+	}
+	std::filesystem::remove_all(workDir);
+}
+
+TEST(DirectoryScanner, DuplicateDetector)
+{
+	std::filesystem::path workDir = std::filesystem::temp_directory_path() / "DirectoryScanner_DuplicateDetector";
+	std::filesystem::remove_all(workDir);
+	std::filesystem::create_directories(workDir);
+	auto writeFile = [&workDir](const char* name, const std::string& contents) {
+		std::ofstream(workDir / name, std::ios::binary) << contents;
+		return workDir / name;
+	};
+
+	std::string base(20000, 'x');
+	std::string middle = base;
+	middle[10000] = 'y';
+	std::string front = base;
+	front[0] = 'y';
+
+	CDuplicateDetector detector;
+	ASSERT_TRUE(detector.addFile(writeFile("unique.txt", std::string(100, 'u')), 100));
+	ASSERT_TRUE(detector.addFile(writeFile("base.txt", base), base.size()));
+	ASSERT_TRUE(detector.addFile(writeFile("middle.txt", middle), middle.size()));
+	ASSERT_FALSE(detector.addFile(writeFile("copy.txt", base), base.size()));
+	ASSERT_TRUE(detector.addFile(writeFile("front.txt", front), front.size()));
+
+	// the file with a unique size is never read, samples decide unless they collide
+	CDuplicateDetector::CStats stats = detector.stats();
+	ASSERT_EQ(5, stats.files);
+	ASSERT_EQ(1, stats.duplicates);
+	ASSERT_EQ(4, stats.sampleHashes);
+	ASSERT_EQ(3, stats.fullHashes);
+
+	// members without data are compared by size and crc
+	ASSERT_TRUE(detector.addMember({}, 100, 0x1234));
+	ASSERT_TRUE(detector.hasMember(100, 0x1234));
+	ASSERT_FALSE(detector.hasMember(100, 0x4321));
+	ASSERT_FALSE(detector.addMember({}, 100, 0x1234));
+	ASSERT_FALSE(detector.addMember(writeFile("member.txt", middle), middle.size(), CCrc32::compute(middle.data(), middle.size())));
+
+	// members without crc, e.g. of tar archives, are compared by their contents while they are added
+	std::string tarMember(300, 't');
+	ASSERT_TRUE(detector.addMember(writeFile("tar1.txt", tarMember), tarMember.size(), 0));
+	std::filesystem::remove(workDir / "tar1.txt");
+	ASSERT_FALSE(detector.addMember(writeFile("tar2.txt", tarMember), tarMember.size(), 0));
+	ASSERT_FALSE(detector.addFile(writeFile("tar3.txt", tarMember), tarMember.size()));
+
+	// two copies of an archive whose members have no crc deliver the members once
+	std::filesystem::path tarDir = workDir / "tars";
+	std::filesystem::create_directories(tarDir);
+	std::filesystem::copy_file(std::filesystem::path(testDir) / "archives" / "test2.tar", tarDir / "a.tar");
+	std::filesystem::copy_file(std::filesystem::path(testDir) / "archives" / "test2.tar", tarDir / "b.tar");
+	for (const char* option : { "--dedup", "--checkcrc" })
+	{
+		CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+		cds.parseCommandLineArguments({ option });
+		cds.scanPath(tarDir);
+		ASSERT_EQ(7, cds.scannedFileInfo.size()) << option;
+	}
+
+	std::filesystem::remove_all(workDir);
+}
+
+TEST(DirectoryScanner, With_Archives_With_Dedup)
+{
+	CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+	cds.parseCommandLineArguments({ "--dedup" });
+	cds.scanPath(testDir);
+	ASSERT_EQ(16, cds.scannedFileInfo.size());
+	ASSERT_EQ(cds.duplicateDetector()->stats().files - cds.duplicateDetector()->stats().duplicates, 16);
+
+	CDirectoryScannerMock parallel(false, false, { ".*" }, { "" });
+	parallel.parseCommandLineArguments({ "--dedup", "--threads", "4" });
+	parallel.scanPath(testDir);
+	ASSERT_EQ(16, parallel.scannedFileInfo.size());
+}
+
+TEST(DirectoryScanner, DedupStore)
+{
+	CDedupStore store(4);
+	ASSERT_TRUE(store.insert(0));
+	ASSERT_FALSE(store.insert(0));
+	ASSERT_TRUE(store.contains(0));
+	ASSERT_FALSE(store.contains(1));
+
+	// every key is inserted by all threads, exactly one of them must succeed
+	const uint64_t keyCount = 100000;
+	std::atomic<uint64_t> inserted(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&store, &inserted, t, keyCount]() {
+			for (uint64_t i = 1; i <= keyCount; i++)
+			{
+				uint64_t key = (t % 2 ? i : keyCount + 1 - i) * 0x9e3779b9;
+				if (store.insert(key))
+					inserted++;
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+
+	ASSERT_EQ(keyCount, inserted);
+	ASSERT_EQ(keyCount + 1, store.size());
+	ASSERT_TRUE(store.contains(keyCount * 0x9e3779b9));
+	store.clear();
+	ASSERT_EQ(0, store.size());
+	ASSERT_FALSE(store.contains(0));
+}
+
+TEST(DirectoryScanner, ArchiveBackends)
+{
+	ASSERT_THROW(CArchiveReader::create("unknown", ""), std::invalid_argument);
+
+	for (const char* backend : { "7z", "libarchive" })
+	{
+		if (!CArchiveReader::isAvailable(backend))
+			continue;
+
+		CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+		cds.parseCommandLineArguments({ "--archive-backend", backend });
+		cds.scanPath(testDir);
+		ASSERT_EQ(44, cds.scannedFileInfo.size()) << backend;
+
+		CDirectoryScannerMock crc(false, true, { ".*" }, { "" });
+		crc.parseCommandLineArguments({ "--archive-backend", backend });
+		crc.scanPath(testDir);
+		ASSERT_EQ(16, crc.scannedFileInfo.size()) << backend;
+
+		CDirectoryScannerStreamMock streaming(false, false, { ".*" }, { "" });
+		streaming.parseCommandLineArguments({ "--archive-backend", backend });
+		streaming.scanPath(testDir);
+		ASSERT_EQ(44, streaming.scannedFileInfo.size()) << backend;
+
+		// the members of the tar archive in their archive order, without directories
+		std::unique_ptr<CArchiveReader> reader = CArchiveReader::create(backend, "7z.dll");
+		std::vector<CArchiveMember> members = reader->list(std::filesystem::path(testDir) / "archives" / "test2.tar", fmtTar);
+		size_t files = 0;
+		for (const auto& member : members)
+		{
+			if (!member.isDirectory) files++;
+		}
+		ASSERT_EQ(7, files) << backend;
+	}
+}
+
+TEST(DirectoryScanner, NestedArchives)
+{
+	// test2.tgz contains test2.tar, subdir_z.zip contains subdir_z2.zip
+	CDirectoryScannerMock shallow(false, false, { ".*" }, { "" });
+	shallow.parseCommandLineArguments({ "--max-archive-depth", "1" });
+	shallow.scanPath(testDir);
+	ASSERT_EQ(33, shallow.scannedFileInfo.size());
+
+	CDirectoryScannerMock limited(false, false, { ".*" }, { "" });
+	limited.parseCommandLineArguments({ "--max-expanded-bytes", "40" });
+	limited.scanPath(testDir);
+	ASSERT_EQ(16, limited.scannedFileInfo.size());
+
+	if (!CArchiveReader::isAvailable("libarchive"))
+		return;
+	// the tar inside the tgz is read from the decompressed stream
+	std::unique_ptr<CArchiveReader> reader = CArchiveReader::create("libarchive", "");
+	size_t nestedMembers = 0;
+	reader->stream(std::filesystem::path(testDir) / "archives" / "test2.tgz", fmtGzip,
+		[](unsigned int, const CArchiveMember&) { return true; },
+		[&](unsigned int, const CArchiveMember& member, CMemberSource& source) {
+			ASSERT_EQ(member.name, "test2.tar");
+			ASSERT_TRUE(source.filePath().empty());
+			ASSERT_TRUE(reader->streamNested(source, member.size, member.name, fmtTar,
+				[](unsigned int, const CArchiveMember&) { return true; },
+				[&](unsigned int, const CArchiveMember&, CMemberSource&) { nestedMembers++; }));
+		});
+	ASSERT_EQ(7, nestedMembers);
+}
+
+TEST(DirectoryScanner, FormatDetector)
+{
+	ASSERT_EQ(fmtZip, CFormatDetector::detect("PK\x03\x04\x14\0", 6));
+	ASSERT_EQ(fmt7z, CFormatDetector::detect("7z\xbc\xaf\x27\x1c\0\x04", 8));
+	ASSERT_EQ(fmtGzip, CFormatDetector::detect("\x1f\x8b\x08\0", 4));
+	ASSERT_EQ(fmtBzip2, CFormatDetector::detect("BZh91AY&SY", 10));
+	ASSERT_EQ(fmtXz, CFormatDetector::detect("\xfd" "7zXZ\0\0\x04", 8));
+	ASSERT_EQ(fmtCab, CFormatDetector::detect("MSCF\0\0\0\0\x10", 9));
+	ASSERT_EQ(fmtNone, CFormatDetector::detect("BZh0", 4));
+	ASSERT_EQ(fmtNone, CFormatDetector::detect("PK", 2));
+	ASSERT_EQ(fmtNone, CFormatDetector::detect("", 0));
+
+	std::string tar(512, '\0');
+	tar.replace(257, 6, "ustar");
+	ASSERT_EQ(fmtTar, CFormatDetector::detect(tar.data(), tar.size()));
+	ASSERT_EQ(fmtNone, CFormatDetector::detect(tar.data(), 260));
+}
+
+TEST(DirectoryScanner, ArchivesDetectedByContents)
+{
+	std::filesystem::path workDir = std::filesystem::temp_directory_path() / "DirectoryScanner_Formats";
+	std::filesystem::remove_all(workDir);
+	std::filesystem::create_directories(workDir);
+	std::filesystem::copy_file(std::filesystem::path(testDir) / "archives" / "test2.zip", workDir / "misnamed.dat");
+	std::filesystem::copy_file(std::filesystem::path(testDir) / "archives" / "test2.tar", workDir / "noextension");
+	std::ofstream(workDir / "fake_99.zip") << "This is file 99\r\n";
+
+	// the members of both archives and fake_99.zip as a file
+	CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+	cds.scanPath(workDir);
+	ASSERT_EQ(15, cds.scannedFileInfo.size());
+
+	CDirectoryScannerMock pipelined(false, false, { ".*" }, { "" });
+	pipelined.parseCommandLineArguments({ "--pipeline" });
+	pipelined.scanPath(workDir);
+	ASSERT_EQ(15, pipelined.scannedFileInfo.size());
+
+	// fake_99.zip is no archive: a file if it is read, an archive which can't be opened by name
+	CDirectoryScannerMock sniffed(false, false, { ".*\\.zip" }, { "" });
+	sniffed.scanPath(workDir);
+	ASSERT_EQ(1, sniffed.scannedFileInfo.size());
+
+	// archives without an extension are opened whatever the file specifications, containers selected
+	// by a file specification are files: the members of noextension, misnamed.dat as a file
+	for (const char* options : { "", "--pipeline" })
+	{
+		CDirectoryScannerMock members(false, false, { ".*\\.txt" }, { "" });
+		members.parseOptions(options);
+		members.scanPath(workDir);
+		ASSERT_EQ(7, members.scannedFileInfo.size()) << options;
+
+		CDirectoryScannerMock container(false, false, { ".*\\.dat" }, { "" });
+		container.parseOptions(options);
+		container.namesRoot = workDir;
+		container.scanPath(workDir);
+		ASSERT_EQ(std::vector<std::string>({ "misnamed.dat" }), container.names) << options;
+	}
+
+	CDirectoryScannerMock byName(false, false, { ".*\\.zip" }, { "" });
+	byName.parseCommandLineArguments({ "--trust-extension" });
+	byName.scanPath(workDir);
+	ASSERT_EQ(0, byName.scannedFileInfo.size());
+
+	// unchanged files are skipped by the index before their heads are read
+	std::filesystem::path indexDir = std::filesystem::temp_directory_path() / "DirectoryScanner_FormatsIndex";
+	std::filesystem::remove_all(indexDir);
+	std::filesystem::create_directories(indexDir);
+	for (const char* mode : { "--threads=0", "--pipeline" })
+	{
+		std::string indexFile = (indexDir / (std::string(mode + 2) + ".idx")).string();
+		std::ostringstream out, err;
+		auto logger = std::make_shared<CLogger>(out, err);
+		for (int pass = 0; pass < 2; pass++)
+		{
+			out.str("");
+			CDirectoryScannerMock indexed(false, false, { ".*" }, { "" });
+			indexed.setLogger(logger);
+			indexed.parseCommandLineArguments({ "--index", indexFile, "--verbose", mode });
+			indexed.scanPath(workDir);
+			logger->flush();
+			ASSERT_EQ(pass == 0 ? 15 : 0, indexed.scannedFileInfo.size()) << mode;
+			ASSERT_EQ(pass == 0, out.str().find("detected as") != std::string::npos) << mode;
+		}
+	}
+	std::filesystem::remove_all(indexDir);
+
+	std::filesystem::remove_all(workDir);
+}
+
+TEST(DirectoryScanner, Logger)
+{
+	std::ostringstream out, err;
+	{
+		// a small ring buffer makes the writing threads wait for the writer
+		CLogger logger(out, err, 16);
+		CLogLine(logger, levelError, 0) << "error " << std::hex << 255;
+		CLogLine(logger, levelInfo, 2) << "info " << 255;
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; t++)
+		{
+			threads.emplace_back([&logger, t]() {
+				for (int i = 0; i < 1000; i++)
+					CLogLine(logger, levelDebug, 0) << "thread " << t << " line " << i;
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		logger.flush();
+		ASSERT_EQ("error ff\n", err.str());
+	}
+	std::istringstream lines(out.str());
+	std::string line;
+	std::getline(lines, line);
+	ASSERT_EQ("    info 255", line);
+	std::vector<int> next(4, 0);
+	while (std::getline(lines, line))
+	{
+		int t, i;
+		ASSERT_EQ(2, sscanf(line.c_str(), "thread %d line %d", &t, &i)) << line;
+		// the lines of one thread keep their order
+		ASSERT_EQ(next[t]++, i);
+	}
+	ASSERT_EQ(std::vector<int>(4, 1000), next);
+
+	// the levels are filtered by the scanner
+	auto logger = std::make_shared<CLogger>(out, err);
+	for (const char* verbosity : { "--quiet", "--verbose" })
+	{
+		out.str("");
+		CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+		cds.setLogger(logger);
+		cds.parseCommandLineArguments({ verbosity });
+		cds.scanPath(testDir);
+		ASSERT_EQ(std::string(verbosity) == "--verbose", out.str().find("Entry 0") != std::string::npos) << verbosity;
+		ASSERT_EQ(std::string(verbosity) == "--verbose", out.str().find("searching archive") != std::string::npos) << verbosity;
+	}
+}
+
+TEST(DirectoryScanner, ScanMetrics)
+{
+	CScanMetrics metrics;
+	metrics.add(CScanMetrics::counterBytesHashed, 100);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&metrics]() {
+			for (int i = 0; i < 1000; i++)
+			{
+				metrics.add(CScanMetrics::counterFilesMatched);
+				metrics.record(CScanMetrics::timerCrc32, std::chrono::nanoseconds(i < 900 ? 100 : 100000));
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	ASSERT_EQ(100, metrics.counter(CScanMetrics::counterBytesHashed));
+	ASSERT_EQ(4000, metrics.counter(CScanMetrics::counterFilesMatched));
+	CScanMetrics::CHistogram crc32 = metrics.histogram(CScanMetrics::timerCrc32);
+	ASSERT_EQ(4000, crc32.count);
+	ASSERT_EQ(4 * (900 * 100 + 100 * 100000), crc32.totalNs);
+	ASSERT_EQ(128, crc32.percentileNs(50));
+	ASSERT_EQ(131072, crc32.percentileNs(99));
+
+	for (const char* options : { "", "--threads 4", "--pipeline" })
+	{
+		CDirectoryScannerMock cds(false, true, { ".*" }, { "" });
+		cds.parseOptions(options);
+		cds.scanPath(testDir);
+		const CScanMetrics& scan = cds.metrics();
+		ASSERT_EQ(5, scan.counter(CScanMetrics::counterDirectories)) << options;
+		ASSERT_EQ(16, scan.histogram(CScanMetrics::timerProcessFile).count) << options;
+		ASSERT_EQ(0, scan.counter(CScanMetrics::counterErrors)) << options;
+		// 16 unique files and 28 duplicates on disk and in archives, the 8 archives themselves
+		ASSERT_EQ(52, scan.counter(CScanMetrics::counterFilesMatched)) << options;
+		ASSERT_EQ(28, scan.counter(CScanMetrics::counterDedupHits)) << options;
+		ASSERT_EQ(39, scan.counter(CScanMetrics::counterMembersListed)) << options;
+		ASSERT_EQ(8, scan.histogram(CScanMetrics::timerArchiveList).count) << options;
+	}
+
+	CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+	std::filesystem::path metricsPath = std::filesystem::temp_directory_path() / "DirectoryScanner_metrics.json";
+	cds.parseCommandLineArguments({ "--metrics", metricsPath.string() });
+	cds.scanPath(testDir);
+	std::ifstream ifs(metricsPath);
+	std::string json((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+	ifs.close();
+	std::filesystem::remove(metricsPath);
+	ASSERT_NE(std::string::npos, json.find("\"directories\": 5,"));
+	for (const char* timer : { "enumerate", "crc32", "archive_list", "archive_extract", "process_file", "entry_feed" })
+		ASSERT_NE(std::string::npos, json.find(std::string("\"") + timer + "\": {\"count\": ")) << timer;
+}
+
+TEST(DirectoryScanner, Entries)
+{
+	CDirectoryScannerMock reference(false, false, { ".*" }, { "" });
+	reference.scanPath(testDir);
+
+	CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+	std::vector<std::string> logicalFilenames;
+	size_t streamed = 0;
+	for (const CScanEntry& entry : cds.entries(testDir))
+	{
+		std::string line;
+		if (entry.isMember()) {
+			std::getline(entry.source->stream(), line);
+			if (entry.path.empty())
+				streamed++;
+		}
+		else {
+			std::ifstream ifs(entry.path);
+			std::getline(ifs, line);
+		}
+		// the number in the contents is the number in the name
+		std::regex number("\\d+");
+		std::smatch inContents, inName;
+		std::string filename = entry.logicalFilename.filename().string();
+		ASSERT_TRUE(std::regex_search(line, inContents, number)) << line;
+		ASSERT_TRUE(std::regex_search(filename, inName, number)) << filename;
+		ASSERT_EQ(inName[0], inContents[0]) << entry.logicalFilename;
+		logicalFilenames.push_back(entry.logicalFilename.string());
+	}
+	// the files come in the order of a sequential scan
+	ASSERT_EQ(44, logicalFilenames.size());
+	ASSERT_EQ(37, streamed);
+	// the time of the loop body is measured apart from process_file
+	ASSERT_EQ(44, cds.metrics().histogram(CScanMetrics::timerEntryFeed).count);
+	ASSERT_EQ(0, cds.metrics().histogram(CScanMetrics::timerProcessFile).count);
+	for (size_t i = 0; i < logicalFilenames.size(); i++)
+		ASSERT_EQ(reference.scannedFileInfo[i].logicalFilename, logicalFilenames[i]);
+	ASSERT_TRUE(cds.scannedFileInfo.empty());
+
+	// stopping early, inside an archive as well
+	for (size_t stopAfter : { 1, 10, 30 })
+	{
+		size_t count = 0;
+		for ([[maybe_unused]] const CScanEntry& entry : cds.entries(testDir))
+		{
+			if (++count == stopAfter)
+				break;
+		}
+		ASSERT_EQ(stopAfter, count);
+		// the archive being read stops at the cancel flag, without an error and before extracting further members
+		ASSERT_EQ(0, cds.metrics().counter(CScanMetrics::counterErrors)) << stopAfter;
+		ASSERT_GE(stopAfter, cds.metrics().counter(CScanMetrics::counterMembersExtracted)) << stopAfter;
+	}
+
+	CDirectoryScannerMock crcCheck(false, true, { ".*" }, { "" });
+	CScanRange range = crcCheck.entries(testDir);
+	ASSERT_EQ(16, std::distance(range.begin(), range.end()));
+	ASSERT_THROW(range.begin(), std::logic_error);
+	ASSERT_THROW(crcCheck.entries(testDir), std::logic_error);
+}
+
+TEST(DirectoryScanner, ProcessBatch)
+{
+	//! collects the batches, checking that every file can still be read
+	class CBatchScanner : public CDirectoryScannerMock
+	{
+	public:
+		using CDirectoryScannerMock::CDirectoryScannerMock;
+
+		virtual void process_batch(std::span<const CBatchEntry> entries) override
+		{
+			std::lock_guard<std::mutex> lock(scannedFileInfoMutex);
+			batchSizes.push_back(entries.size());
+			for (const CBatchEntry& entry : entries)
+			{
+				std::filesystem::path p(entry.path);
+				EXPECT_TRUE(std::filesystem::is_regular_file(p)) << p;
+				EXPECT_EQ(entry.member, p.string().find("Test") == std::string::npos) << p;
+				logicalFilenames.push_back(std::filesystem::path(entry.logicalFilename).string());
+			}
+		}
+
+		std::vector<size_t> batchSizes;
+		std::vector<std::string> logicalFilenames;
+	};
+
+	for (const char* options : { "", "--threads 4", "--pipeline --consume-workers 2" })
+	{
+		CBatchScanner cds(false, false, { ".*" }, { "" });
+		cds.parseOptions(std::string("--batch-size 5 ") + options);
+		cds.scanPath(testDir);
+		ASSERT_EQ(44, cds.logicalFilenames.size()) << options;
+		ASSERT_EQ(9, cds.batchSizes.size()) << options;
+		for (size_t size : cds.batchSizes)
+			ASSERT_LE(size, 5) << options;
+		ASSERT_TRUE(cds.scannedFileInfo.empty());
+	}
+
+	// a batch is passed on when the interval has passed
+	CBatchScanner interval(false, false, { ".*" }, { "" });
+	interval.parseCommandLineArguments({ "--batch-size", "100", "--batch-interval", "0" });
+	interval.scanPath(testDir);
+	ASSERT_EQ(std::vector<size_t>(44, 1), interval.batchSizes);
+
+	// by default the batches are passed on to process_file
+	CDirectoryScannerMock cds(false, true, { ".*" }, { "" });
+	cds.parseCommandLineArguments({ "--batch-size", "7" });
+	cds.scanPath(testDir);
+	ASSERT_EQ(16, cds.scannedFileInfo.size());
+
+	// reading the root fails: the files accepted before are still passed on
+	std::filesystem::path workDir = std::filesystem::temp_directory_path() / "DirectoryScanner_BatchError";
+	std::filesystem::remove_all(workDir);
+	std::filesystem::create_directories(workDir);
+	for (int i = 0; i < 10; i++)
+		std::ofstream(workDir / ("file_" + std::to_string(i) + ".txt"), std::ios::binary) << "This is file " << i << "\r\n";
+	CDirectoryScannerMock failing(false, false, { ".*" }, { "" });
+	failing.failRootAfter = 6;
+	failing.parseCommandLineArguments({ "--batch-size", "100" });
+	ASSERT_THROW(failing.scanPath(workDir), std::runtime_error);
+	ASSERT_EQ(6, failing.scannedFileInfo.size());
+	std::filesystem::remove_all(workDir);
+
+	CScanBatch batch;
+	batch.add("a/b", "x/a/b", 1, 0);
+	batch.add("c", "x/c", 2, 3);
+	std::span<const CBatchEntry> entries = batch.entries();
+	ASSERT_EQ(2, entries.size());
+	ASSERT_EQ(std::filesystem::path("a/b").native(), entries[0].path);
+	ASSERT_EQ(std::filesystem::path("x/c").native(), entries[1].logicalFilename);
+	ASSERT_EQ(3, entries[1].size);
+	batch.clear();
+	ASSERT_TRUE(batch.empty());
+}
+
+TEST(DirectoryScanner, PruningRules)
+{
+	auto scan = [](CDirectoryScannerMock& cds, const std::string& options) {
+		cds.parseOptions(options);
+		cds.scanPath(testDir);
+	};
+	for (const char* options : { "", " --threads 4", " --pipeline" })
+	{
+		// directories are pruned on disk and in archives
+		CDirectoryScannerMock excluded(false, false, { ".*" }, { "" });
+		scan(excluded, std::string("--exclude-dir subdir_1 subdir_z_1") + options);
+		for (const auto& fr : excluded.scannedFileInfo)
+		{
+			std::filesystem::path logical(fr.logicalFilename);
+			ASSERT_EQ(logical.end(), std::find(logical.begin(), logical.end(), "subdir_1")) << fr.logicalFilename;
+			ASSERT_EQ(logical.end(), std::find(logical.begin(), logical.end(), "subdir_z_1")) << fr.logicalFilename;
+		}
+		ASSERT_EQ(27, excluded.scannedFileInfo.size()) << options;
+		ASSERT_EQ(1, excluded.metrics().counter(CScanMetrics::counterDirectoriesPruned)) << options;
+		ASSERT_EQ(3, excluded.metrics().counter(CScanMetrics::counterDirectories)) << options;
+
+		CDirectoryScannerMock root(false, false, { ".*" }, { "" });
+		scan(root, std::string("--max-depth 0") + options);
+		ASSERT_EQ(3, root.scannedFileInfo.size()) << options;
+
+		// archive members count as levels below the directory of the archive
+		CDirectoryScannerMock shallow(false, false, { ".*" }, { "" });
+		scan(shallow, std::string("--max-depth 1") + options);
+		ASSERT_EQ(19, shallow.scannedFileInfo.size()) << options;
+
+		// archives are files too: only the ones below an included directory are opened
+		CDirectoryScannerMock included(false, false, { ".*" }, { "" });
+		scan(included, std::string("--include-dir subdir_1") + options);
+		ASSERT_EQ(3, included.scannedFileInfo.size()) << options;
+	}
+
+	ASSERT_TRUE(CIgnoreRules::globMatch("*.log", "x.log"));
+	ASSERT_FALSE(CIgnoreRules::globMatch("*.log", "a/x.log"));
+	ASSERT_TRUE(CIgnoreRules::globMatch("a/**/b", "a/b"));
+	ASSERT_TRUE(CIgnoreRules::globMatch("a/**/b", "a/x/y/b"));
+	ASSERT_TRUE(CIgnoreRules::globMatch("**/b", "b"));
+	ASSERT_TRUE(CIgnoreRules::globMatch("file_[0-3].?xt", "file_2.txt"));
+	ASSERT_FALSE(CIgnoreRules::globMatch("file_[!0-3].txt", "file_2.txt"));
+
+	std::filesystem::path workDir = std::filesystem::temp_directory_path() / "DirectoryScanner_Ignore";
+	std::filesystem::remove_all(workDir);
+	auto write = [&workDir](const std::string& name, const std::string& contents) {
+		std::filesystem::create_directories((workDir / name).parent_path());
+		std::ofstream(workDir / name, std::ios::binary) << contents;
+	};
+	write(".gitignore", "# build output\nbuild/\n*.log\n!keep.log\n/top.txt\n");
+	write("top.txt", "1");
+	write("a.txt", "2");
+	write("x.log", "3");
+	write("keep.log", "4");
+	write("build/b.txt", "5");
+	write("sub/.gitignore", "!x.log\n");
+	write("sub/top.txt", "6");
+	write("sub/x.log", "7");
+	write("sub/y.log", "8");
+	write("sub/build/c.txt", "9");
+	for (const char* options : { "", "--threads 4", "--pipeline" })
+	{
+		// the files don't follow the naming scheme of the test directory
+		CDirectoryScannerMock cds;
+		cds.namesRoot = workDir;
+		cds.parseOptions(std::string("--ignore-file .gitignore ") + options);
+		cds.scanPath(workDir);
+		std::sort(cds.names.begin(), cds.names.end());
+		ASSERT_EQ(std::vector<std::string>({ ".gitignore", "a.txt", "keep.log", "sub/.gitignore", "sub/top.txt", "sub/x.log" }), cds.names) << options;
+		ASSERT_EQ(2, cds.metrics().counter(CScanMetrics::counterDirectoriesPruned)) << options;
+	}
+	std::filesystem::remove_all(workDir);
+}
+
+TEST(DirectoryScanner, FilePredicates)
+{
+	ASSERT_EQ(1536, CFilePredicate::parseSize("1536"));
+	ASSERT_EQ(2048, CFilePredicate::parseSize("2k"));
+	ASSERT_EQ(uint64_t(3) << 20, CFilePredicate::parseSize("3MiB"));
+	ASSERT_EQ(86400, CFilePredicate::parseDuration("24h"));
+	ASSERT_EQ(90, CFilePredicate::parseDuration("90"));
+	ASSERT_THROW(CFilePredicate::parseSize("12q"), std::invalid_argument);
+	ASSERT_THROW(CFilePredicate::parseDuration("-1d"), std::invalid_argument);
+
+	// the text files in the test directory have 17 bytes, the ones with two digit numbers 18
+	for (const char* options : { "", " --threads 4", " --pipeline" })
+	{
+		CDirectoryScannerMock large(false, false, { ".*" }, { "" });
+		large.parseOptions(std::string("--min-size 18") + options);
+		large.scanPath(testDir);
+		ASSERT_FALSE(large.scannedFileInfo.empty()) << options;
+		for (const auto& fr : large.scannedFileInfo)
+			ASSERT_GE(fr.fileNo, 10) << fr.logicalFilename;
+	}
+
+	std::filesystem::path workDir = std::filesystem::temp_directory_path() / "DirectoryScanner_Predicates";
+	std::filesystem::remove_all(workDir);
+	std::filesystem::create_directories(workDir);
+	std::ofstream(workDir / "old.txt") << "old";
+	std::ofstream(workDir / "new.txt") << "new";
+	std::filesystem::last_write_time(workDir / "old.txt", std::filesystem::file_time_type::clock::now() - std::chrono::hours(48));
+	std::filesystem::permissions(workDir / "old.txt", std::filesystem::perms::owner_write, std::filesystem::perm_options::remove);
+
+	auto names = [&workDir](std::vector<std::string> arguments) {
+		CDirectoryScannerMock cds;
+		cds.namesRoot = workDir;
+		cds.parseCommandLineArguments(arguments);
+		cds.scanPath(workDir);
+		return std::set<std::string>(cds.names.begin(), cds.names.end());
+	};
+	for (const char* enumerator : { "std", "native" })
+	{
+		ASSERT_EQ(std::set<std::string>({ "new.txt" }), names({ "--enumerator", enumerator, "--max-age", "1d" })) << enumerator;
+		ASSERT_EQ(std::set<std::string>({ "old.txt" }), names({ "--enumerator", enumerator, "--min-age", "1d" })) << enumerator;
+		ASSERT_EQ(std::set<std::string>({ "new.txt" }), names({ "--enumerator", enumerator, "--perm", "200" })) << enumerator;
+		ASSERT_EQ(std::set<std::string>({ "new.txt", "old.txt" }), names({ "--enumerator", enumerator, "--type", "f", "--max-size", "3" })) << enumerator;
+		ASSERT_TRUE(names({ "--enumerator", enumerator, "--type", "l" }).empty()) << enumerator;
+	}
+	ASSERT_THROW(names({ "--type", "x" }), std::invalid_argument);
+
+	std::filesystem::permissions(workDir / "old.txt", std::filesystem::perms::owner_write, std::filesystem::perm_options::add);
+	std::filesystem::remove_all(workDir);
+}
+
+TEST(DirectoryScanner, FileIdentity)
+{
+	CInodeSet inodes;
+	ASSERT_TRUE(inodes.insert(1, 2));
+	ASSERT_FALSE(inodes.insert(1, 2));
+	ASSERT_TRUE(inodes.insert(2, 2));
+	// identities which don't fit into 64 bits
+	ASSERT_TRUE(inodes.insert(1, uint64_t(1) << 60));
+	ASSERT_FALSE(inodes.insert(1, uint64_t(1) << 60));
+	for (uint64_t device = 0; device < 2 * CInodeSet::maxDevices; device++)
+		ASSERT_TRUE(inodes.insert(device + 100, 7));
+	ASSERT_FALSE(inodes.insert(2 * CInodeSet::maxDevices + 99, 7));
+	ASSERT_EQ(3 + 2 * CInodeSet::maxDevices, inodes.size());
+
+#ifdef __linux__
+	std::filesystem::path workDir = std::filesystem::temp_directory_path() / "DirectoryScanner_Identity";
+	std::filesystem::remove_all(workDir);
+	std::filesystem::create_directories(workDir / "sub");
+	std::ofstream(workDir / "a.txt") << "a";
+	std::ofstream(workDir / "sub" / "b.txt") << "b";
+	std::filesystem::create_hard_link(workDir / "a.txt", workDir / "hard.txt");
+	std::filesystem::create_directory_symlink("..", workDir / "sub" / "loop");
+	std::filesystem::create_directory_symlink("sub", workDir / "link");
+
+	auto scan = [&workDir](const std::string& options) {
+		CDirectoryScannerMock cds;
+		cds.namesRoot = workDir;
+		cds.parseOptions(options);
+		cds.scanPath(workDir);
+		std::sort(cds.names.begin(), cds.names.end());
+		return cds.names;
+	};
+	for (const char* options : { "", " --threads 4", " --pipeline" })
+	{
+		// symlinked directories are not followed by default
+		ASSERT_EQ(std::vector<std::string>({ "a.txt", "hard.txt", "sub/b.txt" }), scan(options)) << options;
+
+		std::vector<std::string> unique = scan(std::string("--inode-dedup") + options);
+		ASSERT_EQ(2, unique.size()) << options;
+		ASSERT_EQ("sub/b.txt", unique[1]) << options;
+
+		// the loop back to the root is detected, b.txt is found through sub or link but not both
+		std::vector<std::string> followed = scan(std::string("--follow-symlinks") + options);
+		ASSERT_EQ(3, followed.size()) << options;
+		ASSERT_TRUE(followed[2] == "sub/b.txt" || followed[2] == "link/b.txt") << options;
+
+		ASSERT_EQ(2, scan(std::string("--xdev --follow-symlinks --inode-dedup") + options).size()) << options;
+	}
+	std::filesystem::remove_all(workDir);
+#endif
+}
+
+TEST(DirectoryScanner, MemoryFiles)
+{
+#ifdef __linux__
+	CFileReader reader;
+	std::filesystem::path firstPath;
+	{
+		CMemoryFile first("first");
+		first.write("0123456789", 10);
+		firstPath = first.path();
+		std::ifstream ifs(firstPath, std::ios::binary);
+		std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+		ASSERT_EQ("0123456789", content);
+		reader.open(firstPath);
+		ASSERT_TRUE(reader.holds(firstPath));
+		// the scanner closes its reader before a member is released
+		reader.close();
+	}
+	{
+		// the descriptor of the first file is reused: the reader must not deliver the old content
+		CMemoryFile second("second");
+		second.write("abc", 3);
+		ASSERT_EQ(firstPath, second.path());
+		ASSERT_FALSE(reader.holds(second.path()));
+		reader.open(second.path());
+		ASSERT_EQ(3, reader.size());
+	}
+#endif
+
+	std::filesystem::path tempDir = std::filesystem::temp_directory_path() / "DirectoryScanner_Spill";
+	std::filesystem::remove_all(tempDir);
+	std::filesystem::create_directories(tempDir);
+	auto scan = [](const std::string& options) {
+		CDirectoryScannerMock cds(false, true, { ".*" }, { "" });
+		cds.parseOptions(options);
+		cds.scanPath(testDir);
+		EXPECT_EQ(16, cds.scannedFileInfo.size()) << options;
+		const CScanMetrics& metrics = cds.metrics();
+		return std::make_pair(metrics.counter(CScanMetrics::counterMemoryBytesWritten), metrics.counter(CScanMetrics::counterTempBytesWritten));
+	};
+	for (const char* options : { "", " --pipeline" })
+	{
+		auto disk = scan(std::string("--memory-spill-limit 0 --temp-dir ") + tempDir.string() + options);
+		ASSERT_EQ(0, disk.first) << options;
+		ASSERT_LT(0, disk.second) << options;
+		// the directories of the extracted members are removed
+		ASSERT_TRUE(std::filesystem::is_empty(tempDir)) << options;
+#ifdef __linux__
+		auto memory = scan(options);
+		ASSERT_LT(0, memory.first) << options;
+		// members of unknown size are still spilled to disk
+		ASSERT_EQ(disk.second, memory.first + memory.second) << options;
+#endif
+	}
+	std::filesystem::remove_all(tempDir);
+}
+
+TEST(DirectoryScanner, ArchiveWorkers)
+{
+	ASSERT_EQ(std::vector<CArchiveScheduler::Range>({ { 0, 2 }, { 2, 4 } }), CArchiveScheduler::partition({ 10, 10, 10, 10 }, 2));
+	ASSERT_EQ(std::vector<CArchiveScheduler::Range>({ { 0, 1 }, { 1, 2 }, { 2, 4 } }), CArchiveScheduler::partition({ 100, 1, 1, 1 }, 3));
+	// archives without sizes are split by the number of members
+	ASSERT_EQ(std::vector<CArchiveScheduler::Range>({ { 0, 2 }, { 2, 4 } }), CArchiveScheduler::partition({ 0, 0, 0, 0 }, 2));
+	ASSERT_EQ(std::vector<CArchiveScheduler::Range>({ { 0, 1 } }), CArchiveScheduler::partition({ 5 }, 4));
+	ASSERT_TRUE(CArchiveScheduler::partition({}, 4).empty());
+
+	{
+		CArchiveScheduler scheduler(2);
+		std::atomic<int> runs[5] = {};
+		std::vector<CArchiveScheduler::Task> parts;
+		for (int i = 0; i < 5; i++)
+			parts.push_back([&runs, i]() { runs[i]++; });
+		// parts started by a worker must not wait for the busy workers
+		std::atomic<bool> nestedDone = false;
+		scheduler.submit([&]() { scheduler.runParts(parts); nestedDone = true; });
+		scheduler.submit([&]() { scheduler.runParts(parts); });
+		scheduler.wait();
+		ASSERT_TRUE(nestedDone);
+		for (auto& count : runs)
+			ASSERT_EQ(2, count);
+		parts.push_back([]() { throw std::runtime_error("part failed"); });
+		ASSERT_THROW(scheduler.runParts(parts), std::runtime_error);
+	}
+
+	auto scan = [](bool crcCheck, const std::string& options, uint64_t* archiveParts = nullptr) {
+		CDirectoryScannerMock cds(false, crcCheck, { ".*" }, { "" });
+		cds.parseOptions(options);
+		cds.scanPath(testDir);
+		EXPECT_EQ(0, cds.metrics().counter(CScanMetrics::counterErrors)) << options;
+		if (archiveParts)
+			*archiveParts = cds.metrics().counter(CScanMetrics::counterArchiveParts);
+		std::vector<std::string> files;
+		for (const auto& fr : cds.scannedFileInfo)
+			files.push_back(crcCheck ? std::to_string(fr.crc) : fr.logicalFilename);
+		std::sort(files.begin(), files.end());
+		return files;
+	};
+	const std::vector<std::string> all = scan(false, "");
+	const std::vector<std::string> crcs = scan(true, "");
+	ASSERT_EQ(16, crcs.size());
+	for (const char* options : { "--archive-workers 4", "--archive-workers 2 --threads 3", "--archive-workers 4 --archive-split-size 1",
+		"--archive-workers 3 --archive-split-size 1 --pipeline --extract-workers 2" })
+	{
+		// the logical file names and the duplicates skipped don't depend on the workers
+		uint64_t parts = 0;
+		ASSERT_EQ(all, scan(false, options, &parts)) << options;
+		ASSERT_EQ(crcs, scan(true, options)) << options;
+		if (std::string(options).find("split-size 1") != std::string::npos && std::string(options).find("pipeline") == std::string::npos)
+			ASSERT_LT(0, parts) << options;
+		else
+			ASSERT_EQ(0, parts) << options;
+	}
+}
+
+TEST(DirectoryScanner, ScanPaths)
+{
+	const std::filesystem::path root = testDir;
+#ifndef _WIN32
+	ASSERT_NE(0, CStorageDevice::id(root));
+#endif
+	ASSERT_EQ(CStorageDevice::id(root), CStorageDevice::id(root / "subdir_1"));
+	ASSERT_EQ(CStorageDevice::isRotational(root), CStorageDevice::isRotational(root / "subdir_1"));
+
+	auto files = [](CDirectoryScannerMock& cds) {
+		std::vector<std::string> names;
+		for (const auto& fr : cds.scannedFileInfo)
+			names.push_back(std::filesystem::path(fr.logicalFilename).lexically_normal().generic_string());
+		std::sort(names.begin(), names.end());
+		return names;
+	};
+	CDirectoryScannerMock reference(false, false, { ".*" }, { "" });
+	reference.scanPath(root);
+	const std::vector<std::string> all = files(reference);
+	std::vector<std::string> subdirs;
+	std::copy_if(all.begin(), all.end(), std::back_inserter(subdirs), [&root](const std::string& name) {
+		return name.starts_with((root / "subdir_1/").generic_string()) || name.starts_with((root / "subdir_2/").generic_string());
+	});
+	// 4 files and the members of subdir_z.zip
+	ASSERT_EQ(12, subdirs.size());
+
+	for (const char* options : { "", "--threads 4", "--pipeline" })
+	{
+		{
+			// roots inside another root and duplicates are scanned once
+			CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+			cds.parseOptions(options);
+			cds.scanPaths({ root / "subdir_1", root, root / "archives" / "test2.zip", root / ".." / root.filename() });
+			ASSERT_EQ(all, files(cds)) << options;
+			ASSERT_EQ(5, cds.metrics().counter(CScanMetrics::counterDirectories)) << options;
+		}
+		{
+			// a missing root is reported, the others are scanned
+			CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+			cds.parseOptions(options);
+			cds.scanPaths({ root / "subdir_1", root / "missing", root / "subdir_2" });
+			ASSERT_EQ(subdirs, files(cds)) << options;
+			ASSERT_EQ(1, cds.metrics().counter(CScanMetrics::counterErrors)) << options;
+		}
+	}
+
+	{
+		// the index keeps the files of every root: an unchanged rescan processes nothing
+		std::filesystem::path workDir = std::filesystem::temp_directory_path() / "DirectoryScanner_Roots";
+		std::filesystem::remove_all(workDir);
+		std::filesystem::create_directories(workDir / "A");
+		std::filesystem::create_directories(workDir / "B");
+		std::filesystem::copy_file(root / "file_0.txt", workDir / "A" / "file_0.txt");
+		std::filesystem::copy_file(root / "file_1.txt", workDir / "B" / "file_1.txt");
+		const std::string indexFile = (workDir / "index.dsix").string();
+		for (int pass = 0; pass < 3; pass++)
+		{
+			CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+			cds.parseCommandLineArguments({ "--index", indexFile });
+			cds.scanPaths({ workDir / "A", workDir / "B" });
+			ASSERT_EQ(pass == 0 ? 2 : 0, cds.scannedFileInfo.size()) << pass;
+			ASSERT_EQ(pass == 0 ? 2 : 0, cds.changes.size()) << pass;
+		}
+		std::filesystem::remove(workDir / "B" / "file_1.txt");
+		CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+		cds.parseCommandLineArguments({ "--index", indexFile });
+		cds.scanPaths({ workDir / "A", workDir / "B" });
+		ASSERT_EQ(0, cds.scannedFileInfo.size());
+		ASSERT_EQ(1, cds.changes.size());
+		ASSERT_EQ("file_1.txt", cds.changes[0].first);
+		ASSERT_EQ(CDirectoryScanner::changeRemoved, cds.changes[0].second);
+		std::filesystem::remove_all(workDir);
+	}
+
+#ifdef __linux__
+	// roots on two devices are scanned at the same time
+	std::filesystem::path shmDir = "/dev/shm/DirectoryScanner_Devices";
+	if (std::filesystem::is_directory(shmDir.parent_path()) && CStorageDevice::id(shmDir.parent_path()) != CStorageDevice::id(root)) {
+		std::filesystem::remove_all(shmDir);
+		std::filesystem::create_directories(shmDir);
+		std::filesystem::copy_file(root / "file_0.txt", shmDir / "file_0.txt");
+		std::vector<std::string> expected = subdirs;
+		expected.push_back((shmDir / "file_0.txt").generic_string());
+		std::sort(expected.begin(), expected.end());
+		for (const char* options : { "", "--threads 4" })
+		{
+			CDirectoryScannerMock cds(false, false, { ".*" }, { "" });
+			cds.parseOptions(options);
+			cds.scanPaths({ root / "subdir_1", shmDir, root / "subdir_2" });
+			ASSERT_EQ(expected, files(cds)) << options;
+		}
+		std::filesystem::remove_all(shmDir);
+	}
+#endif
+}
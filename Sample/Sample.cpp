@@ -2,6 +2,7 @@
 //
 
 #include <iostream>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -13,17 +14,16 @@ class FileLister : public CDirectoryScanner
 {
 	virtual void process_file(const std::filesystem::path& p, const std::filesystem::path& logicalFilename, crc_t crc) override
 	{
+		// roots on different devices are scanned concurrently
+		std::lock_guard<std::mutex> lock(m_mutex);
 		std::cout << "\n";
 		std::cout << p << "\n";
 		std::cout << logicalFilename << "\n";
 		std::cout << "\n";
 	}
 
-	//virtual std::ostream& logs(int indent = 0) override
-	//{
-	//	std::ostream cnull(0);
-	//	return cnull;
-	//}
+private:
+	std::mutex m_mutex;
 };
 
 FileLister cds;
@@ -66,10 +66,7 @@ int main(int argc, char* argv[])
 {
 	try {
 		parse_command_line(argc, argv);
-		for (auto s : searchPaths)
-		{
-			cds.scanPath(s);
-		}
+		cds.scanPaths(std::vector<std::filesystem::path>(searchPaths.begin(), searchPaths.end()));
 	}
 	catch (const std::exception& ex)
 	{